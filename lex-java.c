@@ -19,6 +19,11 @@
  * along with parse-java.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* fopencookie() of glibc is needed by the pipeline */
+#ifdef __linux__
+# define _GNU_SOURCE
+#endif /* __linux__ */
+
 #ifdef _MSC_VER
 /*
  * if using MSVC, suppress stupid security warnings, define snprintf and inline
@@ -28,179 +33,681 @@
 # define inline
 #endif /* _MSC_VER */
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "lexjava.h"
+#include "lexfile.h"
+
+#ifdef USE_THREADS
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif /* USE_THREADS */
+
+#define BUF_SIZE LEX_BUF_SIZE
+#define OUT_BUF_SIZE (BUF_SIZE << 4)
+
+/*
+ * reading, scanning and writing a single source overlap in a pipeline of
+ * threads wherever stdio streams can be made of callbacks
+ */
+#if defined(USE_THREADS) && defined(__GLIBC__)
+# define USE_PIPELINE
+#endif /* USE_THREADS && __GLIBC__ */
+
+/* a directory tree is watched wherever inotify is available */
+#if defined(USE_THREADS) && defined(__linux__)
+# define USE_WATCH
+# include <poll.h>
+# include <time.h>
+# include <sys/inotify.h>
+#endif /* USE_THREADS && __linux__ */
+
+#define BLOCK_SIZE (BUF_SIZE << 6)
+#define BLOCK_COUNT 8
+
 /*
- * two styles of state handler, one having a return value, the other not
- * see line 962 for more details
+ * version of outputs kept in a cache, to be bumped whenever the output of a
+ * source changes, so that no outdated output is reused
  */
-#define DEFINE_DO_STATE(stat) static inline void do_state_##stat(char c,\
-	int * state, char * word, int * length)
-#define DEFINE_DO_STATE_RETURN(stat) static inline int do_state_##stat(char c,\
-	int * state, char * word, int * length)
+#define CACHE_VERSION 3
+#define CACHE_BUDGET 1024
 
-#define BUF_SIZE 4096
+/*
+ * requests of a client not replied yet, beyond which it is not read on,
+ * buckets of the replies kept by a server, and their size in MB by default,
+ * and the largest source in MB a client may send, which is also how much of
+ * the sources it sends may be in memory at once
+ */
+#define SERVER_PIPELINE 256
+#define SERVER_BUCKETS 4096
+#define SERVER_BUDGET 256
+#define SERVER_MAX_SIZE 256
 
-/* get the size of an array, maybe defined */
-#ifndef ARRAY_SIZE
-# define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
-#endif /* ARRAY_SIZE */
+/*
+ * quiet time ending a burst of changes in watch mode, and the longest time a
+ * burst is waited for, in milliseconds, and the size of the buffer of events
+ */
+#define WATCH_DEBOUNCE 50
+#define WATCH_DELAY 1000
+#define WATCH_EVENTS_SIZE (BUF_SIZE << 2)
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | \
+	IN_MOVED_FROM | IN_MOVED_TO)
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
-/* attribute list */
+/* scanner buffers type, reused across all sources scanned by a thread */
+struct scanner_t
+{
+	struct input_t input;
+	struct binary_sink_t binary;
+	struct symbol_sink_t symbol;
+	struct text_sink_t text;
+	struct index_sink_t index;
+	struct space_sink_t space;
+	struct comment_sink_t comment;
+	struct lex_sink inner;      /* sink wrapped by the line index sink */
+	struct lex_sink spaced;     /* sink wrapped by the space sink */
+	struct lex_sink commented;  /* sink wrapped by the comment index sink */
+	char * unpacked;            /* entry of an archive unpacked */
+	size_t unpacked_capacity;
+	char output[OUT_BUF_SIZE];
+};
+
+/* command line options */
+static struct
+{
+	int binary;   /* write binary format */
+	int flags;    /* binary format flags, positions wanted in any format */
+	int symbols;  /* print identifiers as symbol IDs */
+	int threads;  /* threads scanning a single source in parallel */
+	int lines;    /* write lines into a line index */
+	int comments; /* write comments into a comment index */
+	int stats;    /* print statistics only, in a format of stats formats */
+	int spaces;   /* space sink mode, 0 to keep spaces as they are */
+	const char * cache;     /* cache directory, NULL if not wanted */
+	unsigned long budget;   /* cache size in MB kept after a batch */
+} options;
+
+/* stats formats */
 enum
 {
-	WRONG          = 0x101,
-	SPACE          = 0x102,
-	KEYWORD        = 0x103,
-	IDENTIFIER     = 0x104,
-	BOOLEAN        = 0x105,
-	CHAR           = 0x106,
-	INT            = 0x107,
-	FLOAT          = 0x108,
-	STRING         = 0x109,
-	ASSIGN         = 0x110,
-	CONDITION      = 0x111,
-	LOGIC_OR       = 0x112,
-	LOGIC_AND      = 0x113,
-	BIT_OR         = 0x114,
-	XOR            = 0x115,
-	BIT_AND        = 0x116,
-	EQUAL          = 0x117,
-	COMPARE        = 0x118,
-	SHIFT          = 0x119,
-	ADD_SUB        = 0x11a,
-	MUL_DIV        = 0x11b,
-	PLUSPLUS       = 0x11c,
-	BRACKET_DOT    = 0x11d,
-	COMMA          = 0x120,
-	BIG_BRACKET    = 0x121,
-	SEMICOLON      = 0x122,
-	COLON          = 0x123, /* in addition */
+	STATS_JSON = 1,
+	STATS_CSV,
+};
+
+/* names of word types in statistics, NULL for no type */
+static const char * kind_names[LEX_STATS_KINDS] = {
+	NULL, "WRONG", "SPACE", "KEYWORD", "IDENTIFIER", "BOOLEAN", "CHAR",
+	"INT", "FLOAT", "STRING", NULL, NULL, NULL, NULL, NULL, NULL,
+	"ASSIGN", "CONDITION", "LOGIC_OR", "LOGIC_AND", "BIT_OR", "XOR",
+	"BIT_AND", "EQUAL", "COMPARE", "SHIFT", "ADD_SUB", "MUL_DIV",
+	"PLUSPLUS", "BRACKET_DOT", NULL, NULL, "COMMA", "BIG_BRACKET",
+	"SEMICOLON", "COLON",
+};
+
+#ifdef USE_PIPELINE
+/* block type, a buffer passed between stages of the pipeline */
+struct block_t
+{
+	struct block_t * next;
+	size_t length;
+	char data[BLOCK_SIZE];
+};
+
+/*
+ * stage type, a thread reading or writing a file in blocks, which passes
+ * blocks to or from the scanning thread through a queue of full blocks, and
+ * gets them back through a queue of free blocks
+ * the scanning thread sees a stage as a stdio stream
+ */
+struct stage_t
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	FILE * fp;                  /* file read or written by the thread */
+	struct block_t * head;      /* queue of full blocks */
+	struct block_t * tail;
+	struct block_t * free;      /* queue of free blocks */
+	struct block_t * current;   /* block used by the scanning thread */
+	size_t pos;                 /* position in current block */
+	size_t total;               /* bytes written by the scanning thread */
+	int done;                   /* whether the other side has finished */
+	int error;
+};
+#endif /* USE_PIPELINE */
+
+#ifdef USE_THREADS
+/* archive type, a zip archive mapped into memory */
+struct archive_t
+{
+	struct archive_t * next;
+	char * path;
+	struct zip_t zip;
+};
+
+/*
+ * batch job type, a source file to scan, or an entry of an archive, whose
+ * path is 'ARCHIVE/ENTRY'
+ */
+struct job_t
+{
+	char * path;
+	off_t size;
+	struct archive_t * archive; /* archive of entry, NULL for a file */
+	struct zip_entry_t entry;   /* entry of archive */
+};
+
+/* job list type, a growing array of jobs, with the archives they are in */
+struct job_list_t
+{
+	struct job_t * jobs;
+	int count;
+	int capacity;
+	struct archive_t * archives;
+};
+
+/*
+ * job deque type
+ * the owner takes jobs from the head and the others steal from the tail
+ */
+struct deque_t
+{
+	pthread_mutex_t lock;
+	struct job_t * jobs;
+	int head;
+	int tail;
+};
+
+/* cache entry type, an output kept in a cache directory */
+struct entry_t
+{
+	char * name;
+	off_t size;
+	time_t used;                /* time of last use */
+};
+
+/*
+ * server request type, a source to scan for a client, which is in the order
+ * of requests of its client, and in the queue of the workers until taken
+ */
+struct request_t
+{
+	struct request_t * next;    /* next request of client */
+	struct request_t * queued;  /* next request to scan */
+	struct client_t * client;
+	char * path;                /* source file, NULL if data is given */
+	char * data;                /* source sent by client */
+	size_t size;                /* size of data */
+	char * reply;               /* NULL until answered */
+	size_t length;              /* length of reply */
+	int done;                   /* whether it can be replied */
+};
+
+/* server client type, a connection with its requests not replied yet */
+struct client_t
+{
+	int fd;
+	pthread_t sender;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;        /* signaled as requests are done or replied */
+	struct request_t * head;
+	struct request_t * tail;
+	int pending;                /* number of requests not replied */
+	size_t held;                /* bytes of sources and replies not sent */
+	int reading;                /* whether requests are still read */
+	int failed;                 /* whether a reply cannot be sent */
+};
+
+/*
+ * reply type, a reply kept by a server for a source of a hash and a size,
+ * in a bucket of the hash, and in order of use
+ */
+struct reply_t
+{
+	struct reply_t * next;      /* next in bucket */
+	struct reply_t * newer;
+	struct reply_t * older;
+	uint64_t hash;
+	size_t size;
+	size_t length;
+	char data[];
+};
+
+/* worker type, buffers are reused across all jobs of a worker */
+struct worker_t
+{
+	pthread_t thread;
+	int id;
+	int count;                  /* number of workers */
+	struct worker_t * workers;  /* all workers, including itself */
+	struct deque_t deque;
+	int failed;                 /* whether any of its jobs failed */
+	struct scanner_t scanner;
+};
+
+#ifdef USE_WATCH
+/* watched source type, a '*.java' under the directory watched */
+struct watched_t
+{
+	char * path;
+	uint64_t hash;              /* hash of content last scanned */
+	size_t size;                /* size of content last scanned */
+	int known;                  /* whether it is scanned and not removed */
+	int dirty;                  /* whether it is marked in this burst */
 };
 
 /*
- * keyword list
- * I have removed 'true' and 'false' from it since they are considered as
- * boolean constants
- */
-const static char * keywords[] = {
-	/* a */ "abstract",
-	/* b */ "boolean", "break", "byte",
-	/* c */ "case", "catch", "char", "class", "const", "continue",
-	/* d */ "default", "do", "double",
-	/* e */ "else", "extends",
-	/* f */ "final", "finally", "float", "for",
-	/* g */ "goto",
-	/* i */ "if", "implements", "import", "instanceof", "int", "interface",
-	/* l */ "long",
-	/* n */ "native", "new", "null",
-	/* p */ "package", "private", "protected", "public",
-	/* r */ "return",
-	/* s */ "short", "static","super","switch", "synchronized",
-	/* t */ "this", "throw", "throws", "transient", "try",
-	/* v */ "void", "volatile",
-	/* w */ "while",
+ * watch state type, of a directory tree watched, whose sources are indexed
+ * by the intern indexes of their paths
+ */
+struct watch_t
+{
+	int fd;                     /* inotify instance */
+	char ** dirs;               /* directory of each watch, NULL if none */
+	int dir_capacity;
+	struct intern_t paths;
+	struct watched_t * sources;
+	size_t count;
+	size_t capacity;            /* capacity of sources and dirty */
+	size_t * dirty;             /* sources marked in this burst */
+	size_t dirty_count;
+	struct scanner_t scanner;
 };
+#endif /* USE_WATCH */
 
-static void do_lex(FILE * src, FILE * out);
-static inline void do_output_word(FILE * out, const char * word, int type);
-static inline void do_output_wrong_word(FILE * out, const char * word,
-	int lines);
-static inline int do_judgement(const char * word);
-static inline void do_update_word_count(int * words, int * words_in_line);
-static inline void do_update_line_count(FILE * out, int * lines,
-	int * words_in_line);
-static inline void do_clear(char * word, int * length, int * state);
-static inline void do_output_word_count(FILE * out, int words);
-
-/* wrong word state handler */
-DEFINE_DO_STATE_RETURN(m1);
-
-/* initial state handler */
-DEFINE_DO_STATE_RETURN(0);
-
-/* keyword, boolean, identifier state handler */
-DEFINE_DO_STATE_RETURN(1);
-
-/* string, char state handler */
-DEFINE_DO_STATE(3);
-DEFINE_DO_STATE(5);
-DEFINE_DO_STATE(6_16);
-DEFINE_DO_STATE(7);
-DEFINE_DO_STATE(8_9_10_18_19_20);
-DEFINE_DO_STATE(11);
-DEFINE_DO_STATE(12);
-DEFINE_DO_STATE(13);
-DEFINE_DO_STATE(15);
-DEFINE_DO_STATE(17);
-DEFINE_DO_STATE(21);
-
-/* numeric constant state handler */
-DEFINE_DO_STATE_RETURN(22);
-DEFINE_DO_STATE_RETURN(23);
-DEFINE_DO_STATE_RETURN(24);
-DEFINE_DO_STATE(26);
-DEFINE_DO_STATE(27);
-DEFINE_DO_STATE_RETURN(28);
-DEFINE_DO_STATE_RETURN(29);
-DEFINE_DO_STATE(30);
-DEFINE_DO_STATE_RETURN(31);
-DEFINE_DO_STATE_RETURN(33);
-DEFINE_DO_STATE(34);
-
-/* operator state handler (except '/') */
-DEFINE_DO_STATE_RETURN(39);
-DEFINE_DO_STATE_RETURN(42);
-DEFINE_DO_STATE_RETURN(45_49_57_60_64_70_72);
-DEFINE_DO_STATE_RETURN(51);
-DEFINE_DO_STATE_RETURN(54);
-DEFINE_DO_STATE_RETURN(62);
-DEFINE_DO_STATE_RETURN(66_68);
-
-/* '/' state handler */
-DEFINE_DO_STATE_RETURN(47);
-DEFINE_DO_STATE_RETURN(74);
-DEFINE_DO_STATE_RETURN(75);
-DEFINE_DO_STATE_RETURN(77);
+/* server state, shared by all workers and clients */
+static struct
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;        /* signaled as requests are queued */
+	struct request_t * head;    /* queue of requests to scan */
+	struct request_t * tail;
+	pthread_mutex_t cache_lock; /* of the replies kept */
+	struct reply_t * buckets[SERVER_BUCKETS];
+	struct reply_t * newest;
+	struct reply_t * oldest;
+	size_t kept;                /* total length of replies kept */
+} server;
+#endif /* USE_THREADS */
+
+static int do_scan(FILE * src, FILE * out, FILE * lines, FILE * comments,
+	struct scanner_t * scanner);
+#ifdef USE_MMAP
+static int do_scan_stream(int fd, const struct lex_sink * sink);
+#endif /* USE_MMAP */
+static int do_open_sink(struct lex_sink * sink, FILE * out, FILE * lines,
+	FILE * comments, struct scanner_t * scanner);
+static int do_open_index(const char * out_path, const char * suffix,
+	int wanted, FILE ** fp);
+static int do_close_index(const char * out_path, const char * suffix,
+	FILE * fp);
+static int do_stats(char * const * paths, int count);
+static int do_stats_file(const char * path, FILE * src,
+	struct input_t * input, struct lex_stats * total);
+static void do_print_stats_header(void);
+static void do_print_stats(const char * path, const struct lex_stats * stats);
+static void do_print_histogram(const unsigned long * histogram, int json);
+static void do_print_string(const char * string, int json);
+static inline double do_ratio(unsigned long part, unsigned long whole);
+static int do_interact(FILE * src, struct scanner_t * scanner);
+static int do_write_doc(const struct doc_t * doc, struct scanner_t * scanner);
+
+#ifdef USE_PIPELINE
+static int do_pipeline(FILE * src, FILE * out, FILE * lines,
+	FILE * comments, struct scanner_t * scanner);
+static FILE * do_open_stage(struct stage_t * stage, FILE * fp, int writing);
+static int do_close_stage(struct stage_t * stage, FILE * fp);
+static void * do_read_blocks(void * arg);
+static void * do_write_blocks(void * arg);
+static ssize_t do_read_stage(void * cookie, char * buffer, size_t size);
+static ssize_t do_write_stage(void * cookie, const char * buffer,
+	size_t size);
+static int do_tell_stage(void * cookie, off64_t * offset, int whence);
+static int do_finish_reading(void * cookie);
+static int do_finish_writing(void * cookie);
+static void do_push(struct stage_t * stage, struct block_t ** queue,
+	struct block_t * block);
+static struct block_t * do_pop(struct stage_t * stage,
+	struct block_t ** queue);
+#endif /* USE_PIPELINE */
+
+#ifdef USE_THREADS
+static int do_batch(char * const * paths, int count, int threads);
+static int do_collect(struct job_list_t * list, const char * path,
+	int explicit);
+static int do_compare_job(const void * a, const void * b);
+static int do_compare_path(const void * a, const void * b);
+static void * do_work(void * arg);
+static int do_add_job(struct job_list_t * list, const char * path,
+	off_t size);
+static void do_free_jobs(struct job_list_t * list);
+static int do_take(struct deque_t * deque, int steal, struct job_t * job);
+static int do_lex_file(const struct job_t * job, struct scanner_t * scanner);
+static FILE * do_open_job(const struct job_t * job, char ** buffer,
+	size_t * capacity);
+static int do_cache_key(FILE * src, const char * data, size_t size,
+	char * entry);
+static int do_fetch_cache(const char * entry, const char * out_path,
+	char * buffer);
+static void do_store_cache(const char * entry, const char * out_path,
+	char * buffer);
+static int do_store_file(const char * entry, const char * path,
+	char * buffer);
+static int do_copy_file(FILE * from, FILE * to, char * buffer);
+static void do_evict_cache(void);
+static int do_compare_entry(const void * a, const void * b);
+static int do_server(const char * path, int threads);
+static void * do_serve_client(void * arg);
+static void do_queue_request(struct request_t * request, int scan);
+static void * do_serve(void * arg);
+static void do_answer(struct request_t * request, struct scanner_t * scanner);
+static int do_load(const char * path, char ** buffer, size_t * capacity,
+	size_t * size);
+static void do_reply(struct request_t * request);
+static void * do_send_replies(void * arg);
+static void do_hold(struct client_t * client, size_t size);
+static void do_release(struct client_t * client, size_t size);
+static int do_send(int fd, const char * data, size_t length);
+static void do_fail_request(struct request_t * request, const char * message);
+static void do_free_request(struct request_t * request);
+static void do_free_client(struct client_t * client);
+static int do_find_reply(struct request_t * request, uint64_t hash,
+	size_t size);
+static void do_keep_reply(const struct request_t * request, uint64_t hash,
+	size_t size);
+static inline void do_link_reply(struct reply_t * reply);
+static inline void do_unlink_reply(struct reply_t * reply);
+static int do_open_archive(struct job_list_t * list, const char * path);
+static int do_add_entry(struct job_list_t * list,
+	struct archive_t * archive, const struct zip_entry_t * entry);
+static int do_make_dirs(char * path);
+#endif /* USE_THREADS */
+
+#ifdef USE_WATCH
+static int do_watch(const char * path);
+static void do_watch_event(struct watch_t * watch,
+	const struct inotify_event * event);
+static int do_watch_tree(struct watch_t * watch, const char * path,
+	int explicit);
+static int do_watch_error(const char * path);
+static void do_unwatch_tree(struct watch_t * watch, const char * path);
+static void do_mark_source(struct watch_t * watch, const char * path);
+static void do_watch_burst(struct watch_t * watch);
+static int do_watch_scan(const char * path, const char * data, size_t size,
+	struct scanner_t * scanner);
+static void do_remove_outputs(const char * path);
+#endif /* USE_WATCH */
 
 int main(int argc, char * const * argv)
 {
-	FILE * fp1 = NULL, * fp2 = NULL;
-	const char * usage = "Usage: lex-java <SOURCE>\n\n";
+	FILE * fp1 = NULL, * fp2 = NULL, * fp3 = NULL, * fp4 = NULL;
+	const char * usage = "Usage: lex-java [-j JOBS] [-p] [OPTION]... "
+			     "<SOURCE>\n"
+			     "       lex-java -i [OPTION]... <SOURCE>\n"
+			     "       lex-java -b [-j JOBS] [-C DIR [-M MB]] "
+			     "[OPTION]...\n"
+			     "                <SOURCE|DIR|ARCHIVE>...\n"
+			     "       lex-java -m json|csv "
+			     "<SOURCE|DIR|ARCHIVE>...\n"
+			     "       lex-java -s SOCKET [-j JOBS] [-M MB] "
+			     "[OPTION]...\n"
+			     "       lex-java --watch DIR [OPTION]...\n"
+			     "In batch mode, each SOURCE and each '*.java' under "
+			     "DIR is scanned into\n"
+			     "'SOURCE.scanner_output' by JOBS threads, and each "
+			     "'*.java' in a '.jar' or\n"
+			     "'.zip' ARCHIVE into "
+			     "'ARCHIVE.scanner_output/ENTRY.scanner_output' "
+			     "without\n"
+			     "extracting it, otherwise a large SOURCE is split "
+			     "into chunks scanned by\n"
+			     "JOBS threads\n"
+			     "With -C, batch mode copies the output kept in DIR "
+			     "for a source of the same\n"
+			     "content instead of scanning it, and keeps no more "
+			     "than MB megabytes of\n"
+			     "outputs there, the least recently used dropped "
+			     "first, 1024 by default\n"
+			     "With -p, reading and writing are done by their own "
+			     "threads, overlapping\n"
+			     "with scanning\n"
+			     "With -i, edits are read from standard input, each "
+			     "as 'OFFSET REMOVED LENGTH'\n"
+			     "and a newline followed by LENGTH bytes, and after "
+			     "each one, only the lines\n"
+			     "needed are scanned again into 'scanner_output', "
+			     "and the span scanned is printed\n"
+			     "With -s, sources are scanned for clients on a Unix "
+			     "domain SOCKET by JOBS\n"
+			     "threads until killed, each request a line 'SCAN "
+			     "PATH', or 'DATA SIZE' and\n"
+			     "SIZE bytes, and each reply a line 'OK N L C' and "
+			     "N bytes of output, L of\n"
+			     "line index and C of comment index, or a line 'ERR "
+			     "MESSAGE', in order of\n"
+			     "requests, where replies of no more than MB "
+			     "megabytes are kept in memory,\n"
+			     "256 by default, and sources sent are no larger "
+			     "than 256 megabytes\n"
+			     "With --watch, each '*.java' under DIR is scanned "
+			     "as in batch mode, and then\n"
+			     "scanned again whenever its content changes, until "
+			     "killed, and the path of\n"
+			     "each source scanned or removed is printed\n"
+			     "With -m, nothing is written but statistics of each "
+			     "SOURCE and each '*.java'\n"
+			     "under DIR, and of all of them, printed as JSON or "
+			     "CSV records\n"
+			     "Options:\n"
+			     "  -B  write binary format instead of text\n"
+			     "  -c  write comments into a comment index "
+			     "'OUTPUT.comments'\n"
+			     "  -l  keep line records in binary format\n"
+			     "  -L  write lines into a line index 'OUTPUT.lines' "
+			     "instead of OUTPUT\n"
+			     "  -P  write where each word starts, as deltas "
+			     "from the word before\n"
+			     "  -S  print identifiers as symbol IDs in text "
+			     "format\n"
+			     "  -V  write values of numeric constants in binary "
+			     "format\n"
+			     "  -w none|run  write no spaces, or a word for each "
+			     "run of spaces in a line\n\n";
 	char err_msg[BUF_SIZE];
+	static struct scanner_t scanner;
+	const char * sock = NULL, * watched = NULL;
+	int i, batch = 0, interactive = 0, pipeline = 0, threads = 0, modes, ret;
+
+	/* parse options */
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-b") == 0) {
+			batch = 1;
+		} else if (strcmp(argv[i], "-i") == 0) {
+			interactive = 1;
+		} else if (strcmp(argv[i], "-p") == 0) {
+			pipeline = 1;
+		} else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			if ((threads = atoi(argv[++i])) <= 0) {
+				fprintf(stderr, "%s", usage);
+				goto error;
+			}
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			++i;
+			if (strcmp(argv[i], "json") == 0) {
+				options.stats = STATS_JSON;
+			} else if (strcmp(argv[i], "csv") == 0) {
+				options.stats = STATS_CSV;
+			} else {
+				fprintf(stderr, "%s", usage);
+				goto error;
+			}
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			sock = argv[++i];
+		} else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+			watched = argv[++i];
+		} else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+			options.cache = argv[++i];
+		} else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+			if ((options.budget = strtoul(argv[++i], NULL,
+				10)) == 0) {
+				fprintf(stderr, "%s", usage);
+				goto error;
+			}
+		} else if (strcmp(argv[i], "-B") == 0) {
+			options.binary = 1;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			options.comments = 1;
+		} else if (strcmp(argv[i], "-l") == 0) {
+			options.flags |= LEX_BIN_LINES;
+		} else if (strcmp(argv[i], "-L") == 0) {
+			options.lines = 1;
+		} else if (strcmp(argv[i], "-P") == 0) {
+			options.flags |= LEX_BIN_POSITIONS;
+		} else if (strcmp(argv[i], "-S") == 0) {
+			options.symbols = 1;
+		} else if (strcmp(argv[i], "-V") == 0) {
+			options.flags |= LEX_BIN_VALUES;
+		} else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			++i;
+			if (strcmp(argv[i], "none") == 0) {
+				options.spaces = LEX_SPACE_NONE;
+			} else if (strcmp(argv[i], "run") == 0) {
+				options.spaces = LEX_SPACE_RUN;
+			} else {
+				fprintf(stderr, "%s", usage);
+				goto error;
+			}
+		} else {
+			fprintf(stderr, "%s", usage);
+			goto error;
+		}
+	}
+
+	/* modes exclude each other, and options of other modes are refused */
+	modes = batch + interactive + (options.stats != 0) + (sock != NULL) +
+		(watched != NULL);
+	if (modes > 1 || (pipeline && modes != 0) || (threads != 0 &&
+		(interactive || options.stats || watched != NULL)) ||
+		(options.cache != NULL && !batch) || (options.budget != 0 &&
+		options.cache == NULL && sock == NULL)) {
+		fprintf(stderr, "%s", usage);
+		goto error;
+	}
+
+	/* so are options of the other format */
+	if ((!options.binary && (options.flags & (LEX_BIN_LINES |
+		LEX_BIN_VALUES))) || (options.binary && options.symbols)) {
+		fprintf(stderr, "%s", usage);
+		goto error;
+	}
+
+	/* statistics mode */
+	if (options.stats) {
+		if (i == argc) {
+			fprintf(stderr, "%s", usage);
+			goto error;
+		}
+		return do_stats(argv + i, argc - i);
+	}
+
+#ifdef USE_THREADS
+	/* batch mode */
+	if (batch) {
+		if (i == argc) {
+			fprintf(stderr, "%s", usage);
+			goto error;
+		}
+		return do_batch(argv + i, argc - i, threads);
+	}
 
-	/* restrict exactly 2 arguments */
-	if (argc != 2) {
+	/* server mode */
+	if (sock != NULL) {
+		if (i != argc) {
+			fprintf(stderr, "%s", usage);
+			goto error;
+		}
+		return do_server(sock, threads);
+	}
+#endif /* USE_THREADS */
+
+#ifdef USE_WATCH
+	/* watch mode */
+	if (watched != NULL) {
+		if (i != argc) {
+			fprintf(stderr, "%s", usage);
+			goto error;
+		}
+		return do_watch(watched);
+	}
+#endif /* USE_WATCH */
+
+	/* restrict exactly 1 source */
+	if (batch || i != argc - 1) {
 		fprintf(stderr, "%s", usage);
 		goto error;
 	}
+	options.threads = threads;
 
 	/* open source file */
-	if ((fp1 = fopen(argv[1], "r")) == NULL) {
+	if ((fp1 = fopen(argv[i], "r")) == NULL) {
 		snprintf(err_msg, BUF_SIZE, "lex-java: cannot open '%s'",
-			argv[1]);
+			argv[i]);
 		perror(err_msg);
 		goto error;
 	}
 
+	/* scan edits incrementally */
+	if (interactive) {
+		if (do_interact(fp1, &scanner) != 0) {
+			goto error;
+		}
+		fclose(fp1);
+		return 0;
+	}
+
 	/* open output file */
-	if ((fp2 = fopen("scanner_output", "w")) == NULL) {
+	if ((fp2 = fopen("scanner_output", "wb")) == NULL) {
 		perror("lex-java: cannot open 'scanner_output'");
 		goto error;
 	}
+	if (do_open_index("scanner_output", ".lines", options.lines,
+		&fp3) != 0 || do_open_index("scanner_output", ".comments",
+		options.comments, &fp4) != 0) {
+		goto error;
+	}
 
 	/* do lexical analysis */
-	do_lex(fp1, fp2);
+#ifdef USE_PIPELINE
+	ret = pipeline ? do_pipeline(fp1, fp2, fp3, fp4, &scanner) :
+		do_scan(fp1, fp2, fp3, fp4, &scanner);
+#else
+	ret = do_scan(fp1, fp2, fp3, fp4, &scanner);
+#endif /* USE_PIPELINE */
+	if (ret != 0) {
+		perror("lex-java: cannot write 'scanner_output'");
+		goto error;
+	}
 
 	fclose(fp1);
-	fclose(fp2);
-	return 0;
+	if (fclose(fp2) != 0) {
+		fp1 = fp2 = NULL;
+		perror("lex-java: cannot write 'scanner_output'");
+		goto error;
+	}
+	ret = do_close_index("scanner_output", ".lines", fp3);
+	if (do_close_index("scanner_output", ".comments", fp4) != 0) {
+		ret = -1;
+	}
+	return ret != 0 ? 1 : 0;
 
 error:
 	if (fp1 != NULL) {
@@ -209,1521 +716,3069 @@ error:
 	if (fp2 != NULL) {
 		fclose(fp2);
 	}
+	if (fp3 != NULL) {
+		fclose(fp3);
+	}
+	if (fp4 != NULL) {
+		fclose(fp4);
+	}
 	return 1;
 }
 
 /*
- * do lexical analysis
+ * scan a source into an output file in the format given by options
  *
  * @src: a FILE pointer of Java source file
  * @out: a FILE pointer of output file
+ * @lines: a FILE pointer of line index file, NULL if not wanted
+ * @comments: a FILE pointer of comment index file, NULL if not wanted
+ * @scanner: buffers of the scanning thread
+ *
+ * return: 0 on success, -1 on write error
  */
-static void do_lex(FILE * src, FILE * out)
+static int do_scan(FILE * src, FILE * out, FILE * lines, FILE * comments,
+	struct scanner_t * scanner)
 {
-	char buffer[BUF_SIZE << 1]; /* double-sized buffer */
-	int pos = 0, end = 0;
-	size_t nread;
-	int i;
+	struct lex_sink sink;
+#ifdef USE_MMAP
+	struct stat st;
+#endif /* USE_MMAP */
 
-	int state = 0, condition_flag = 0, tmp;
-	int words = 0, lines = 0;
-	int words_in_line = 0;
-	int length = 0;
-	char word[BUF_SIZE] = { 0 };
-
-	while (!end) {
-		nread = fread(buffer + pos, sizeof(char), BUF_SIZE, src);
-		/* manually add a newline at the last buffer */
-		if (nread < BUF_SIZE) {
-			buffer[pos + nread] = '\n';
-			++nread;
-			end = 1;
-		}
-
-		i = 0; /* character counter in current buffer */
-		while (i < nread) {
-			switch (state) {
-			/* inside a wrong word */
-			case -1:
-				if (!do_state_m1(buffer[pos + i], &state, word,
-					&length)) {
-					++i;
-				}
-				break;
+	if (do_open_sink(&sink, out, lines, comments, scanner) != 0) {
+		return -1;
+	}
 
-			/* get a wrong word */
-			case -2:
-				do_output_wrong_word(out, word, lines + 1);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
+#ifdef USE_MMAP
+	/* pipes and terminals are scanned as data arrives */
+	if (fstat(fileno(src), &st) == 0 && !S_ISREG(st.st_mode)) {
+		if (do_scan_stream(fileno(src), &sink) != 0) {
+			return -1;
+		}
+		return ferror(out) ? -1 : 0;
+	}
+#endif /* USE_MMAP */
 
-			/* initial */
-			case 0:
-				tmp = do_state_0(buffer[pos + i], &state, word,
-					&length);
-				if (tmp) {
-					if (!condition_flag) {
-						condition_flag = tmp;
-						word[--length] = '\0';
-					} else {
-						state = -1;
-					}
-				}
-				++i;
-				break;
+#ifdef USE_THREADS
+	if (options.threads > 1) {
+		do_lex_parallel(src, &sink, &scanner->input, options.threads);
+		return ferror(out) ? -1 : 0;
+	}
+#endif /* USE_THREADS */
+	do_lex(src, &sink, &scanner->input);
+	return ferror(out) ? -1 : 0;
+}
 
-			/* inside a keyword, boolean value or identifier */
-			case 1:
-				if (!do_state_1(buffer[pos + i], &state, word,
-					&length)) {
-					++i;
-				}
-				break;
+#ifdef USE_MMAP
+/*
+ * scan a pipe or a terminal by feeding a lexer whatever each read returns,
+ * so that nothing waits for a full buffer
+ *
+ * @fd: file descriptor of Java source
+ * @sink: sink to report words and counts to
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+static int do_scan_stream(int fd, const struct lex_sink * sink)
+{
+	struct lexer_t * lexer;
+	char buffer[BUF_SIZE];
+	ssize_t n;
+	int ret = -1;
 
-			/* get a keyword, boolean value or identifier */
-			case 2:
-				do_output_word(out, word, do_judgement(word));
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
+	if ((lexer = do_start_lexer(sink)) == NULL) {
+		goto oom;
+	}
+	for (;;) {
+		if ((n = read(fd, buffer, BUF_SIZE)) < 0 && errno == EINTR) {
+			continue;
+		}
+		/* a read error ends the source, as it does for a stream */
+		if (n <= 0) {
+			break;
+		}
+		if (do_feed_lexer(lexer, buffer, n) != 0) {
+			goto oom;
+		}
+	}
+	if (do_finish_lexer(lexer) != 0) {
+		goto oom;
+	}
+	ret = 0;
+	goto out;
+
+oom:
+	perror("lex-java: cannot allocate lexer");
+out:
+	do_close_lexer(lexer);
+	return ret;
+}
+#endif /* USE_MMAP */
 
-			/* inside a string */
-			case 3:
-				do_state_3(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+/*
+ * set up a sink writing to an output file in the format given by options
+ *
+ * @sink: sink to set up
+ * @out: a FILE pointer of output file
+ * @lines: a FILE pointer of line index file, NULL if not wanted
+ * @comments: a FILE pointer of comment index file, NULL if not wanted
+ * @scanner: buffers of the scanning thread
+ *
+ * return: 0 on success, -1 on write error
+ */
+static int do_open_sink(struct lex_sink * sink, FILE * out, FILE * lines,
+	FILE * comments, struct scanner_t * scanner)
+{
+	struct lex_sink * commented = comments != NULL ?
+		&scanner->commented : sink;
+	struct lex_sink * spaced = options.spaces ?
+		&scanner->spaced : commented;
+	struct lex_sink * inner = lines != NULL ? &scanner->inner : spaced;
+
+	/* a sink wraps one set up before, to know if it wants positions */
+	if (options.binary) {
+		/* line records go to the line index instead */
+		if (do_binary_sink(inner, &scanner->binary, out,
+			lines != NULL ? options.flags & ~LEX_BIN_LINES :
+			options.flags) != 0) {
+			return -1;
+		}
+	} else if (options.symbols) {
+		do_symbol_sink(inner, &scanner->symbol, out,
+			options.flags & LEX_BIN_POSITIONS);
+	} else if (options.flags & LEX_BIN_POSITIONS) {
+		do_text_position_sink(inner, &scanner->text, out);
+	} else {
+		do_text_sink(inner, out);
+	}
+	if (lines != NULL && do_index_sink(spaced, &scanner->index, inner,
+		out, lines) != 0) {
+		return -1;
+	}
+	/* spaces are taken off before lines are counted into the index */
+	if (options.spaces) {
+		do_space_sink(commented, &scanner->space, spaced,
+			options.spaces);
+	}
+	if (comments != NULL) {
+		return do_comment_sink(sink, &scanner->comment, commented,
+			comments);
+	}
+	return 0;
+}
 
-			/* get a string */
-			case 4:
-				do_output_word(out, word, STRING);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
+/*
+ * open a sidecar index of an output file, a line index or a comment index
+ *
+ * @out_path: path of output file
+ * @suffix: suffix of index file added to out_path
+ * @wanted: whether the index is wanted by options
+ * @fp: a pointer to FILE pointer of index file, set to NULL if not wanted
+ *
+ * return: 0 on success, -1 on error
+ */
+static int do_open_index(const char * out_path, const char * suffix,
+	int wanted, FILE ** fp)
+{
+	char path[BUF_SIZE];
+	char err_msg[BUF_SIZE << 1];
 
-			/* inside a string and after a back slash */
-			case 5:
-				do_state_5(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+	*fp = NULL;
+	if (!wanted) {
+		return 0;
+	}
+	snprintf(path, BUF_SIZE, "%s%s", out_path, suffix);
+	if ((*fp = fopen(path, "wb")) == NULL) {
+		snprintf(err_msg, sizeof(err_msg), "lex-java: cannot open '%s'",
+			path);
+		perror(err_msg);
+		return -1;
+	}
+	return 0;
+}
 
-			/*
-			 * inside a string or a char and after a back slash and
-			 * an octal digit
-			 */
-			case 6: case 16:
-				do_state_6_16(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+/*
+ * close a sidecar index of an output file
+ *
+ * @out_path: path of output file
+ * @suffix: suffix of index file added to out_path
+ * @fp: a FILE pointer of index file, NULL if not wanted
+ *
+ * return: 0 on success, -1 on write error
+ */
+static int do_close_index(const char * out_path, const char * suffix,
+	FILE * fp)
+{
+	char err_msg[BUF_SIZE << 1];
+	int ret;
 
-			/*
-			 * inside a string and after a back slash and 2 octal
-			 * digits
-			 */
-			case 7:
-				do_state_7(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+	if (fp == NULL) {
+		return 0;
+	}
+	ret = ferror(fp) ? -1 : 0;
+	if (fclose(fp) != 0 || ret != 0) {
+		snprintf(err_msg, sizeof(err_msg),
+			"lex-java: cannot write '%s%s'", out_path, suffix);
+		perror(err_msg);
+		return -1;
+	}
+	return 0;
+}
 
-			/*
-			 * inside a string or a char and after a back slash and
-			 * a char 'u' and 0~2 hexadecimal digits
-			 */
-			case 8: case 9: case 10: /* string */
-			case 18: case 19: case 20: /* char */
-				do_state_8_9_10_18_19_20(buffer[pos + i],
-					&state, word, &length);
-				++i;
-				break;
+/****************************** statistics mode *******************************/
 
-			/*
-			 * inside a string and after a back slash and a char 'u'
-			 * and 3 hexadecimal digits
-			 */
-			case 11:
-				do_state_11(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+/*
+ * scan sources for statistics only, printing a record of each source and one
+ * of all of them to standard output
+ *
+ * @paths: source files, or directories when threads are used
+ * @count: number of paths
+ *
+ * return: 0 if all sources are scanned, 1 otherwise
+ */
+static int do_stats(char * const * paths, int count)
+{
+#ifdef USE_THREADS
+	struct job_list_t list = { NULL, 0, 0, NULL };
+	char * buffer = NULL;
+	size_t capacity = 0;
+	FILE * src;
+#endif /* USE_THREADS */
+	static struct input_t input;
+	struct lex_stats total;
+	int i, status = 0, collected = 1;
+
+	memset(&total, 0, sizeof(total));
+	if (options.stats == STATS_CSV) {
+		do_print_stats_header();
+	}
 
-			/* inside a char and do not have a char */
-			case 12:
-				do_state_12(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+#ifdef USE_THREADS
+	/*
+	 * directories are walked as in batch mode, and sources sorted by path,
+	 * while sources not all collected are not added up
+	 */
+	for (i = 0; i < count; ++i) {
+		if (do_collect(&list, paths[i], 1) != 0) {
+			status = 1;
+			collected = 0;
+		}
+	}
+	qsort(list.jobs, list.count, sizeof(struct job_t), do_compare_path);
+	for (i = 0; i < list.count; ++i) {
+		if ((src = do_open_job(&list.jobs[i], &buffer,
+			&capacity)) == NULL) {
+			status = 1;
+			continue;
+		}
+		status |= do_stats_file(list.jobs[i].path, src, &input,
+			&total);
+	}
+	do_free_jobs(&list);
+	free(buffer);
+#else
+	for (i = 0; i < count; ++i) {
+		status |= do_stats_file(paths[i], NULL, &input, &total);
+	}
+#endif /* USE_THREADS */
 
-			/* inside a char and have a char */
-			case 13:
-				do_state_13(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+	if (collected) {
+		do_print_stats(NULL, &total);
+	}
+	do_free_input(&input);
+	return status;
+}
 
-			/* get a char */
-			case 14:
-				do_output_word(out, word, CHAR);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
+/*
+ * scan a source for statistics, and print and add up them
+ *
+ * @path: path of source file
+ * @src: a FILE pointer of source, which is closed, NULL to open path
+ * @input: input buffer, reused across sources
+ * @total: statistics of all sources
+ *
+ * return: 0 on success, 1 if the source cannot be opened
+ */
+static int do_stats_file(const char * path, FILE * src,
+	struct input_t * input, struct lex_stats * total)
+{
+	struct lex_stats stats;
+	char err_msg[BUF_SIZE << 1];
 
-			/* inside a char and after a back slash */
-			case 15:
-				do_state_15(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+	if (src == NULL && (src = fopen(path, "r")) == NULL) {
+		snprintf(err_msg, sizeof(err_msg), "lex-java: cannot open '%s'",
+			path);
+		perror(err_msg);
+		return 1;
+	}
+	do_lex_stats(src, &stats, input);
+	fclose(src);
 
-			/*
-			 * inside a char and after a back slash and two octal
-			 * digits
-			 */
-			case 17:
-				do_state_17(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+	do_print_stats(path, &stats);
+	do_add_stats(total, &stats);
+	return 0;
+}
 
-			/*
-			 * inside a char and after a back slash and a char 'u'
-			 * and 3 hexadecimal digits
-			 */
-			case 21:
-				do_state_21(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+/* print the header of CSV records */
+static void do_print_stats_header(void)
+{
+	int i;
 
-			/* catch a dot */
-			case 22:
-				if (do_state_22(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, BRACKET_DOT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
+	printf("file,files,bytes,lines,words,comment_bytes,comment_ratio");
+	for (i = 0; i < LEX_STATS_KINDS; ++i) {
+		if (kind_names[i] != NULL) {
+			printf(",kind_%s", kind_names[i]);
+		}
+	}
+	for (i = 0; i < LEX_STATS_BUCKETS; ++i) {
+		printf(",line_length_%d", i);
+	}
+	for (i = 0; i < LEX_STATS_BUCKETS; ++i) {
+		printf(",identifier_length_%d", i);
+	}
+	printf("\n");
+}
 
-			/* catch a '1' ~ '9' */
-			case 23:
-				if (do_state_23(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, INT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
+/*
+ * print a record of statistics, as a JSON object on a line or a CSV row
+ * histograms are printed as arrays in JSON, or as a column each in CSV, and
+ * the last bucket holds every value not less than its index
+ *
+ * @path: path of source, NULL for all sources
+ * @stats: statistics
+ */
+static void do_print_stats(const char * path, const struct lex_stats * stats)
+{
+	const char * separator;
+	int json = options.stats == STATS_JSON, i;
+
+	if (json) {
+		printf("{\"file\":");
+		do_print_string(path, 1);
+		printf(",\"files\":%lu,\"bytes\":%lu,\"lines\":%lu,"
+			"\"words\":%lu,\"comment_bytes\":%lu,"
+			"\"comment_ratio\":%.4f,\"kinds\":{", stats->files,
+			stats->bytes, stats->lines, stats->words,
+			stats->comment_bytes, do_ratio(stats->comment_bytes,
+			stats->bytes));
+	} else {
+		do_print_string(path, 0);
+		printf(",%lu,%lu,%lu,%lu,%lu,%.4f", stats->files, stats->bytes,
+			stats->lines, stats->words, stats->comment_bytes,
+			do_ratio(stats->comment_bytes, stats->bytes));
+	}
 
-			/* a float without 'f', 'F', 'd', 'D' or 'e', 'E' */
-			case 24:
-				if (do_state_24(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, FLOAT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
+	for (i = 0, separator = ""; i < LEX_STATS_KINDS; ++i) {
+		if (kind_names[i] == NULL) {
+			continue;
+		}
+		if (json) {
+			printf("%s\"%s\":%lu", separator, kind_names[i],
+				stats->kinds[i]);
+			separator = ",";
+		} else {
+			printf(",%lu", stats->kinds[i]);
+		}
+	}
 
-			/* a float ending with 'f', 'F', 'd' or 'D' */
-			case 25:
-				do_output_word(out, word, FLOAT);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
+	if (json) {
+		printf("},\"line_lengths\":");
+	}
+	do_print_histogram(stats->line_lengths, json);
+	if (json) {
+		printf(",\"identifier_lengths\":");
+	}
+	do_print_histogram(stats->identifier_lengths, json);
+	printf(json ? "}\n" : "\n");
+}
 
-			/* a float ending with 'e' or 'E' */
-			case 26:
-				do_state_26(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+/*
+ * print a histogram, as a JSON array, or as CSV columns after others
+ *
+ * @histogram: histogram of LEX_STATS_BUCKETS buckets
+ * @json: whether to print JSON
+ */
+static void do_print_histogram(const unsigned long * histogram, int json)
+{
+	int i;
 
-			/* a float ending with 'e+', 'e-', 'E+' or 'E-' */
-			case 27:
-				do_state_27(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
+	for (i = 0; i < LEX_STATS_BUCKETS; ++i) {
+		printf("%s%lu", json && i == 0 ? "[" : ",", histogram[i]);
+	}
+	if (json) {
+		printf("]");
+	}
+}
 
-			/* a float ending with 'e' or 'E' and a valid number */
-			case 28:
-				if (do_state_28(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, FLOAT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
+/*
+ * print a string quoted as JSON or CSV wants
+ *
+ * @string: string to print, NULL for null in JSON, or nothing in CSV
+ * @json: whether to print JSON
+ */
+static void do_print_string(const char * string, int json)
+{
+	const char * p;
 
-			/* catch a '0' */
-			case 29:
-				if (do_state_29(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, INT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
+	if (string == NULL) {
+		if (json) {
+			printf("null");
+		}
+		return;
+	}
+	if (!json && strpbrk(string, ",\"\r\n") == NULL) {
+		printf("%s", string);
+		return;
+	}
 
-			/* catch a '0x' or '0X' */
-			case 30:
-				do_state_30(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
-
-			/* int in hexadecimal */
-			case 31:
-				if (do_state_31(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, INT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* int ending with 'l' or 'L' */
-			case 32:
-				do_output_word(out, word, INT);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* int in octal */
-			case 33:
-				if (do_state_33(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, INT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/*
-			 * number starting with '0' and have occurrence of '8'
-			 * or '9'
-			 */
-			case 34:
-				do_state_34(buffer[pos + i], &state, word,
-					&length);
-				++i;
-				break;
-
-			/* catch a '[', ']', '(' or ')' */
-			case 35:
-				do_output_word(out, word, BRACKET_DOT);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a ',' */
-			case 36:
-				do_output_word(out, word, COMMA);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '{' or '}' */
-			case 37:
-				do_output_word(out, word, BIG_BRACKET);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a ';' */
-			case 38:
-				do_output_word(out, word, SEMICOLON);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '+' */
-			case 39:
-				if (do_state_39(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, ADD_SUB);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/*
-			 * catch a '+=', '-=', '*=', '/=', '%=',
-			 * '&=', '|=', '^=', '<<=', '>>=' or '>>>='
-			 */
-			case 40: case 43: case 46: case 48: case 50:
-			case 52: case 55: case 58: case 65: case 69: case 71:
-				do_output_word(out, word, ASSIGN);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '++', '--' or '~' */
-			case 41: case 44: case 59:
-				do_output_word(out, word, PLUSPLUS);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '-' */
-			case 42:
-				if (do_state_42(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, ADD_SUB);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '*' or '%' */
-			case 45: case 49:
-				if (do_state_45_49_57_60_64_70_72(buffer[pos + i],
-					&state, word, &length)) {
-					do_output_word(out, word, MUL_DIV);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '/' */
-			case 47:
-				if (do_state_47(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, MUL_DIV);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '&' */
-			case 51:
-				if (do_state_51(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, BIT_AND);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '&&' */
-			case 53:
-				do_output_word(out, word, LOGIC_AND);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '|' */
-			case 54:
-				if (do_state_54(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, BIT_OR);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '||' */
-			case 56:
-				do_output_word(out, word, LOGIC_OR);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '^' */
-			case 57:
-				if (do_state_45_49_57_60_64_70_72(buffer[pos + i],
-					&state, word, &length)) {
-					do_output_word(out, word, XOR);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '!' */
-			case 60:
-				if (do_state_45_49_57_60_64_70_72(buffer[pos + i],
-					&state, word, &length)) {
-					do_output_word(out, word, PLUSPLUS);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '!=' or '==' */
-			case 61: case 73:
-				do_output_word(out, word, EQUAL);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '<' */
-			case 62:
-				if (do_state_62(buffer[pos + i], &state, word,
-					&length)) {
-					do_output_word(out, word, COMPARE);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '<=' or '>=' */
-			case 63: case 67:
-				do_output_word(out, word, COMPARE);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '<<' or '>>>' */
-			case 64: case 70:
-				if (do_state_45_49_57_60_64_70_72(buffer[pos + i],
-					&state, word, &length)) {
-					do_output_word(out, word, SHIFT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '>' */
-			case 66:
-				if (do_state_66_68(buffer[pos + i], &state,
-					word, &length)) {
-					do_output_word(out, word, COMPARE);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '>>' */
-			case 68:
-				if (do_state_66_68(buffer[pos + i], &state,
-					word, &length)) {
-					do_output_word(out, word, SHIFT);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			/* catch a '=' */
-			case 72:
-				if (do_state_45_49_57_60_64_70_72(buffer[pos + i],
-					&state, word, &length)) {
-					do_output_word(out, word, ASSIGN);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					++i;
-				}
-				break;
-
-			// catch a '/*', block comment start
-			case 74:
-				if (do_state_74(buffer[pos + i], &state, word,
-					&length)) {
-					do_update_line_count(out, &lines,
-						&words_in_line);
-				}
-				++i;
-				break;
-
-			/* catch a '*' in block comment */
-			case 75:
-				if (do_state_75(buffer[pos + i], &state, word,
-					&length)) {
-					do_update_line_count(out, &lines,
-						&words_in_line);
-				}
-				++i;
-				break;
-
-			// catch a '*/' in block comment, block comment end
-			case 76:
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '//', line comment start */
-			case 77:
-				if (do_state_77(buffer[pos + i], &state, word,
-					&length)) {
-					do_update_line_count(out, &lines,
-						&words_in_line);
-				}
-				++i;
-				break;
-
-			/* catch a '\n' in line comment, line comment end */
-			case 78:
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a ' ', '\t' or '\r' */
-			case 79:
-				do_output_word(out, word, SPACE);
-				do_update_word_count(&words, &words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a '\n' */
-			case 80:
-				do_output_word(out, word, SPACE);
-				do_update_word_count(&words, &words_in_line);
-				do_update_line_count(out, &lines,
-					&words_in_line);
-				do_clear(word, &length, &state);
-				break;
-
-			/* catch a ':' after '?' */
-			case 81:
-				if (condition_flag) {
-					do_output_word(out, "?:", CONDITION);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				} else {
-					do_output_word(out, word, COLON);
-					do_update_word_count(&words,
-						&words_in_line);
-					do_clear(word, &length, &state);
-				}
-				break;
-
-			default:
-				fprintf(stderr, "illegal state %d\n", state);
-				return;
-			}
+	putchar('"');
+	for (p = string; *p != '\0'; ++p) {
+		if (*p == '"') {
+			printf(json ? "\\\"" : "\"\"");
+		} else if (json && *p == '\\') {
+			printf("\\\\");
+		} else if (json && (unsigned char)*p < 0x20) {
+			printf("\\u%04x", (unsigned char)*p);
+		} else {
+			putchar(*p);
 		}
-		pos = (pos + BUF_SIZE) % (BUF_SIZE << 1);
 	}
-	do_output_word_count(out, words);
+	putchar('"');
 }
 
 /*
- * print a word to output file
+ * divide two counts
  *
- * @out: a FILE pointer of output file
- * @word: word to print
- * @type: word type, see attribute list at line 51
+ * @part: dividend
+ * @whole: divisor
+ *
+ * return: quotient, 0 if whole is 0
  */
-static inline void do_output_word(FILE * out, const char * word, int type)
+static inline double do_ratio(unsigned long part, unsigned long whole)
 {
-	fprintf(out, "0x%x\t%s\n", type, word);
+	return whole != 0 ? (double)part / whole : 0;
 }
 
+/****************************** interactive mode ******************************/
+
 /*
- * print a wrong word with line number to output file
+ * keep a source in memory, and scan it again incrementally on each edit read
+ * from standard input, rewriting 'scanner_output' and printing the span
+ * scanned as "FROM TO"
  *
- * @out: a FILE pointer of output file
- * @word: wrong word to print
- * @lines: current line number
+ * @src: a FILE pointer of Java source file
+ * @scanner: buffers of the scanning thread
+ *
+ * return: 0 on success, -1 on error
  */
-static inline void do_output_wrong_word(FILE * out, const char * word,
-	int lines)
+static int do_interact(FILE * src, struct scanner_t * scanner)
 {
-	fprintf(out, "0x%x\t%s at line %d\n", WRONG, word, lines);
+	static struct doc_t doc;
+	unsigned long offset, removed, length;
+	char * text = NULL, * p;
+	size_t size = 0, capacity = BUF_SIZE, n;
+	int ret = -1;
+
+	/* read the whole source */
+	if ((text = malloc(capacity)) == NULL) {
+		goto oom;
+	}
+	while ((n = fread(text + size, sizeof(char), capacity - size,
+		src)) != 0) {
+		size += n;
+		if (size == capacity) {
+			if ((p = realloc(text, capacity << 1)) == NULL) {
+				goto oom;
+			}
+			text = p;
+			capacity <<= 1;
+		}
+	}
+	if (do_open_doc(&doc, text, size) != 0) {
+		goto oom;
+	}
+	if (do_write_doc(&doc, scanner) != 0) {
+		goto out;
+	}
+
+	while (scanf("%lu %lu %lu", &offset, &removed, &length) == 3 &&
+		getchar() == '\n') {
+		if (length > capacity) {
+			if ((p = realloc(text, length)) == NULL) {
+				goto oom;
+			}
+			text = p;
+			capacity = length;
+		}
+		if (fread(text, sizeof(char), length, stdin) != length) {
+			break;
+		}
+		if (offset > doc.size || removed > doc.size - offset) {
+			printf("error\n");
+			fflush(stdout);
+			continue;
+		}
+		if (do_edit_doc(&doc, offset, removed, text, length) != 0) {
+			goto oom;
+		}
+		if (do_write_doc(&doc, scanner) != 0) {
+			goto out;
+		}
+		printf("%lu %lu\n", (unsigned long)doc.from,
+			(unsigned long)doc.to);
+		fflush(stdout);
+	}
+	ret = 0;
+	goto out;
+
+oom:
+	perror("lex-java: cannot allocate document");
+out:
+	free(text);
+	do_free_doc(&doc);
+	return ret;
 }
 
 /*
- * determine if a word is a boolean value, a keyword or an identifier
+ * write the tokens of a document into 'scanner_output'
  *
- * @word: word to judge
+ * @doc: document
+ * @scanner: buffers of the scanning thread
  *
- * return: word type, see attribute list at line 51
+ * return: 0 on success, -1 on error
  */
-static inline int do_judgement(const char * word)
+static int do_write_doc(const struct doc_t * doc, struct scanner_t * scanner)
 {
-	int i;
+	struct lex_sink sink;
+	FILE * out, * lines, * comments = NULL;
+	int ret;
 
-	if (strcmp(word, "true") == 0 || strcmp(word, "false") == 0) {
-		return BOOLEAN;
+	if ((out = fopen("scanner_output", "wb")) == NULL) {
+		perror("lex-java: cannot open 'scanner_output'");
+		return -1;
 	}
-
-	for (i = 0; i < ARRAY_SIZE(keywords); ++i) {
-		if (strcmp(word, keywords[i]) == 0) {
-			return KEYWORD;
-		}
+	if (do_open_index("scanner_output", ".lines", options.lines,
+		&lines) != 0 || do_open_index("scanner_output", ".comments",
+		options.comments, &comments) != 0) {
+		goto error;
+	}
+	setvbuf(out, scanner->output, _IOFBF, OUT_BUF_SIZE);
+	if ((ret = do_open_sink(&sink, out, lines, comments, scanner)) == 0) {
+		do_report_doc(doc, &sink);
+		ret = ferror(out) ? -1 : 0;
+	}
+	if (fclose(out) != 0 || ret != 0) {
+		out = NULL;
+		perror("lex-java: cannot write 'scanner_output'");
+		goto error;
+	}
+	ret = do_close_index("scanner_output", ".lines", lines);
+	if (do_close_index("scanner_output", ".comments", comments) != 0) {
+		ret = -1;
 	}
+	return ret;
 
-	return IDENTIFIER;
+error:
+	if (out != NULL) {
+		fclose(out);
+	}
+	if (lines != NULL) {
+		fclose(lines);
+	}
+	if (comments != NULL) {
+		fclose(comments);
+	}
+	return -1;
 }
 
+/********************************* pipeline ***********************************/
+#ifdef USE_PIPELINE
+
 /*
- * update word count
+ * scan a source into an output file, with a thread reading the source ahead
+ * and a thread writing the output behind, so that waiting for a slow disk
+ * overlaps with scanning
+ *
+ * @src: a FILE pointer of Java source file
+ * @out: a FILE pointer of output file
+ * @lines: a FILE pointer of line index file, NULL if not wanted, which is
+ *         written by the scanning thread
+ * @comments: a FILE pointer of comment index file, NULL if not wanted,
+ *            which is written by the scanning thread as well
+ * @scanner: buffers of the scanning thread
  *
- * @words: total word count
- * @words_in_line: current line word count
+ * return: 0 on success, -1 on error
  */
-static inline void do_update_word_count(int * words, int * words_in_line)
+static int do_pipeline(FILE * src, FILE * out, FILE * lines,
+	FILE * comments, struct scanner_t * scanner)
 {
-	++*words;
-	++*words_in_line;
+	static struct stage_t reader, writer;
+	FILE * in, * fp;
+	int ret = -1;
+
+	if ((in = do_open_stage(&reader, src, 0)) == NULL) {
+		return -1;
+	}
+	if ((fp = do_open_stage(&writer, out, 1)) != NULL) {
+		setvbuf(fp, scanner->output, _IOFBF, OUT_BUF_SIZE);
+		ret = do_scan(in, fp, lines, comments, scanner);
+		if (do_close_stage(&writer, fp) != 0) {
+			ret = -1;
+		}
+	}
+	do_close_stage(&reader, in);
+	return ret;
 }
 
 /*
- * update and print line count and in-line word count
+ * start a stage, reading or writing a file by a thread
  *
- * @out: a FILE pointer of output file
- * @lines: line count
- * @words_in_line: current line word count
+ * @stage: stage to start
+ * @fp: a FILE pointer of file to read or write
+ * @writing: whether the file is written
+ *
+ * return: a stream of stage for the scanning thread, NULL on error
  */
-static inline void do_update_line_count(FILE * out, int * lines,
-	int * words_in_line)
+static FILE * do_open_stage(struct stage_t * stage, FILE * fp, int writing)
 {
-	++*lines;
-	if (*words_in_line < 2) {
-		fprintf(out, "line %d has %d word\n", *lines, *words_in_line);
+	cookie_io_functions_t functions = {NULL, NULL, NULL, NULL};
+	struct block_t * block;
+	FILE * stream;
+	int i;
+
+	memset(stage, 0, sizeof(*stage));
+	stage->fp = fp;
+	for (i = 0; i < BLOCK_COUNT; ++i) {
+		if ((block = malloc(sizeof(struct block_t))) == NULL) {
+			perror("lex-java: cannot allocate pipeline");
+			goto error;
+		}
+		block->next = stage->free;
+		stage->free = block;
+	}
+
+	if (writing) {
+		functions.write = do_write_stage;
+		functions.seek = do_tell_stage;
+		functions.close = do_finish_writing;
 	} else {
-		fprintf(out, "line %d has %d words\n", *lines, *words_in_line);
+		functions.read = do_read_stage;
+		functions.close = do_finish_reading;
+	}
+	if ((stream = fopencookie(stage, writing ? "w" : "r",
+		functions)) == NULL) {
+		perror("lex-java: cannot open pipeline");
+		goto error;
+	}
+
+	pthread_mutex_init(&stage->lock, NULL);
+	pthread_cond_init(&stage->cond, NULL);
+	if (pthread_create(&stage->thread, NULL,
+		writing ? do_write_blocks : do_read_blocks, stage) != 0) {
+		perror("lex-java: cannot start pipeline");
+		pthread_cond_destroy(&stage->cond);
+		pthread_mutex_destroy(&stage->lock);
+		/* nothing is read or written without the thread */
+		stage->done = 1;
+		stage->error = 1;
+		stage->current = NULL;
+		fclose(stream);
+		goto error;
+	}
+	return stream;
+
+error:
+	while ((block = stage->free) != NULL) {
+		stage->free = block->next;
+		free(block);
 	}
-	*words_in_line = 0;
+	return NULL;
 }
 
 /*
- * clear current word and set state to 0
+ * stop a stage, waiting for its thread
+ *
+ * @stage: stage to stop
+ * @fp: stream of stage
  *
- * @word: current word
- * @length: length of current word
- * @state: DFA state
+ * return: 0 on success, -1 on error
  */
-static inline void do_clear(char * word, int * length, int * state)
+static int do_close_stage(struct stage_t * stage, FILE * fp)
 {
-	memset(word, 0, BUF_SIZE * sizeof(char));
-	*length = 0;
-	*state = 0;
+	struct block_t * block;
+	int ret = fclose(fp) != 0 || stage->error ? -1 : 0;
+
+	pthread_cond_destroy(&stage->cond);
+	pthread_mutex_destroy(&stage->lock);
+	free(stage->current);
+	while ((block = stage->head) != NULL) {
+		stage->head = block->next;
+		free(block);
+	}
+	while ((block = stage->free) != NULL) {
+		stage->free = block->next;
+		free(block);
+	}
+	return ret;
 }
 
 /*
- * print total word count to output file
+ * thread reading a file into blocks, until the end of file, or until the
+ * scanning thread finishes
  *
- * @out: a FILE pointer of output file
- * @words: total word count
+ * @arg: stage
+ *
+ * return: NULL
  */
-static inline void do_output_word_count(FILE * out, int words)
+static void * do_read_blocks(void * arg)
 {
-	fprintf(out, "total %d words\n", words);
+	struct stage_t * stage = arg;
+	struct block_t * block;
+
+	while ((block = do_pop(stage, &stage->free)) != NULL) {
+		block->length = fread(block->data, sizeof(char), BLOCK_SIZE,
+			stage->fp);
+		if (block->length < BLOCK_SIZE && ferror(stage->fp)) {
+			stage->error = 1;
+		}
+		do_push(stage, &stage->head, block);
+		/* a block not full is the last one */
+		if (block->length < BLOCK_SIZE) {
+			break;
+		}
+	}
+	return NULL;
 }
 
-/***************************** DFA state handlers *****************************/
 /*
- * most handlers do not have a return value, or have a return value of int
- * indicating whether it should accept the current word or move on scanning
+ * thread writing blocks into a file, until the scanning thread finishes and
+ * every block is written
  *
- * there are also comment handlers returning an int indicating whether it meets
- * a newline
+ * @arg: stage
  *
- * the only special case is state 0 handler, whose return value indicates
- * whether it meets a '?'
+ * return: NULL
  */
-
-/* finish */
-DEFINE_DO_STATE_RETURN(m1)
+static void * do_write_blocks(void * arg)
 {
-	switch (c) {
-	/* reach the end of a wrong word when it meets a space or a delimiter */
-	case ' ': case '\t': case '\r': case '\n':
-	case '{': case '}': case '[': case ']': case '(': case ')':
-	case ',': case '.': case ';':
-		*state = -2;
-		return 1;
+	struct stage_t * stage = arg;
+	struct block_t * block;
 
-	default:
-		word[(*length)++] = c;
-		return 0;
+	while ((block = do_pop(stage, &stage->head)) != NULL) {
+		if (fwrite(block->data, sizeof(char), block->length,
+			stage->fp) != block->length) {
+			stage->error = 1;
+		}
+		do_push(stage, &stage->free, block);
+	}
+	if (fflush(stage->fp) != 0) {
+		stage->error = 1;
 	}
+	return NULL;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(0)
+/*
+ * read from a stage, called by stdio of the scanning thread
+ *
+ * @cookie: stage
+ * @buffer: buffer to read into
+ * @size: size of buffer
+ *
+ * return: number of bytes read, 0 at the end of file
+ */
+static ssize_t do_read_stage(void * cookie, char * buffer, size_t size)
 {
-	word[(*length)++] = c;
-
-	if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
-		c == '$' || c == '_') {
-		*state = 1;
-		return 0;
-	} else if (c >= '1' && c <= '9') {
-		*state = 23;
-		return 0;
+	struct stage_t * stage = cookie;
+	struct block_t * block = stage->current;
+	size_t n;
+
+	while (block == NULL || stage->pos == block->length) {
+		if (block != NULL) {
+			if (block->length < BLOCK_SIZE) {
+				return 0;
+			}
+			do_push(stage, &stage->free, block);
+		}
+		block = stage->current = do_pop(stage, &stage->head);
+		stage->pos = 0;
 	}
 
-	switch (c) {
-	case '\"':
-		*state = 3;
-		break;
-
-	case '\'':
-		*state = 12;
-		break;
-
-	case '.':
-		*state = 22;
-		break;
-
-	case '0':
-		*state = 29;
-		break;
-
-	case '[': case ']': case '(': case ')':
-		*state = 35;
-		break;
-
-	case ',':
-		*state = 36;
-		break;
-
-	case '{': case '}':
-		*state = 37;
-		break;
-
-	case ';':
-		*state = 38;
-		break;
-
-	case '+':
-		*state = 39;
-		break;
-
-	case '-':
-		*state = 42;
-		break;
-
-	case '*':
-		*state = 45;
-		break;
-
-	case '/':
-		*state = 47;
-		break;
-
-	case '%':
-		*state = 49;
-		break;
-
-	case '&':
-		*state = 51;
-		break;
-
-	case '|':
-		*state = 54;
-		break;
-
-	case '^':
-		*state = 57;
-		break;
-
-	case '~':
-		*state = 59;
-		break;
-
-	case '!':
-		*state = 60;
-		break;
-
-	case '<':
-		*state = 62;
-		break;
-
-	case '>':
-		*state = 66;
-		break;
-
-	case '=':
-		*state = 72;
-		break;
-
-	case ' ':
-		*state = 79;
-		break;
-
-	case '\t':
-		*state = 79;
-		word[*length - 1] = '\\';
-		word[(*length)++] = 't';
-		break;
-
-	case '\r':
-		*state = 79;
-		word[*length - 1] = '\\';
-		word[(*length)++] = 'r';
-		break;
-
-	case '\n':
-		*state = 80;
-		word[*length - 1] = '\\';
-		word[(*length)++] = 'n';
-		break;
-
-	case '?':
-		return 1;
-
-	case ':':
-		*state = 81;
-		break;
-
-	default:
-		*state = -1;
-		break;
+	n = block->length - stage->pos;
+	if (n > size) {
+		n = size;
 	}
-
-	return 0;
+	memcpy(buffer, block->data + stage->pos, n);
+	stage->pos += n;
+	return n;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(1)
+/*
+ * write to a stage, called by stdio of the scanning thread
+ *
+ * @cookie: stage
+ * @buffer: data to write
+ * @size: size of data
+ *
+ * return: size
+ */
+static ssize_t do_write_stage(void * cookie, const char * buffer,
+	size_t size)
 {
-	if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
-		(c >= '0' && c <= '9') || c == '$' || c == '_') {
-		word[(*length)++] = c;
-		return 0;
-	} else {
-		*state = 2;
-		return 1;
+	struct stage_t * stage = cookie;
+	size_t n, written = 0;
+
+	while (written < size) {
+		if (stage->current == NULL) {
+			stage->current = do_pop(stage, &stage->free);
+			stage->pos = 0;
+		}
+		n = BLOCK_SIZE - stage->pos;
+		if (n > size - written) {
+			n = size - written;
+		}
+		memcpy(stage->current->data + stage->pos, buffer + written, n);
+		stage->pos += n;
+		written += n;
+		if (stage->pos == BLOCK_SIZE) {
+			stage->current->length = BLOCK_SIZE;
+			do_push(stage, &stage->head, stage->current);
+			stage->current = NULL;
+		}
 	}
+	stage->total += size;
+	return size;
 }
 
-/* finish */
-DEFINE_DO_STATE(3)
+/*
+ * tell the position of a stage written, called by ftell() of the scanning
+ * thread, while seeking is not supported
+ *
+ * @cookie: stage
+ * @offset: a pointer to offset from whence, set to the position
+ * @whence: SEEK_SET, SEEK_CUR or SEEK_END
+ *
+ * return: 0 if telling, -1 if seeking
+ */
+static int do_tell_stage(void * cookie, off64_t * offset, int whence)
 {
-	word[(*length)++] = c;
+	struct stage_t * stage = cookie;
 
-	if (c == '\"') {
-		*state = 4;
-	} else if (c == '\\') {
-		*state = 5;
+	if (whence != SEEK_CUR || *offset != 0) {
+		return -1;
 	}
+	*offset = (off64_t)stage->total;
+	return 0;
 }
 
-/* finish */
-DEFINE_DO_STATE(5)
+/*
+ * finish reading a stage, called by stdio when the stream is closed
+ *
+ * @cookie: stage
+ *
+ * return: 0
+ */
+static int do_finish_reading(void * cookie)
 {
-	word[(*length)++] = c;
-
-	if (c >= '0' && c <= '7') {
-		*state = 6;
-		return;
-	}
-
-	switch (c) {
-	case '\\': case '\'': case '\"': case 'r': case 'n': case 'f': case 't':
-	case 'b':
-		*state = 3;
-		break;
-
-	case 'u':
-		*state = 8;
-		break;
+	struct stage_t * stage = cookie;
 
-	default:
-		*state = -1;
-		break;
+	if (stage->done) {
+		return 0;
 	}
+	pthread_mutex_lock(&stage->lock);
+	stage->done = 1;
+	pthread_cond_broadcast(&stage->cond);
+	pthread_mutex_unlock(&stage->lock);
+	pthread_join(stage->thread, NULL);
+	return 0;
 }
 
-/* finish */
-DEFINE_DO_STATE(6_16)
+/*
+ * finish writing a stage, called by stdio when the stream is closed, and
+ * wait for every block to be written
+ *
+ * @cookie: stage
+ *
+ * return: 0 on success, -1 on error
+ */
+static int do_finish_writing(void * cookie)
 {
-	word[(*length)++] = c;
+	struct stage_t * stage = cookie;
 
-	if (c >= '0' && c <= '7') {
-		++*state;
-	} else {
-		*state = -1;
+	if (stage->done) {
+		return 0;
 	}
+	if (stage->current != NULL) {
+		stage->current->length = stage->pos;
+		do_push(stage, &stage->head, stage->current);
+		stage->current = NULL;
+	}
+	pthread_mutex_lock(&stage->lock);
+	stage->done = 1;
+	pthread_cond_broadcast(&stage->cond);
+	pthread_mutex_unlock(&stage->lock);
+	pthread_join(stage->thread, NULL);
+	return stage->error ? -1 : 0;
 }
 
-/* finish */
-DEFINE_DO_STATE(7)
+/*
+ * put a block into a queue of stage
+ *
+ * @stage: stage
+ * @queue: queue of full blocks or free blocks
+ * @block: block to put
+ */
+static void do_push(struct stage_t * stage, struct block_t ** queue,
+	struct block_t * block)
 {
-	word[(*length)++] = c;
-
-	if (c >= '0' && c <= '7') {
-		*state = 3;
+	pthread_mutex_lock(&stage->lock);
+	if (queue == &stage->head) {
+		block->next = NULL;
+		if (stage->head != NULL) {
+			stage->tail->next = block;
+		} else {
+			stage->head = block;
+		}
+		stage->tail = block;
 	} else {
-		*state = -1;
+		/* free blocks are in no order */
+		block->next = *queue;
+		*queue = block;
 	}
+	pthread_cond_broadcast(&stage->cond);
+	pthread_mutex_unlock(&stage->lock);
 }
 
-/* finish */
-DEFINE_DO_STATE(8_9_10_18_19_20)
+/*
+ * take a block from a queue of stage, waiting until there is one
+ *
+ * @stage: stage
+ * @queue: queue of full blocks or free blocks
+ *
+ * return: the block, or NULL if the other side of stage has finished and
+ *         either the queue is empty or it is the queue of free blocks
+ */
+static struct block_t * do_pop(struct stage_t * stage,
+	struct block_t ** queue)
 {
-	word[(*length)++] = c;
+	struct block_t * block;
 
-	if ((c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f') ||
-		(c >= '0' && c <= '9')) {
-		++*state;
-	} else {
-		*state = -1;
+	pthread_mutex_lock(&stage->lock);
+	while ((block = *queue) == NULL && !stage->done) {
+		pthread_cond_wait(&stage->cond, &stage->lock);
+	}
+	if (stage->done && queue == &stage->free) {
+		block = NULL;
+	} else if (block != NULL) {
+		*queue = block->next;
 	}
+	pthread_mutex_unlock(&stage->lock);
+	return block;
 }
 
-/* finish */
-DEFINE_DO_STATE(11)
-{
-	word[(*length)++] = c;
+#endif /* USE_PIPELINE */
 
-	if ((c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f') ||
-		(c >= '0' && c <= '9')) {
-		*state = 3;
-	} else {
-		*state = -1;
-	}
-}
+/******************************** batch mode **********************************/
+#ifdef USE_THREADS
 
-/* finish */
-DEFINE_DO_STATE(12)
+/*
+ * scan many sources with a pool of work-stealing threads
+ * jobs are sorted so that the largest files are scanned first
+ *
+ * @paths: source files or directories
+ * @count: number of paths
+ * @threads: number of threads, 0 for the number of online processors
+ *
+ * return: 0 if all sources are scanned, 1 otherwise
+ */
+static int do_batch(char * const * paths, int count, int threads)
 {
-	word[(*length)++] = c;
+	struct job_list_t list = { NULL, 0, 0, NULL };
+	struct worker_t * workers = NULL;
+	int i, n, status = 0;
 
-	if (c == '\\') {
-		*state = 15;
-	} else {
-		*state = 13;
+	for (i = 0; i < count; ++i) {
+		if (do_collect(&list, paths[i], 1) != 0) {
+			status = 1;
+		}
 	}
-}
+	if (list.count == 0) {
+		goto out;
+	}
+	qsort(list.jobs, list.count, sizeof(struct job_t), do_compare_job);
 
-/* finish */
-DEFINE_DO_STATE(13)
-{
-	word[(*length)++] = c;
-
-	if (c == '\'') {
-		*state = 14;
-	} else {
-		*state = -1;
+	/* a cache that cannot be made only misses */
+	if (options.cache != NULL) {
+		mkdir(options.cache, 0777);
 	}
-}
-
-/* finish */
-DEFINE_DO_STATE(15)
-{
-	word[(*length)++] = c;
-
-	if (c >= '0' && c <= '7') {
-		*state = 16;
-		return;
+	if (threads <= 0) {
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads <= 0) {
+		threads = 1;
+	}
+	if (threads > list.count) {
+		threads = list.count;
 	}
 
-	switch (c) {
-	case '\\': case '\'': case '\"': case 'r': case 'n': case 'f': case 't':
-	case 'b':
-		*state = 13;
-		break;
-
-	case 'u':
-		*state = 18;
-		break;
+	if ((workers = calloc(threads, sizeof(struct worker_t))) == NULL) {
+		perror("lex-java: cannot allocate workers");
+		status = 1;
+		goto out;
+	}
 
-	default:
-		*state = -1;
-		break;
+	/* deal jobs round-robin, so every deque is also sorted by size */
+	for (i = 0; i < threads; ++i) {
+		workers[i].id = i;
+		workers[i].count = threads;
+		workers[i].workers = workers;
+		pthread_mutex_init(&workers[i].deque.lock, NULL);
+		workers[i].deque.jobs = malloc(sizeof(struct job_t) *
+			((list.count + threads - 1) / threads));
+		if (workers[i].deque.jobs == NULL) {
+			perror("lex-java: cannot allocate jobs");
+			status = 1;
+			goto out;
+		}
+	}
+	for (i = 0; i < list.count; ++i) {
+		n = i % threads;
+		workers[n].deque.jobs[workers[n].deque.tail++] = list.jobs[i];
 	}
-}
 
-/* finish */
-DEFINE_DO_STATE(17)
-{
-	word[(*length)++] = c;
+	/* the main thread works as worker 0 */
+	for (n = 1; n < threads; ++n) {
+		if (pthread_create(&workers[n].thread, NULL, do_work,
+			&workers[n]) != 0) {
+			perror("lex-java: cannot create thread");
+			break;
+		}
+	}
+	do_work(&workers[0]);
+	for (i = 1; i < n; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	for (i = 0; i < threads; ++i) {
+		status |= workers[i].failed;
+	}
+	if (options.cache != NULL) {
+		do_evict_cache();
+	}
 
-	if (c >= '0' && c <= '7') {
-		*state = 13;
-	} else {
-		*state = -1;
+out:
+	if (workers != NULL) {
+		for (i = 0; i < threads; ++i) {
+			pthread_mutex_destroy(&workers[i].deque.lock);
+			free(workers[i].deque.jobs);
+			do_free_binary_sink(&workers[i].scanner.binary);
+			do_free_symbol_sink(&workers[i].scanner.symbol);
+			do_free_input(&workers[i].scanner.input);
+			free(workers[i].scanner.unpacked);
+		}
+		free(workers);
 	}
+	do_free_jobs(&list);
+	return status;
 }
 
-/* finish */
-DEFINE_DO_STATE(21)
+/*
+ * collect jobs from a path, walking directories recursively
+ *
+ * @list: job list to append to
+ * @path: a source file or a directory
+ * @explicit: whether the path is given on command line, in which case it is
+ *            scanned whatever its name is
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_collect(struct job_list_t * list, const char * path,
+	int explicit)
 {
-	word[(*length)++] = c;
+	struct stat st;
+	DIR * dir;
+	struct dirent * entry;
+	char * child;
+	size_t length = strlen(path);
+	int ret = 0;
+	char err_msg[BUF_SIZE];
 
-	if ((c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f') ||
-		(c >= '0' && c <= '9')) {
-		*state = 13;
-	} else {
-		*state = -1;
+	if ((explicit ? stat(path, &st) : lstat(path, &st)) != 0) {
+		snprintf(err_msg, BUF_SIZE, "lex-java: cannot stat '%s'", path);
+		perror(err_msg);
+		return -1;
 	}
-}
 
-/* finish */
-DEFINE_DO_STATE_RETURN(22)
-{
-	if (c >= '0' && c <= '9') {
-		word[(*length)++] = c;
-		*state = 24;
-		return 0;
-	} else {
-		return 1;
+	if (S_ISDIR(st.st_mode)) {
+		if ((dir = opendir(path)) == NULL) {
+			snprintf(err_msg, BUF_SIZE, "lex-java: cannot open '%s'",
+				path);
+			perror(err_msg);
+			return -1;
+		}
+		while ((entry = readdir(dir)) != NULL) {
+			if (strcmp(entry->d_name, ".") == 0 ||
+				strcmp(entry->d_name, "..") == 0) {
+				continue;
+			}
+			child = malloc(length + strlen(entry->d_name) + 2);
+			if (child == NULL) {
+				ret = -1;
+				break;
+			}
+			sprintf(child, "%s/%s", path, entry->d_name);
+			if (do_collect(list, child, 0) != 0) {
+				ret = -1;
+			}
+			free(child);
+		}
+		closedir(dir);
+		return ret;
 	}
-}
 
-/* finish */
-DEFINE_DO_STATE_RETURN(23)
-{
-	if (c >= '0' && c <= '9') {
-		word[(*length)++] = c;
+	if (!S_ISREG(st.st_mode)) {
+		if (explicit) {
+			fprintf(stderr, "lex-java: '%s' is not a regular file\n",
+				path);
+			return -1;
+		}
 		return 0;
 	}
 
-	switch (c) {
-	case '.':
-		word[(*length)++] = c;
-		*state = 24;
-		return 0;
-
-	case 'f': case 'F': case 'd': case 'D':
-		word[(*length)++] = c;
-		*state = 25;
-		return 0;
-
-	case 'e': case 'E':
-		word[(*length)++] = c;
-		*state = 26;
-		return 0;
-
-	case 'l': case 'L':
-		word[(*length)++] = c;
-		*state = 33;
+	/* only '*.java' files are picked up from directories */
+	if (!explicit && (length < 5 ||
+		strcmp(path + length - 5, ".java") != 0)) {
 		return 0;
+	}
 
-	default:
-		return 1;
+	/* the entries of an archive given are picked up instead */
+	if (explicit && length > 4 && (strcmp(path + length - 4, ".jar") == 0 ||
+		strcmp(path + length - 4, ".zip") == 0)) {
+		return do_open_archive(list, path);
 	}
+	return do_add_job(list, path, st.st_size);
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(24)
+/*
+ * add a job of a source file to a job list
+ *
+ * @list: job list to append to
+ * @path: path of source file
+ * @size: size of source file
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+static int do_add_job(struct job_list_t * list, const char * path,
+	off_t size)
 {
-	if (c >= '0' && c <= '9') {
-		word[(*length)++] = c;
-		return 0;
+	struct job_t * jobs;
+
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity << 1 : 64;
+		jobs = realloc(list->jobs, sizeof(struct job_t) *
+			list->capacity);
+		if (jobs == NULL) {
+			perror("lex-java: cannot allocate jobs");
+			return -1;
+		}
+		list->jobs = jobs;
 	}
-
-	switch (c) {
-	case 'f': case 'F': case 'd': case 'D':
-		word[(*length)++] = c;
-		*state = 25;
-		return 0;
-
-	case 'e': case 'E':
-		word[(*length)++] = c;
-		*state = 26;
-		return 0;
-
-	default:
-		return 1;
+	memset(&list->jobs[list->count], 0, sizeof(struct job_t));
+	if ((list->jobs[list->count].path = strdup(path)) == NULL) {
+		perror("lex-java: cannot allocate jobs");
+		return -1;
 	}
+	list->jobs[list->count].size = size;
+	++list->count;
+	return 0;
 }
 
-/* finish */
-DEFINE_DO_STATE(26)
+/*
+ * release a job list and the archives its jobs are in
+ *
+ * @list: job list
+ */
+static void do_free_jobs(struct job_list_t * list)
 {
-	word[(*length)++] = c;
+	struct archive_t * archive;
+	int i;
 
-	if (c >= '0' && c <= '9') {
-		*state = 28;
-	} else if (c == '-' || c == '+') {
-		*state = 27;
-	} else {
-		*state = -1;
+	for (i = 0; i < list->count; ++i) {
+		free(list->jobs[i].path);
+	}
+	free(list->jobs);
+	while ((archive = list->archives) != NULL) {
+		list->archives = archive->next;
+		munmap((void *)archive->zip.map, archive->zip.size);
+		free(archive->path);
+		free(archive);
 	}
 }
 
-/* finish */
-DEFINE_DO_STATE(27)
+/*
+ * compare two jobs by size in descending order, for qsort
+ */
+static int do_compare_job(const void * a, const void * b)
 {
-	word[(*length)++] = c;
+	off_t size1 = ((const struct job_t *)a)->size;
+	off_t size2 = ((const struct job_t *)b)->size;
 
-	if (c >= '0' && c <= '9') {
-		*state = 28;
-	} else {
-		*state = -1;
-	}
+	return (size1 < size2) - (size1 > size2);
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(28)
+/*
+ * compare two jobs by path, for qsort
+ */
+static int do_compare_path(const void * a, const void * b)
 {
-	if (c >= '0' && c <= '9') {
-		word[(*length)++] = c;
-		return 0;
-	}
-
-	switch (c) {
-	case 'f': case 'F': case 'd': case 'D':
-		word[(*length)++] = c;
-		*state = 25;
-		return 0;
-
-	default:
-		return 1;
-	}
+	return strcmp(((const struct job_t *)a)->path,
+		((const struct job_t *)b)->path);
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(29)
+/*
+ * worker thread, running jobs from its own deque and then stealing from the
+ * others until all deques are empty
+ *
+ * @arg: a pointer to struct worker_t
+ *
+ * return: always NULL
+ */
+static void * do_work(void * arg)
 {
-	if (c >= '0' && c <= '7') {
-		word[(*length)++] = c;
-		*state = 33;
-		return 0;
-	}
-
-	switch (c) {
-	case 'x': case 'X':
-		word[(*length)++] = c;
-		*state = 30;
-		return 0;
-
-	case 'l': case 'L':
-		word[(*length)++] = c;
-		*state = 32;
-		return 0;
-
-	case 'e': case 'E':
-		word[(*length)++] = c;
-		*state = 26;
-		return 0;
-
-	case 'f': case 'F': case 'd': case 'D':
-		word[(*length)++] = c;
-		*state = 25;
-		return 0;
-
-	case '8': case '9':
-		word[(*length)++] = c;
-		*state = 34;
-		return 0;
-
-	case '.':
-		word[(*length)++] = c;
-		*state = 24;
-		return 0;
+	struct worker_t * self = arg;
+	struct job_t job;
+	int i;
 
-	default:
-		return 1;
+	while (1) {
+		if (!do_take(&self->deque, 0, &job)) {
+			/* steal from the next workers in turn */
+			for (i = 1; i < self->count; ++i) {
+				if (do_take(&self->workers[(self->id + i) %
+					self->count].deque, 1, &job)) {
+					break;
+				}
+			}
+			if (i >= self->count) {
+				return NULL;
+			}
+		}
+		if (do_lex_file(&job, &self->scanner) != 0) {
+			self->failed = 1;
+		}
 	}
 }
 
-/* finish */
-DEFINE_DO_STATE(30)
+/*
+ * take a job from a deque
+ *
+ * @deque: deque to take from
+ * @steal: whether to take from the tail (stealing) or the head (owning)
+ * @job: a pointer to struct job_t to store the job taken
+ *
+ * return: 1 if a job is taken, 0 if the deque is empty
+ */
+static int do_take(struct deque_t * deque, int steal, struct job_t * job)
 {
-	word[(*length)++] = c;
+	int taken = 0;
 
-	if ((c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f') ||
-		(c >= '0' && c <= '9')) {
-		*state = 31;
-	} else {
-		*state = -1;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->head < deque->tail) {
+		*job = steal ? deque->jobs[--deque->tail] :
+			deque->jobs[deque->head++];
+		taken = 1;
 	}
+	pthread_mutex_unlock(&deque->lock);
+	return taken;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(31)
+/*
+ * scan a source file into 'SOURCE.scanner_output', or an entry of an archive
+ * into 'ARCHIVE.scanner_output/ENTRY.scanner_output'
+ *
+ * @job: job of source file or entry
+ * @scanner: buffers of the worker
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_lex_file(const struct job_t * job, struct scanner_t * scanner)
 {
-	if ((c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f') ||
-		(c >= '0' && c <= '9')) {
-		word[(*length)++] = c;
-		return 0;
-	} else if (c == 'l' || c == 'L') {
-		word[(*length)++] = c;
-		*state = 32;
-		return 0;
-	} else {
-		return 1;
+	FILE * src, * out, * lines, * comments = NULL;
+	int ret, cached;
+	char out_path[BUF_SIZE];
+	char entry[BUF_SIZE];
+	char entry_dir[BUF_SIZE];
+	char err_msg[BUF_SIZE << 1];
+
+	if ((src = do_open_job(job, &scanner->unpacked,
+		&scanner->unpacked_capacity)) == NULL) {
+		return -1;
 	}
-}
 
-/* finish */
-DEFINE_DO_STATE_RETURN(33)
-{
-	if (c >= '0' && c <= '7') {
-		word[(*length)++] = c;
-		return 0;
+	if (job->archive != NULL) {
+		snprintf(out_path, BUF_SIZE, "%s.scanner_output%s"
+			".scanner_output", job->archive->path,
+			job->path + strlen(job->archive->path));
+		cached = options.cache != NULL && do_cache_key(NULL,
+			scanner->unpacked, job->size, entry) == 0;
+		/* directories of outputs are made as entries need them */
+		strcpy(entry_dir, out_path);
+		*strrchr(entry_dir, '/') = '\0';
+		if (do_make_dirs(entry_dir) != 0) {
+			snprintf(err_msg, sizeof(err_msg),
+				"lex-java: cannot make '%s'", entry_dir);
+			perror(err_msg);
+			fclose(src);
+			return -1;
+		}
+	} else {
+		snprintf(out_path, BUF_SIZE, "%s.scanner_output", job->path);
+		cached = options.cache != NULL && do_cache_key(src, NULL, 0,
+			entry) == 0;
 	}
-
-	switch (c) {
-	case '8': case '9':
-		word[(*length)++] = c;
-		*state = 34;
-		return 0;
-
-	case 'l': case 'L':
-		word[(*length)++] = c;
-		*state = 32;
+	if (cached && do_fetch_cache(entry, out_path,
+		scanner->output) == 0) {
+		fclose(src);
 		return 0;
+	}
 
-	case 'e': case 'E':
-		word[(*length)++] = c;
-		*state = 26;
-		return 0;
+	if ((out = fopen(out_path, "wb")) == NULL) {
+		snprintf(err_msg, sizeof(err_msg), "lex-java: cannot open '%s'",
+			out_path);
+		perror(err_msg);
+		fclose(src);
+		return -1;
+	}
+	if (do_open_index(out_path, ".lines", options.lines, &lines) != 0 ||
+		do_open_index(out_path, ".comments", options.comments,
+		&comments) != 0) {
+		fclose(src);
+		fclose(out);
+		if (lines != NULL) {
+			fclose(lines);
+		}
+		return -1;
+	}
+	setvbuf(out, scanner->output, _IOFBF, OUT_BUF_SIZE);
 
-	case 'f': case 'F': case 'd': case 'D':
-		word[(*length)++] = c;
-		*state = 25;
-		return 0;
+	ret = do_scan(src, out, lines, comments, scanner);
 
-	default:
-		return 1;
+	fclose(src);
+	if (fclose(out) != 0 || ret != 0) {
+		snprintf(err_msg, sizeof(err_msg), "lex-java: cannot write '%s'",
+			out_path);
+		perror(err_msg);
+		if (lines != NULL) {
+			fclose(lines);
+		}
+		if (comments != NULL) {
+			fclose(comments);
+		}
+		return -1;
+	}
+	ret = do_close_index(out_path, ".lines", lines);
+	if (do_close_index(out_path, ".comments", comments) != 0 ||
+		ret != 0) {
+		return -1;
 	}
+	if (cached) {
+		do_store_cache(entry, out_path, scanner->output);
+	}
+	return 0;
 }
 
-/* finish */
-DEFINE_DO_STATE(34)
+/*
+ * open a source file, or unpack an entry of an archive and open it in memory
+ *
+ * @job: job of source file or entry
+ * @buffer: a pointer to buffer to unpack into, which grows as needed
+ * @capacity: a pointer to size of buffer
+ *
+ * return: a FILE pointer on success, NULL otherwise
+ */
+static FILE * do_open_job(const struct job_t * job, char ** buffer,
+	size_t * capacity)
 {
-	word[(*length)++] = c;
+	FILE * src;
+	char * p;
+	char err_msg[BUF_SIZE << 1];
 
-	if (c >= '0' && c <= '9') {
-		return;
+	if (job->archive == NULL) {
+		if ((src = fopen(job->path, "r")) == NULL) {
+			goto error;
+		}
+		return src;
 	}
 
-	switch (c) {
-	case 'e': case 'E':
-		*state = 26;
-		break;
-
-	case 'f': case 'F': case 'd': case 'D':
-		*state = 25;
-		break;
-
-	default:
-		*state = -1;
-		break;
+	/* a byte more, so that an empty entry has a buffer as well */
+	if (*capacity < (size_t)job->size + 1) {
+		if ((p = realloc(*buffer, job->size + 1)) == NULL) {
+			goto error;
+		}
+		*buffer = p;
+		*capacity = job->size + 1;
 	}
-}
-
-/* finish */
-DEFINE_DO_STATE_RETURN(39)
-{
-	if (c == '=') {
-		word[(*length)++] = c;
-		*state = 40;
-		return 0;
-	} else if (c == '+') {
-		word[(*length)++] = c;
-		*state = 41;
-		return 0;
-	} else {
-		return 1;
+	if (do_unpack_entry(&job->archive->zip, &job->entry,
+		(unsigned char *)*buffer) != 0) {
+		fprintf(stderr, "lex-java: cannot unpack '%s'\n", job->path);
+		return NULL;
 	}
+	if ((src = fmemopen(*buffer, job->size, "r")) != NULL) {
+		return src;
+	}
+
+error:
+	snprintf(err_msg, sizeof(err_msg), "lex-java: cannot open '%s'",
+		job->path);
+	perror(err_msg);
+	return NULL;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(42)
+/********************************* lex cache **********************************/
+
+/*
+ * an output is kept in the cache directory under a name made of the hash
+ * and the size of its source, CACHE_VERSION and the options it depends on,
+ * with its line index and comment index if any under the same name plus
+ * '.lines' and '.comments'
+ * entries are written under temporary names and renamed, so a reader never
+ * sees one half written, and the time an entry is modified is the time it is
+ * last used, by which entries are dropped after a batch
+ */
+
+/*
+ * hash a source and make the path of its cache entry
+ *
+ * @src: a FILE pointer of Java source file, NULL if data is given
+ * @data: content of source in memory, mapped from src if NULL
+ * @size: size of data
+ * @entry: buffer of BUF_SIZE bytes to store the path
+ *
+ * return: 0 on success, -1 if the source cannot be hashed
+ */
+static int do_cache_key(FILE * src, const char * data, size_t size,
+	char * entry)
 {
-	if (c == '=') {
-		word[(*length)++] = c;
-		*state = 43;
-		return 0;
-	} else if (c == '-') {
-		word[(*length)++] = c;
-		*state = 44;
-		return 0;
-	} else {
-		return 1;
+	struct stat st;
+	void * map = NULL;
+	uint64_t hash;
+	int flags;
+
+	if (data == NULL) {
+		if (fstat(fileno(src), &st) != 0 || !S_ISREG(st.st_mode)) {
+			return -1;
+		}
+		size = st.st_size;
+		if (size > 0) {
+			map = mmap(NULL, size, PROT_READ, MAP_PRIVATE,
+				fileno(src), 0);
+			if (map == MAP_FAILED) {
+				return -1;
+			}
+		}
+		data = map;
 	}
+	hash = do_xxh64((const unsigned char *)data, size, 0);
+	if (map != NULL) {
+		munmap(map, size);
+	}
+
+	flags = options.binary | options.symbols << 1 |
+		(options.flags & LEX_BIN_LINES) << 2 | options.lines << 3 |
+		options.spaces << 4 | (options.flags & LEX_BIN_POSITIONS) << 5 |
+		options.comments << 7 | (options.flags & LEX_BIN_VALUES) << 6;
+	snprintf(entry, BUF_SIZE, "%s/%016llx-%llx-%d-%02x", options.cache,
+		(unsigned long long)hash, (unsigned long long)size,
+		CACHE_VERSION, flags);
+	return 0;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(45_49_57_60_64_70_72)
+/*
+ * copy an output and its indexes if wanted from a cache entry, marking them
+ * as used
+ *
+ * @entry: path of cache entry
+ * @out_path: path of output file
+ * @buffer: buffer of OUT_BUF_SIZE bytes to copy with
+ *
+ * return: 0 on success, -1 if the entry is missing or cannot be copied
+ */
+static int do_fetch_cache(const char * entry, const char * out_path,
+	char * buffer)
 {
-	if (c == '=') {
-		word[(*length)++] = c;
-		++*state;
-		return 0;
-	} else {
-		return 1;
+	static const char * suffixes[] = { ".lines", ".comments", "" };
+	FILE * from, * to;
+	char from_path[BUF_SIZE + 16];
+	char to_path[BUF_SIZE + 16];
+	int wanted[] = { options.lines, options.comments, 1 };
+	int i, ret;
+
+	for (i = 0; i < 3; ++i) {
+		if (!wanted[i]) {
+			continue;
+		}
+		snprintf(from_path, sizeof(from_path), "%s%s", entry,
+			suffixes[i]);
+		snprintf(to_path, sizeof(to_path), "%s%s", out_path,
+			suffixes[i]);
+		if ((from = fopen(from_path, "rb")) == NULL) {
+			return -1;
+		}
+		if ((to = fopen(to_path, "wb")) == NULL) {
+			fclose(from);
+			return -1;
+		}
+		futimens(fileno(from), NULL);
+		ret = do_copy_file(from, to, buffer);
+		fclose(from);
+		if (fclose(to) != 0 || ret != 0) {
+			return -1;
+		}
 	}
+	return 0;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(51)
+/*
+ * keep an output and its indexes if any in a cache entry
+ * the indexes are kept first, so an entry is never found without them
+ *
+ * @entry: path of cache entry
+ * @out_path: path of output file
+ * @buffer: buffer of OUT_BUF_SIZE bytes to copy with
+ */
+static void do_store_cache(const char * entry, const char * out_path,
+	char * buffer)
 {
-	if (c == '=') {
-		word[(*length)++] = c;
-		*state = 52;
-		return 0;
-	} else if (c == '&') {
-		word[*length] = c;
-		*state = 53;
-		return 0;
-	} else {
-		return 1;
+	char entry_path[BUF_SIZE + 16];
+	char path[BUF_SIZE + 16];
+
+	if (options.lines) {
+		snprintf(entry_path, sizeof(entry_path), "%s.lines", entry);
+		snprintf(path, sizeof(path), "%s.lines", out_path);
+		if (do_store_file(entry_path, path, buffer) != 0) {
+			return;
+		}
+	}
+	if (options.comments) {
+		snprintf(entry_path, sizeof(entry_path), "%s.comments",
+			entry);
+		snprintf(path, sizeof(path), "%s.comments", out_path);
+		if (do_store_file(entry_path, path, buffer) != 0) {
+			return;
+		}
 	}
+	do_store_file(entry, out_path, buffer);
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(54)
+/*
+ * copy a file into a cache entry under a temporary name, and rename it
+ *
+ * @entry: path of cache entry
+ * @path: path of file to copy
+ * @buffer: buffer of OUT_BUF_SIZE bytes to copy with
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_store_file(const char * entry, const char * path,
+	char * buffer)
 {
-	if (c == '=') {
-		word[(*length)++] = c;
-		*state = 55;
-		return 0;
-	} else if (c == '|') {
-		word[*length] = c;
-		*state = 56;
-		return 0;
-	} else {
-		return 1;
+	FILE * from, * to;
+	char temp[BUF_SIZE + 24];
+	int fd, ret = -1;
+
+	snprintf(temp, sizeof(temp), "%s.XXXXXX", entry);
+	if ((from = fopen(path, "rb")) == NULL) {
+		return -1;
+	}
+	if ((fd = mkstemp(temp)) < 0) {
+		fclose(from);
+		return -1;
+	}
+	if ((to = fdopen(fd, "wb")) == NULL) {
+		close(fd);
+		goto out;
+	}
+	ret = do_copy_file(from, to, buffer);
+	if (fclose(to) != 0) {
+		ret = -1;
+	}
+	if (ret == 0 && rename(temp, entry) != 0) {
+		ret = -1;
 	}
+out:
+	if (ret != 0) {
+		unlink(temp);
+	}
+	fclose(from);
+	return ret;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(62)
+/*
+ * copy the rest of a file
+ *
+ * @from: a FILE pointer of file to copy
+ * @to: a FILE pointer of file to copy to
+ * @buffer: buffer of OUT_BUF_SIZE bytes to copy with
+ *
+ * return: 0 on success, -1 on error
+ */
+static int do_copy_file(FILE * from, FILE * to, char * buffer)
 {
-	if (c == '=') {
-		word[(*length)++] = c;
-		*state = 63;
-		return 0;
-	} else if (c == '<') {
-		word[*length] = c;
-		*state = 64;
-		return 0;
-	} else {
-		return 1;
+	size_t n;
+
+	while ((n = fread(buffer, 1, OUT_BUF_SIZE, from)) != 0) {
+		if (fwrite(buffer, 1, n, to) != n) {
+			return -1;
+		}
 	}
+	return ferror(from) ? -1 : 0;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(66_68)
+/*
+ * drop the least recently used entries of the cache directory until what is
+ * left is within the size budget
+ * only names of entries are looked at, so nothing else there is dropped
+ */
+static void do_evict_cache(void)
 {
-	if (c == '=') {
-		word[(*length)++] = c;
-		++*state;
-		return 0;
-	} else if (c == '>') {
-		word[*length] = c;
-		*state += 2;
-		return 0;
-	} else {
-		return 1;
+	struct entry_t * entries = NULL, * p;
+	size_t count = 0, capacity = 0, i;
+	unsigned long long total = 0, budget;
+	struct stat st;
+	DIR * dir;
+	struct dirent * entry;
+	char path[BUF_SIZE];
+
+	budget = (unsigned long long)(options.budget ? options.budget :
+		CACHE_BUDGET) << 20;
+	if ((dir = opendir(options.cache)) == NULL) {
+		return;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		if (strspn(entry->d_name, "0123456789abcdef") != 16 ||
+			entry->d_name[16] != '-') {
+			continue;
+		}
+		snprintf(path, BUF_SIZE, "%s/%s", options.cache,
+			entry->d_name);
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+			continue;
+		}
+		if (count == capacity) {
+			capacity = capacity ? capacity << 1 : 1024;
+			if ((p = realloc(entries,
+				capacity * sizeof(*entries))) == NULL) {
+				break;
+			}
+			entries = p;
+		}
+		if ((entries[count].name = strdup(entry->d_name)) == NULL) {
+			break;
+		}
+		entries[count].size = st.st_size;
+		entries[count].used = st.st_mtime;
+		total += st.st_size;
+		++count;
+	}
+	closedir(dir);
+
+	if (total > budget) {
+		qsort(entries, count, sizeof(*entries), do_compare_entry);
+		for (i = 0; i < count && total > budget; ++i) {
+			snprintf(path, BUF_SIZE, "%s/%s", options.cache,
+				entries[i].name);
+			if (unlink(path) == 0) {
+				total -= entries[i].size;
+			}
+		}
 	}
-}
 
-/* finish */
-DEFINE_DO_STATE_RETURN(47)
-{
-	if (c == '=') {
-		word[(*length)++] = c;
-		*state = 48;
-		return 0;
-	} else if (c == '*') {
-		do_clear(word, length, state);
-		*state = 74;
-		return 0;
-	} else if (c == '/') {
-		do_clear(word, length, state);
-		*state = 77;
-		return 0;
-	} else {
-		return 1;
+	for (i = 0; i < count; ++i) {
+		free(entries[i].name);
 	}
+	free(entries);
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(74)
+/*
+ * compare two cache entries by time of last use, for qsort
+ */
+static int do_compare_entry(const void * a, const void * b)
 {
-	if (c == '*') {
-		*state = 75;
-	} else if (c == '\n') {
-		return 1;
-	}
+	time_t used1 = ((const struct entry_t *)a)->used;
+	time_t used2 = ((const struct entry_t *)b)->used;
 
-	return 0;
+	return (used1 > used2) - (used1 < used2);
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(75)
-{
-	switch (c) {
-	case '/':
-		*state = 76;
-		break;
+/******************************** server mode *********************************/
 
-	case '*':
-		break;
+/*
+ * the server scans sources for clients on a Unix domain socket, with a pool
+ * of workers whose buffers, sinks and intern tables stay warm across
+ * requests, and keeps replies in memory by the hash of their sources, so a
+ * source scanned before is answered without scanning
+ *
+ * a client sends requests one after another without waiting for replies,
+ * each of which is
+ *   'SCAN PATH' and a newline      to scan a source file
+ *   'DATA SIZE' and a newline      to scan SIZE bytes following it
+ * and gets a reply for each in the same order, which is
+ *   'OK N L C' and a newline       followed by N bytes of output, L bytes of
+ *                                  line index and C bytes of comment index,
+ *                                  where L and C are 0 if not wanted
+ *   'ERR MESSAGE' and a newline    if the source cannot be scanned
+ * requests of a client are scanned by the workers in parallel, and a client
+ * with SERVER_PIPELINE requests not replied yet, or SERVER_MAX_SIZE MB of
+ * sources not scanned and replies not sent, is not read on until fewer are
+ * replies are sent by a thread of each client, so a client not reading them
+ * holds up none but itself
+ */
 
-	case '\n':
+/*
+ * serve clients on a socket until killed
+ *
+ * @path: path of socket, replaced if it is a socket
+ * @threads: number of workers, 0 for the number of online processors
+ *
+ * return: 1 on failure
+ */
+static int do_server(const char * path, int threads)
+{
+	struct sockaddr_un addr;
+	struct client_t * client;
+	struct stat st;
+	pthread_t thread;
+	int fd, sock, i;
+	char err_msg[BUF_SIZE + 32];
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "lex-java: socket path '%s' is too long\n",
+			path);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* only a socket left by an earlier server is replaced */
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "lex-java: '%s' exists and is not a "
+				"socket\n", path);
+			return 1;
+		}
+		unlink(path);
+	}
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror("lex-java: cannot make socket");
+		return 1;
+	}
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+		listen(sock, SOMAXCONN) != 0) {
+		snprintf(err_msg, sizeof(err_msg),
+			"lex-java: cannot listen on '%s'", path);
+		perror(err_msg);
+		close(sock);
 		return 1;
+	}
+
+	/* a client gone fails writes instead of killing the server */
+	signal(SIGPIPE, SIG_IGN);
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.cond, NULL);
+	pthread_mutex_init(&server.cache_lock, NULL);
+	if (threads <= 0) {
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (threads <= 0) {
+		threads = 1;
+	}
+	for (i = 0; i < threads; ++i) {
+		if (pthread_create(&thread, NULL, do_serve, NULL) != 0) {
+			perror("lex-java: cannot create thread");
+			if (i == 0) {
+				close(sock);
+				return 1;
+			}
+			break;
+		}
+	}
+
+	/* each client is read by a thread of its own */
+	while (1) {
+		if ((fd = accept(sock, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			perror("lex-java: cannot accept clients");
+			break;
+		}
+		if ((client = calloc(1, sizeof(struct client_t))) == NULL) {
+			close(fd);
+			continue;
+		}
+		client->fd = fd;
+		pthread_mutex_init(&client->lock, NULL);
+		pthread_cond_init(&client->cond, NULL);
+		if (pthread_create(&thread, NULL, do_serve_client,
+			client) != 0) {
+			do_free_client(client);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	close(sock);
+	return 1;
+}
+
+/*
+ * client thread, reading requests of a client and queueing them for the
+ * workers until the client has sent all, and closing the client once all
+ * are replied by its sender thread
+ *
+ * @arg: a pointer to struct client_t
+ *
+ * return: always NULL
+ */
+static void * do_serve_client(void * arg)
+{
+	struct client_t * client = arg;
+	struct request_t * request;
+	FILE * fp;
+	char line[BUF_SIZE];
+	char * end;
+	size_t n;
+
+	client->reading = 1;
+	if (pthread_create(&client->sender, NULL, do_send_replies,
+		client) != 0) {
+		do_free_client(client);
+		return NULL;
+	}
+	if ((fp = fdopen(dup(client->fd), "rb")) == NULL) {
+		goto out;
+	}
+	while (fgets(line, BUF_SIZE, fp) != NULL) {
+		if ((request = calloc(1, sizeof(struct request_t))) == NULL) {
+			break;
+		}
+		request->client = client;
+
+		/* a request not understood is the last one read */
+		n = strlen(line);
+		if (n == 0 || line[n - 1] != '\n') {
+			do_fail_request(request, "request too long");
+			do_queue_request(request, 0);
+			break;
+		}
+		line[n - 1] = '\0';
+		if (strncmp(line, "SCAN ", 5) == 0) {
+			if ((request->path = strdup(line + 5)) == NULL) {
+				do_fail_request(request, strerror(errno));
+			}
+		} else if (strncmp(line, "DATA ", 5) == 0) {
+			/* a size is only digits, and no more than allowed */
+			errno = 0;
+			request->size = strtoul(line + 5, &end, 10);
+			if (line[5] < '0' || line[5] > '9' || *end != '\0' ||
+				errno == ERANGE) {
+				do_fail_request(request, "bad request");
+				do_queue_request(request, 0);
+				break;
+			}
+			if (request->size > (size_t)SERVER_MAX_SIZE << 20) {
+				do_fail_request(request, "source too large");
+				do_queue_request(request, 0);
+				break;
+			}
+			/* a byte more, so that an empty source has one */
+			do_hold(client, request->size);
+			if ((request->data = malloc(request->size + 1)) ==
+				NULL) {
+				do_release(client, request->size);
+				do_fail_request(request, strerror(errno));
+				do_queue_request(request, 0);
+				break;
+			}
+			if (fread(request->data, 1, request->size, fp) !=
+				request->size) {
+				do_release(client, request->size);
+				do_free_request(request);
+				break;
+			}
+		} else {
+			do_fail_request(request, "bad request");
+			do_queue_request(request, 0);
+			break;
+		}
+		do_queue_request(request, request->reply == NULL);
+	}
+	/* the rest is dropped, so the client is not reset before replies */
+	while (fread(line, 1, BUF_SIZE, fp) == BUF_SIZE) {
+	}
+	fclose(fp);
+
+out:
+	pthread_mutex_lock(&client->lock);
+	client->reading = 0;
+	pthread_cond_broadcast(&client->cond);
+	pthread_mutex_unlock(&client->lock);
+	pthread_join(client->sender, NULL);
+	do_free_client(client);
+	return NULL;
+}
+
+/*
+ * queue a request in order of its client, waiting while the client has too
+ * many requests not replied, and for the workers if it is to be scanned
+ *
+ * @request: request to queue
+ * @scan: whether to scan it, or to reply it as it is
+ */
+static void do_queue_request(struct request_t * request, int scan)
+{
+	struct client_t * client = request->client;
+
+	pthread_mutex_lock(&client->lock);
+	while (client->pending >= SERVER_PIPELINE) {
+		pthread_cond_wait(&client->cond, &client->lock);
+	}
+	if (client->tail != NULL) {
+		client->tail->next = request;
+	} else {
+		client->head = request;
+	}
+	client->tail = request;
+	++client->pending;
+	pthread_mutex_unlock(&client->lock);
+
+	if (!scan) {
+		do_reply(request);
+		return;
+	}
+	pthread_mutex_lock(&server.lock);
+	if (server.tail != NULL) {
+		server.tail->queued = request;
+	} else {
+		server.head = request;
+	}
+	server.tail = request;
+	pthread_cond_signal(&server.cond);
+	pthread_mutex_unlock(&server.lock);
+}
 
-	default:
-		*state = 74;
-		break;
+/*
+ * worker thread, scanning requests queued by all clients
+ *
+ * @arg: unused
+ *
+ * return: never returns
+ */
+static void * do_serve(void * arg)
+{
+	struct scanner_t * scanner;
+	struct request_t * request;
+
+	/* too large for a thread stack */
+	if ((scanner = calloc(1, sizeof(struct scanner_t))) == NULL) {
+		perror("lex-java: cannot allocate worker");
+		exit(1);
+	}
+
+	while (1) {
+		pthread_mutex_lock(&server.lock);
+		while (server.head == NULL) {
+			pthread_cond_wait(&server.cond, &server.lock);
+		}
+		request = server.head;
+		if ((server.head = request->queued) == NULL) {
+			server.tail = NULL;
+		}
+		pthread_mutex_unlock(&server.lock);
+
+		do_answer(request, scanner);
+		do_reply(request);
 	}
+	return NULL;
+}
 
+/*
+ * make the reply of a request, from memory if its source is scanned before
+ *
+ * @request: request to answer
+ * @scanner: buffers of the worker
+ */
+static void do_answer(struct request_t * request, struct scanner_t * scanner)
+{
+	FILE * fps[3] = { NULL, NULL, NULL };
+	char * outputs[3] = { NULL, NULL, NULL };
+	size_t lengths[3] = { 0, 0, 0 };
+	FILE * src = NULL;
+	const char * data = request->data;
+	size_t size = request->size;
+	uint64_t hash;
+	int i, n, ret = -1;
+	char header[64];
+	char message[BUF_SIZE];
+
+	if (request->path != NULL) {
+		if (do_load(request->path, &scanner->unpacked,
+			&scanner->unpacked_capacity, &size) != 0) {
+			snprintf(message, BUF_SIZE, "cannot read '%s': %s",
+				request->path, strerror(errno));
+			do_fail_request(request, message);
+			return;
+		}
+		data = scanner->unpacked;
+	}
+	hash = do_xxh64((const unsigned char *)data, size, 0);
+	if (do_find_reply(request, hash, size)) {
+		return;
+	}
+
+	if ((src = fmemopen((char *)data, size, "r")) == NULL ||
+		(fps[0] = open_memstream(&outputs[0], &lengths[0])) == NULL ||
+		(options.lines && (fps[1] = open_memstream(&outputs[1],
+		&lengths[1])) == NULL) || (options.comments && (fps[2] =
+		open_memstream(&outputs[2], &lengths[2])) == NULL)) {
+		goto out;
+	}
+	ret = do_scan(src, fps[0], fps[1], fps[2], scanner);
+	for (i = 0; i < 3; ++i) {
+		if (fps[i] != NULL && fclose(fps[i]) != 0) {
+			ret = -1;
+		}
+		fps[i] = NULL;
+	}
+	if (ret != 0) {
+		goto out;
+	}
+
+	n = snprintf(header, sizeof(header), "OK %lu %lu %lu\n",
+		(unsigned long)lengths[0], (unsigned long)lengths[1],
+		(unsigned long)lengths[2]);
+	request->length = n + lengths[0] + lengths[1] + lengths[2];
+	if ((request->reply = malloc(request->length)) == NULL) {
+		ret = -1;
+		goto out;
+	}
+	memcpy(request->reply, header, n);
+	for (i = 0; i < 3; ++i) {
+		if (lengths[i] > 0) {
+			memcpy(request->reply + n, outputs[i], lengths[i]);
+			n += lengths[i];
+		}
+	}
+	do_keep_reply(request, hash, size);
+
+out:
+	if (ret != 0) {
+		do_fail_request(request, "cannot scan");
+	}
+	if (src != NULL) {
+		fclose(src);
+	}
+	for (i = 0; i < 3; ++i) {
+		if (fps[i] != NULL) {
+			fclose(fps[i]);
+		}
+		free(outputs[i]);
+	}
+}
+
+/*
+ * read a source file into a buffer
+ *
+ * @path: path of source file
+ * @buffer: a pointer to buffer, which grows as needed
+ * @capacity: a pointer to size of buffer
+ * @size: a pointer to store the size of source
+ *
+ * return: 0 on success, -1 otherwise, with errno set
+ */
+static int do_load(const char * path, char ** buffer, size_t * capacity,
+	size_t * size)
+{
+	struct stat st;
+	ssize_t n;
+	char * p;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return -1;
+	}
+	if (fstat(fd, &st) != 0) {
+		goto error;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		errno = EINVAL;
+		goto error;
+	}
+
+	/* a byte more, so that an empty source has a buffer as well */
+	if (*capacity < (size_t)st.st_size + 1) {
+		if ((p = realloc(*buffer, st.st_size + 1)) == NULL) {
+			goto error;
+		}
+		*buffer = p;
+		*capacity = st.st_size + 1;
+	}
+	for (*size = 0; *size < (size_t)st.st_size; *size += n) {
+		if ((n = read(fd, *buffer + *size, st.st_size - *size)) < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			goto error;
+		}
+		/* a file shrinking as it is read ends there */
+		if (n == 0) {
+			break;
+		}
+	}
+	close(fd);
 	return 0;
+
+error:
+	close(fd);
+	return -1;
 }
 
-/* finish */
-DEFINE_DO_STATE_RETURN(77)
+/*
+ * mark a request as done, for the sender thread of its client to reply it,
+ * which is never waited for, and hold its reply instead of its source
+ *
+ * @request: request done
+ */
+static void do_reply(struct request_t * request)
 {
-	if (c == '\n') {
-		*state = 78;
-		return 1;
+	struct client_t * client = request->client;
+	size_t size = request->data != NULL ? request->size : 0;
+
+	free(request->data);
+	request->data = NULL;
+
+	pthread_mutex_lock(&client->lock);
+	request->done = 1;
+	client->held = client->held - size + request->length;
+	pthread_cond_broadcast(&client->cond);
+	pthread_mutex_unlock(&client->lock);
+}
+
+/*
+ * sender thread of a client, sending replies in order as requests are done,
+ * until the client has sent all requests and all are replied
+ * replies are sent without the lock of the client, so workers marking its
+ * requests done never wait for the client to read them
+ *
+ * @arg: a pointer to struct client_t
+ *
+ * return: always NULL
+ */
+static void * do_send_replies(void * arg)
+{
+	struct client_t * client = arg;
+	struct request_t * request;
+	size_t held;
+
+	pthread_mutex_lock(&client->lock);
+	while (1) {
+		while ((request = client->head) != NULL ? !request->done :
+			client->reading) {
+			pthread_cond_wait(&client->cond, &client->lock);
+		}
+		if (request == NULL) {
+			break;
+		}
+		if ((client->head = request->next) == NULL) {
+			client->tail = NULL;
+		}
+		pthread_mutex_unlock(&client->lock);
+
+		/* a client gone is no longer sent anything */
+		if (!client->failed && do_send(client->fd, request->reply,
+			request->length) != 0) {
+			client->failed = 1;
+		}
+		held = request->length;
+		do_free_request(request);
+
+		pthread_mutex_lock(&client->lock);
+		--client->pending;
+		client->held -= held;
+		pthread_cond_broadcast(&client->cond);
+	}
+	pthread_mutex_unlock(&client->lock);
+	return NULL;
+}
+
+/*
+ * count bytes of a source to be read from a client as held, waiting while
+ * too many are held, unless none is, so any source allowed is read at last,
+ * while replies held may well be more, but are sent before another is read
+ *
+ * @client: client to read from
+ * @size: size of source
+ */
+static void do_hold(struct client_t * client, size_t size)
+{
+	pthread_mutex_lock(&client->lock);
+	while (client->held != 0 && client->held + size >
+		(size_t)SERVER_MAX_SIZE << 20) {
+		pthread_cond_wait(&client->cond, &client->lock);
+	}
+	client->held += size;
+	pthread_mutex_unlock(&client->lock);
+}
+
+/*
+ * count bytes of a source of a client as no longer held
+ *
+ * @client: client
+ * @size: size of source
+ */
+static void do_release(struct client_t * client, size_t size)
+{
+	pthread_mutex_lock(&client->lock);
+	client->held -= size;
+	pthread_cond_broadcast(&client->cond);
+	pthread_mutex_unlock(&client->lock);
+}
+
+/*
+ * send all of a buffer to a socket
+ *
+ * @fd: socket
+ * @data: buffer to send
+ * @length: length of buffer
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_send(int fd, const char * data, size_t length)
+{
+	ssize_t n;
+
+	while (length > 0) {
+		if ((n = write(fd, data, length)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += n;
+		length -= n;
+	}
+	return 0;
+}
+
+/*
+ * make an error reply of a request
+ *
+ * @request: request failed
+ * @message: reason, in a line
+ */
+static void do_fail_request(struct request_t * request, const char * message)
+{
+	char reply[BUF_SIZE];
+	char * p;
+
+	free(request->reply);
+	request->length = snprintf(reply, BUF_SIZE, "ERR %s\n", message);
+	if (request->length >= BUF_SIZE) {
+		request->length = BUF_SIZE - 1;
+		reply[BUF_SIZE - 2] = '\n';
+	}
+	if ((p = malloc(request->length)) != NULL) {
+		memcpy(p, reply, request->length);
+	} else {
+		request->length = 0;
+	}
+	request->reply = p;
+}
+
+/*
+ * release a request
+ *
+ * @request: request to release
+ */
+static void do_free_request(struct request_t * request)
+{
+	free(request->path);
+	free(request->data);
+	free(request->reply);
+	free(request);
+}
+
+/*
+ * close and release a client, which has no request left
+ *
+ * @client: client to release
+ */
+static void do_free_client(struct client_t * client)
+{
+	close(client->fd);
+	pthread_mutex_destroy(&client->lock);
+	pthread_cond_destroy(&client->cond);
+	free(client);
+}
+
+/*
+ * look up the reply kept for a source, and copy it as the reply of a request
+ * if found, marking it as used
+ *
+ * @request: request to answer
+ * @hash: hash of source
+ * @size: size of source
+ *
+ * return: 1 if found, 0 otherwise
+ */
+static int do_find_reply(struct request_t * request, uint64_t hash,
+	size_t size)
+{
+	struct reply_t * reply;
+	int found = 0;
+
+	pthread_mutex_lock(&server.cache_lock);
+	for (reply = server.buckets[hash & (SERVER_BUCKETS - 1)];
+		reply != NULL; reply = reply->next) {
+		if (reply->hash == hash && reply->size == size) {
+			break;
+		}
+	}
+	if (reply != NULL &&
+		(request->reply = malloc(reply->length)) != NULL) {
+		memcpy(request->reply, reply->data, reply->length);
+		request->length = reply->length;
+		do_unlink_reply(reply);
+		do_link_reply(reply);
+		found = 1;
+	}
+	pthread_mutex_unlock(&server.cache_lock);
+	return found;
+}
+
+/*
+ * keep the reply of a request for its source, dropping the least recently
+ * used replies until what is kept is within the size budget
+ *
+ * @request: request answered
+ * @hash: hash of source
+ * @size: size of source
+ */
+static void do_keep_reply(const struct request_t * request, uint64_t hash,
+	size_t size)
+{
+	struct reply_t * reply, ** p;
+	size_t budget = (size_t)(options.budget ? options.budget :
+		SERVER_BUDGET) << 20;
+
+	if (request->length > budget || (reply = malloc(sizeof(struct
+		reply_t) + request->length)) == NULL) {
+		return;
+	}
+	reply->hash = hash;
+	reply->size = size;
+	reply->length = request->length;
+	memcpy(reply->data, request->reply, request->length);
+
+	pthread_mutex_lock(&server.cache_lock);
+	p = &server.buckets[hash & (SERVER_BUCKETS - 1)];
+	reply->next = *p;
+	*p = reply;
+	do_link_reply(reply);
+	server.kept += reply->length;
+
+	while (server.kept > budget) {
+		reply = server.oldest;
+		for (p = &server.buckets[reply->hash & (SERVER_BUCKETS - 1)];
+			*p != reply; p = &(*p)->next) {
+		}
+		*p = reply->next;
+		do_unlink_reply(reply);
+		server.kept -= reply->length;
+		free(reply);
+	}
+	pthread_mutex_unlock(&server.cache_lock);
+}
+
+/* put a reply kept as the most recently used, or take it out of the order */
+static inline void do_link_reply(struct reply_t * reply)
+{
+	reply->older = server.newest;
+	reply->newer = NULL;
+	if (server.newest != NULL) {
+		server.newest->newer = reply;
+	} else {
+		server.oldest = reply;
+	}
+	server.newest = reply;
+}
+
+static inline void do_unlink_reply(struct reply_t * reply)
+{
+	if (reply->newer != NULL) {
+		reply->newer->older = reply->older;
+	} else {
+		server.newest = reply->older;
+	}
+	if (reply->older != NULL) {
+		reply->older->newer = reply->newer;
+	} else {
+		server.oldest = reply->newer;
+	}
+}
+
+/******************************** zip archives ********************************/
+
+/*
+ * an archive is mapped into memory once, and each '*.java' entry in its
+ * central directory is a job, which a worker unpacks into its own buffer and
+ * scans from there, so nothing is extracted to disk, see lexfile.c
+ */
+
+/*
+ * map an archive and add a job for each '*.java' entry of it
+ *
+ * @list: job list to append to
+ * @path: path of archive
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_open_archive(struct job_list_t * list, const char * path)
+{
+	struct archive_t * archive;
+	struct zip_entry_t entry;
+	const unsigned char * map;
+	struct stat st;
+	size_t size;
+	FILE * fp;
+	int ret = 0, next;
+	char err_msg[BUF_SIZE << 1];
+
+	if ((fp = fopen(path, "rb")) == NULL || fstat(fileno(fp), &st) != 0) {
+		snprintf(err_msg, sizeof(err_msg), "lex-java: cannot open '%s'",
+			path);
+		perror(err_msg);
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		return -1;
+	}
+	size = st.st_size;
+	map = size < 22 ? MAP_FAILED : mmap(NULL, size, PROT_READ,
+		MAP_PRIVATE, fileno(fp), 0);
+	fclose(fp);
+	if (map == MAP_FAILED) {
+		goto bad;
+	}
+	if ((archive = malloc(sizeof(*archive))) == NULL ||
+		(archive->path = strdup(path)) == NULL) {
+		perror("lex-java: cannot allocate jobs");
+		free(archive);
+		munmap((void *)map, size);
+		return -1;
+	}
+	archive->next = list->archives;
+	list->archives = archive;
+	if (do_open_zip(&archive->zip, map, size) != 0) {
+		goto bad;
 	}
 
+	while ((next = do_next_entry(&archive->zip, &entry)) > 0) {
+		if (do_add_entry(list, archive, &entry) != 0) {
+			ret = -1;
+		}
+	}
+	if (next < 0) {
+		goto bad;
+	}
+	return ret;
+
+bad:
+	fprintf(stderr, "lex-java: '%s' is not a zip archive\n", path);
+	return -1;
+}
+
+/*
+ * add a job for an entry of an archive if it is a '*.java' file
+ *
+ * @list: job list to append to
+ * @archive: archive of entry
+ * @entry: entry of archive
+ *
+ * return: 0 on success or if the entry is not wanted, -1 otherwise
+ */
+static int do_add_entry(struct job_list_t * list,
+	struct archive_t * archive, const struct zip_entry_t * entry)
+{
+	const unsigned char * name = entry->name, * p;
+	size_t length = entry->length, i;
+	struct job_t * job;
+	char path[BUF_SIZE];
+
+	if (length < 5 || memcmp(name + length - 5, ".java", 5) != 0) {
+		return 0;
+	}
+
+	/* an entry must not be written out of the directory of outputs */
+	for (i = 0; i < length; i = p - name + 1) {
+		if ((p = memchr(name + i, '/', length - i)) == NULL) {
+			p = name + length;
+		}
+		if (p == name + i || (p - name - i == 2 &&
+			memcmp(name + i, "..", 2) == 0) ||
+			memchr(name + i, '\0', p - name - i) != NULL) {
+			break;
+		}
+	}
+	if (i < length || length + strlen(archive->path) + 32 > BUF_SIZE) {
+		fprintf(stderr, "lex-java: cannot take '%.*s' out of '%s'\n",
+			(int)length, name, archive->path);
+		return -1;
+	}
+	snprintf(path, BUF_SIZE, "%s/%.*s", archive->path, (int)length, name);
+
+	if (do_check_entry(&archive->zip, entry) != 0 ||
+		entry->size > (uint64_t)(off_t)-1 >> 1) {
+		fprintf(stderr, "lex-java: cannot unpack '%s'\n", path);
+		return -1;
+	}
+
+	if (do_add_job(list, path, (off_t)entry->size) != 0) {
+		return -1;
+	}
+	job = &list->jobs[list->count - 1];
+	job->archive = archive;
+	job->entry = *entry;
 	return 0;
 }
 
+/*
+ * make a directory and its parents if they do not exist
+ *
+ * @path: path of directory, changed but restored
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_make_dirs(char * path)
+{
+	char * p;
+	int ret;
+
+	if (mkdir(path, 0777) == 0 || errno == EEXIST) {
+		return 0;
+	}
+	if (errno != ENOENT || (p = strrchr(path, '/')) == NULL) {
+		return -1;
+	}
+	*p = '\0';
+	ret = do_make_dirs(path);
+	*p = '/';
+	if (ret != 0) {
+		return -1;
+	}
+	return mkdir(path, 0777) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+#endif /* USE_THREADS */
+
+/********************************* watch mode *********************************/
+#ifdef USE_WATCH
+
+/*
+ * watch mode scans each '*.java' under a directory into
+ * 'SOURCE.scanner_output' as batch mode does, and then waits for changes
+ * told by inotify, scanning again only the sources whose content hash has
+ * changed, and removing the outputs of sources removed
+ * events are gathered until none comes for WATCH_DEBOUNCE milliseconds, or
+ * for WATCH_DELAY milliseconds at most, so a burst of writes to a source
+ * scans it once, and the path of each source scanned or removed is printed
+ * after each burst
+ * an output and its indexes are written under temporary names and renamed,
+ * indexes first, so a reader never sees one half written
+ */
+
+/*
+ * watch a directory tree until killed
+ *
+ * @path: directory to watch
+ *
+ * return: 1 on failure
+ */
+static int do_watch(const char * path)
+{
+	static struct watch_t watch;
+	/* aligned for the events read into it */
+	union
+	{
+		struct inotify_event event;
+		char data[WATCH_EVENTS_SIZE];
+	} events;
+	const struct inotify_event * event;
+	struct pollfd pfd;
+	struct timespec now, start = { 0, 0 };
+	ssize_t n;
+	char * p;
+	long elapsed;
+	int timeout;
+
+	if ((watch.fd = inotify_init1(IN_CLOEXEC)) < 0) {
+		perror("lex-java: cannot watch");
+		return 1;
+	}
+	if (do_watch_tree(&watch, path, 1) != 0) {
+		goto error;
+	}
+	do_watch_burst(&watch);
+
+	pfd.fd = watch.fd;
+	pfd.events = POLLIN;
+	while (1) {
+		/* a burst is over once quiet, or after the delay anyway */
+		timeout = -1;
+		if (watch.dirty_count > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+				(now.tv_nsec - start.tv_nsec) / 1000000;
+			timeout = elapsed >= WATCH_DELAY ? 0 :
+				WATCH_DELAY - elapsed < WATCH_DEBOUNCE ?
+				WATCH_DELAY - elapsed : WATCH_DEBOUNCE;
+		}
+		if ((n = poll(&pfd, 1, timeout)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("lex-java: cannot watch");
+			goto error;
+		}
+		if (n == 0) {
+			do_watch_burst(&watch);
+			continue;
+		}
+
+		if ((n = read(watch.fd, events.data, WATCH_EVENTS_SIZE)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("lex-java: cannot watch");
+			goto error;
+		}
+		if (watch.dirty_count == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &start);
+		}
+		for (p = events.data; p < events.data + n;
+			p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)p;
+			do_watch_event(&watch, event);
+		}
+	}
+
+error:
+	close(watch.fd);
+	return 1;
+}
+
+/*
+ * take an inotify event, marking the sources it changes
+ *
+ * @watch: watch state
+ * @event: event taken
+ */
+static void do_watch_event(struct watch_t * watch,
+	const struct inotify_event * event)
+{
+	const char * dir;
+	char path[BUF_SIZE];
+	struct stat st;
+	size_t length, n;
+	int i;
+
+	/*
+	 * events lost, so every source is looked at again, those scanned
+	 * before included, which are gone if removed meanwhile
+	 */
+	if (event->mask & IN_Q_OVERFLOW) {
+		for (n = 0; n < watch->count; ++n) {
+			if (watch->sources[n].known) {
+				do_mark_source(watch, watch->sources[n].path);
+			}
+		}
+		for (i = 0; i < watch->dir_capacity; ++i) {
+			if (watch->dirs[i] != NULL) {
+				strcpy(path, watch->dirs[i]);
+				do_watch_tree(watch, path, 0);
+			}
+		}
+		return;
+	}
+	if (event->mask & IN_IGNORED) {
+		if (event->wd < watch->dir_capacity) {
+			free(watch->dirs[event->wd]);
+			watch->dirs[event->wd] = NULL;
+		}
+		return;
+	}
+	if (event->len == 0 || event->wd >= watch->dir_capacity ||
+		(dir = watch->dirs[event->wd]) == NULL) {
+		return;
+	}
+	if (snprintf(path, BUF_SIZE, "%s/%s", dir, event->name) >=
+		BUF_SIZE) {
+		return;
+	}
+
+	if (event->mask & IN_ISDIR) {
+		/* a directory moved away is no longer where it was watched */
+		if (event->mask & (IN_MOVED_FROM | IN_DELETE)) {
+			do_unwatch_tree(watch, path);
+		} else {
+			do_watch_tree(watch, path, 0);
+		}
+		return;
+	}
+	/*
+	 * as in batch mode, only regular files are sources, while one gone is
+	 * marked for its outputs to be removed
+	 */
+	length = strlen(path);
+	if (length >= 5 && strcmp(path + length - 5, ".java") == 0 &&
+		(lstat(path, &st) != 0 || S_ISREG(st.st_mode))) {
+		do_mark_source(watch, path);
+	}
+}
+
+/*
+ * watch a directory and those under it, and mark each '*.java' in them
+ *
+ * @watch: watch state
+ * @path: directory
+ * @explicit: whether the path is given on command line, in which case it
+ *            may be a symbolic link and failures are reported
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_watch_tree(struct watch_t * watch, const char * path,
+	int explicit)
+{
+	struct stat st;
+	DIR * dir;
+	struct dirent * entry;
+	char child[BUF_SIZE];
+	char ** p;
+	size_t length;
+	int wd, n, ret = 0;
+
+	if ((explicit ? stat(path, &st) : lstat(path, &st)) != 0) {
+		return explicit ? do_watch_error(path) : -1;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		if (explicit) {
+			fprintf(stderr, "lex-java: '%s' is not a directory\n",
+				path);
+		}
+		return -1;
+	}
+
+	/* watched before read, so nothing made meanwhile is missed */
+	if ((wd = inotify_add_watch(watch->fd, path, WATCH_MASK)) < 0) {
+		return do_watch_error(path);
+	}
+	if (wd >= watch->dir_capacity) {
+		n = watch->dir_capacity ? watch->dir_capacity : 64;
+		while (n <= wd) {
+			n <<= 1;
+		}
+		if ((p = realloc(watch->dirs, n * sizeof(char *))) == NULL) {
+			return do_watch_error(path);
+		}
+		memset(p + watch->dir_capacity, 0,
+			(n - watch->dir_capacity) * sizeof(char *));
+		watch->dirs = p;
+		watch->dir_capacity = n;
+	}
+	/* a directory watched again has the same watch */
+	if (watch->dirs[wd] == NULL || strcmp(watch->dirs[wd], path) != 0) {
+		free(watch->dirs[wd]);
+		if ((watch->dirs[wd] = strdup(path)) == NULL) {
+			return do_watch_error(path);
+		}
+	}
+
+	if ((dir = opendir(path)) == NULL) {
+		return do_watch_error(path);
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 ||
+			strcmp(entry->d_name, "..") == 0 ||
+			snprintf(child, BUF_SIZE, "%s/%s", path,
+			entry->d_name) >= BUF_SIZE) {
+			continue;
+		}
+		length = strlen(child);
+		if (lstat(child, &st) != 0) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			if (do_watch_tree(watch, child, 0) != 0) {
+				ret = -1;
+			}
+		} else if (S_ISREG(st.st_mode) && length >= 5 &&
+			strcmp(child + length - 5, ".java") == 0) {
+			do_mark_source(watch, child);
+		}
+	}
+	closedir(dir);
+	return ret;
+}
+
+/*
+ * report a directory that cannot be watched
+ *
+ * @path: directory
+ *
+ * return: always -1
+ */
+static int do_watch_error(const char * path)
+{
+	char err_msg[BUF_SIZE + 32];
+
+	snprintf(err_msg, sizeof(err_msg), "lex-java: cannot watch '%s'",
+		path);
+	perror(err_msg);
+	return -1;
+}
+
+/*
+ * stop watching a directory and those under it, and forget the sources in
+ * them, whose outputs have gone along
+ *
+ * @watch: watch state
+ * @path: directory
+ */
+static void do_unwatch_tree(struct watch_t * watch, const char * path)
+{
+	size_t length = strlen(path), i;
+	int wd;
+
+	for (wd = 0; wd < watch->dir_capacity; ++wd) {
+		if (watch->dirs[wd] != NULL &&
+			strncmp(watch->dirs[wd], path, length) == 0 &&
+			(watch->dirs[wd][length] == '\0' ||
+			watch->dirs[wd][length] == '/')) {
+			inotify_rm_watch(watch->fd, wd);
+			free(watch->dirs[wd]);
+			watch->dirs[wd] = NULL;
+		}
+	}
+	for (i = 0; i < watch->count; ++i) {
+		if (strncmp(watch->sources[i].path, path, length) == 0 &&
+			watch->sources[i].path[length] == '/') {
+			watch->sources[i].known = 0;
+		}
+	}
+}
+
+/*
+ * mark a source as changed, to be looked at after the burst
+ *
+ * @watch: watch state
+ * @path: path of source
+ */
+static void do_mark_source(struct watch_t * watch, const char * path)
+{
+	struct watched_t * p;
+	long i;
+	int added;
+	size_t * q;
+
+	if ((i = do_intern(&watch->paths, path, strlen(path), &added)) < 0) {
+		return;
+	}
+	if (added) {
+		if ((size_t)i >= watch->capacity) {
+			if ((p = realloc(watch->sources, (i + 1) * 2 *
+				sizeof(struct watched_t))) == NULL) {
+				return;
+			}
+			if ((q = realloc(watch->dirty, (i + 1) * 2 *
+				sizeof(size_t))) == NULL) {
+				watch->sources = p;
+				return;
+			}
+			watch->sources = p;
+			watch->dirty = q;
+			watch->capacity = (i + 1) * 2;
+		}
+		memset(&watch->sources[i], 0, sizeof(struct watched_t));
+		if ((watch->sources[i].path = strdup(path)) == NULL) {
+			return;
+		}
+		watch->count = i + 1;
+	}
+	if ((size_t)i < watch->count && watch->sources[i].path != NULL &&
+		!watch->sources[i].dirty) {
+		watch->sources[i].dirty = 1;
+		watch->dirty[watch->dirty_count++] = i;
+	}
+}
+
+/*
+ * scan again the sources changed in a burst, whose content has changed
+ *
+ * @watch: watch state
+ */
+static void do_watch_burst(struct watch_t * watch)
+{
+	struct watched_t * source;
+	uint64_t hash;
+	size_t i, size;
+	int printed = 0;
+
+	for (i = 0; i < watch->dirty_count; ++i) {
+		source = &watch->sources[watch->dirty[i]];
+		source->dirty = 0;
+		if (do_load(source->path, &watch->scanner.unpacked,
+			&watch->scanner.unpacked_capacity, &size) != 0) {
+			/* a source removed takes its outputs along */
+			if (errno == ENOENT && source->known) {
+				do_remove_outputs(source->path);
+				source->known = 0;
+				printf("%s\n", source->path);
+				printed = 1;
+			}
+			continue;
+		}
+		hash = do_xxh64((const unsigned char *)
+			watch->scanner.unpacked, size, 0);
+		if (source->known && source->hash == hash &&
+			source->size == size) {
+			continue;
+		}
+		if (do_watch_scan(source->path, watch->scanner.unpacked, size,
+			&watch->scanner) != 0) {
+			source->known = 0;
+			continue;
+		}
+		source->hash = hash;
+		source->size = size;
+		source->known = 1;
+		printf("%s\n", source->path);
+		printed = 1;
+	}
+	watch->dirty_count = 0;
+	if (printed) {
+		fflush(stdout);
+	}
+}
+
+/*
+ * scan a source into 'SOURCE.scanner_output' and its indexes if wanted,
+ * replacing them at once by renaming
+ *
+ * @path: path of source
+ * @data: content of source
+ * @size: size of source
+ * @scanner: buffers of scanner
+ *
+ * return: 0 on success, -1 otherwise
+ */
+static int do_watch_scan(const char * path, const char * data, size_t size,
+	struct scanner_t * scanner)
+{
+	static const char * suffixes[] = { ".lines", ".comments", "" };
+	FILE * fps[3] = { NULL, NULL, NULL };
+	FILE * src;
+	char temps[3][BUF_SIZE + 32];
+	char out_path[BUF_SIZE + 32];
+	char err_msg[BUF_SIZE + 64];
+	int wanted[] = { options.lines, options.comments, 1 };
+	int i, fd, ret = -1;
+	mode_t mask;
+
+	/* outputs get the mode fopen() gives in batch mode, not 0600 */
+	mask = umask(0);
+	umask(mask);
+	for (i = 0; i < 3; ++i) {
+		temps[i][0] = '\0';
+	}
+	if ((src = fmemopen((char *)data, size, "r")) == NULL) {
+		goto out;
+	}
+	for (i = 0; i < 3; ++i) {
+		if (!wanted[i]) {
+			continue;
+		}
+		snprintf(temps[i], sizeof(temps[i]), "%s.scanner_output%s"
+			".XXXXXX", path, suffixes[i]);
+		if ((fd = mkstemp(temps[i])) < 0) {
+			temps[i][0] = '\0';
+			goto out;
+		}
+		if (fchmod(fd, 0666 & ~mask) != 0 ||
+			(fps[i] = fdopen(fd, "wb")) == NULL) {
+			close(fd);
+			goto out;
+		}
+	}
+	setvbuf(fps[2], scanner->output, _IOFBF, OUT_BUF_SIZE);
+
+	ret = do_scan(src, fps[2], fps[0], fps[1], scanner);
+	for (i = 0; i < 3; ++i) {
+		if (fps[i] != NULL && fclose(fps[i]) != 0) {
+			ret = -1;
+		}
+		fps[i] = NULL;
+	}
+
+	/* the output is renamed last, so it never goes without indexes */
+	for (i = 0; ret == 0 && i < 3; ++i) {
+		if (!wanted[i]) {
+			continue;
+		}
+		snprintf(out_path, sizeof(out_path), "%s.scanner_output%s",
+			path, suffixes[i]);
+		if (rename(temps[i], out_path) != 0) {
+			ret = -1;
+			break;
+		}
+		temps[i][0] = '\0';
+	}
+
+out:
+	if (ret != 0) {
+		snprintf(err_msg, sizeof(err_msg),
+			"lex-java: cannot write '%s.scanner_output'", path);
+		perror(err_msg);
+	}
+	if (src != NULL) {
+		fclose(src);
+	}
+	for (i = 0; i < 3; ++i) {
+		if (fps[i] != NULL) {
+			fclose(fps[i]);
+		}
+		if (temps[i][0] != '\0') {
+			unlink(temps[i]);
+		}
+	}
+	return ret;
+}
+
+/*
+ * remove the output of a source and its indexes
+ *
+ * @path: path of source
+ */
+static void do_remove_outputs(const char * path)
+{
+	static const char * suffixes[] = { ".lines", ".comments", "" };
+	char out_path[BUF_SIZE + 32];
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		snprintf(out_path, sizeof(out_path), "%s.scanner_output%s",
+			path, suffixes[i]);
+		unlink(out_path);
+	}
+}
+
+#endif /* USE_WATCH */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,802 @@
+/*
+ * lexfile.c - sources in zip archives and hashes of sources, shared by the
+ * modes of lex-java
+ *
+ * Copyright (C) 2015 Chaos Shen
+ *
+ * This file is part of parse-java.
+ *
+ * parse-java is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * parse-java is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with parse-java.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _MSC_VER
+/*
+ * if using MSVC, suppress stupid security warnings, define snprintf and inline
+ */
+# define _CRT_SECURE_NO_WARNINGS
+# define snprintf _snprintf
+# define inline
+#endif /* _MSC_VER */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lexfile.h"
+
+#define HUFFMAN_FAST_BITS 9
+
+/* primes of XXH64 */
+#define XXH_PRIME1 UINT64_C(0x9e3779b185ebca87)
+#define XXH_PRIME2 UINT64_C(0xc2b2ae3d27d4eb4f)
+#define XXH_PRIME3 UINT64_C(0x165667b19e3779f9)
+#define XXH_PRIME4 UINT64_C(0x85ebca77c2b2ae63)
+#define XXH_PRIME5 UINT64_C(0x27d4eb2f165667c5)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * inflate state, decompressing a deflate stream into a buffer of its known
+ * size
+ * bytes past the end of input read as zeros, which are counted, so reading
+ * past the end is found at the end
+ */
+struct inflate_t
+{
+	const unsigned char * in;
+	const unsigned char * in_end;
+	size_t past;                /* zero bytes read past the end of input */
+	unsigned long bits;         /* bit buffer, the next bit lowest */
+	int count;                  /* number of bits in bit buffer */
+	unsigned char * out;
+	size_t pos;
+	size_t size;
+};
+
+/*
+ * canonical Huffman code type
+ * codes no longer than HUFFMAN_FAST_BITS are looked up in fast by the next
+ * bits of input, as (symbol << 4 | length), and longer ones are decoded bit by
+ * bit by counts of codes of each length and symbols in order of codes
+ */
+struct huffman_t
+{
+	unsigned short fast[1 << HUFFMAN_FAST_BITS];
+	unsigned short count[16];
+	unsigned short symbol[288];
+};
+
+static int do_inflate(struct inflate_t * inflate);
+static int do_inflate_codes(struct inflate_t * inflate,
+	const struct huffman_t * lengths, const struct huffman_t * distances);
+static int do_read_codes(struct inflate_t * inflate,
+	struct huffman_t * lengths, struct huffman_t * distances);
+static int do_build_huffman(struct huffman_t * huffman,
+	const unsigned char * lengths, int n);
+static inline int do_decode(struct inflate_t * inflate,
+	const struct huffman_t * huffman);
+static inline unsigned long do_bits(struct inflate_t * inflate, int n);
+static inline void do_need_bits(struct inflate_t * inflate, int n);
+static void do_make_crc_table(void);
+static unsigned long do_crc32(const unsigned char * data, size_t length);
+static inline uint64_t do_xxh_round(uint64_t acc, uint64_t input);
+static inline uint64_t do_xxh_merge(uint64_t acc, uint64_t value);
+static inline uint64_t do_rotate(uint64_t value, int bits);
+static inline uint64_t do_get64(const unsigned char * p);
+static inline uint64_t do_get32(const unsigned char * p);
+static inline unsigned long do_get16(const unsigned char * p);
+
+/******************************** zip archives ********************************/
+
+/*
+ * an archive in memory is read through its central directory, entry by
+ * entry, and an entry is unpacked into a buffer of its size
+ * entries are stored or deflated, and ZIP64 archives are read as well
+ */
+
+/*
+ * tables of CRC-32, where crc_table[k][b] is the CRC of byte b followed by k
+ * zero bytes, so 8 bytes are taken at a time
+ */
+static uint32_t crc_table[8][256];
+
+/*
+ * find the central directory of a zip archive
+ * the first archive must be opened before any entry is unpacked by threads
+ *
+ * @zip: archive to open
+ * @map: archive in memory, kept until the archive is done with
+ * @size: size of archive
+ *
+ * return: 0 on success, -1 if it is not a zip archive
+ */
+int do_open_zip(struct zip_t * zip, const unsigned char * map, size_t size)
+{
+	uint64_t count, offset, length, z;
+	size_t i, last;
+
+	zip->map = map;
+	zip->size = size;
+	zip->next = zip->end = map;
+	zip->count = 0;
+	do_make_crc_table();
+	if (size < 22) {
+		return -1;
+	}
+
+	/* the end of central directory is followed by a comment only */
+	last = size - 22 > 0xffff ? size - 22 - 0xffff : 0;
+	for (i = size - 22; i > last && do_get32(map + i) != 0x06054b50;
+		--i) {
+	}
+	if (do_get32(map + i) != 0x06054b50) {
+		return -1;
+	}
+	count = do_get16(map + i + 10);
+	length = do_get32(map + i + 12);
+	offset = do_get32(map + i + 16);
+
+	/*
+	 * ZIP64 end of central directory, found by its locator before, and
+	 * wholly before the locator, so an archive of only a locator and an
+	 * end of central directory, too short for one, is bad
+	 */
+	if (i >= 20 && do_get32(map + i - 20) == 0x07064b50) {
+		z = do_get64(map + i - 12);
+		if (size < 56 || z > size - 56 || z + 56 > i - 20 ||
+			do_get32(map + z) != 0x06064b50) {
+			return -1;
+		}
+		count = do_get64(map + z + 32);
+		length = do_get64(map + z + 40);
+		offset = do_get64(map + z + 48);
+	}
+	if (offset > size || length > size - offset) {
+		return -1;
+	}
+
+	zip->next = map + offset;
+	zip->end = zip->next + length;
+	zip->count = count;
+	return 0;
+}
+
+/*
+ * read the next entry of the central directory of a zip archive
+ *
+ * @zip: archive opened by do_open_zip()
+ * @entry: entry read
+ *
+ * return: 1 if an entry is read, 0 if there are no more, -1 if the central
+ * directory is broken
+ */
+int do_next_entry(struct zip_t * zip, struct zip_entry_t * entry)
+{
+	const unsigned char * p = zip->next, * extra, * end;
+	size_t length;
+
+	if (zip->count == 0) {
+		return 0;
+	}
+	if (zip->end - p < 46 || do_get32(p) != 0x02014b50 ||
+		(size_t)(zip->end - p - 46) < do_get16(p + 28) +
+		do_get16(p + 30) + do_get16(p + 32)) {
+		return -1;
+	}
+	length = do_get16(p + 28);
+	entry->name = p + 46;
+	entry->length = length;
+	entry->size = do_get32(p + 24);
+	entry->packed = do_get32(p + 20);
+	entry->offset = do_get32(p + 42);
+	entry->flags = do_get16(p + 8);
+	entry->method = do_get16(p + 10);
+	entry->crc = do_get32(p + 16);
+	zip->next = p + 46 + length + do_get16(p + 30) + do_get16(p + 32);
+	--zip->count;
+
+	/* sizes and offset too large are in the ZIP64 extra field instead */
+	extra = p + 46 + length;
+	end = extra + do_get16(p + 30);
+	while (end - extra >= 4 && do_get16(extra) != 0x0001) {
+		extra += 4 + do_get16(extra + 2);
+	}
+	if (end - extra >= 4) {
+		p = extra + 4;
+		end = p + do_get16(extra + 2) < end ? p + do_get16(extra + 2) :
+			end;
+		if (entry->size == 0xffffffff && end - p >= 8) {
+			entry->size = do_get64(p);
+			p += 8;
+		}
+		if (entry->packed == 0xffffffff && end - p >= 8) {
+			entry->packed = do_get64(p);
+			p += 8;
+		}
+		if (entry->offset == 0xffffffff && end - p >= 8) {
+			entry->offset = do_get64(p);
+		}
+	}
+	return 1;
+}
+
+/*
+ * check whether an entry of a zip archive can be unpacked, which it cannot if
+ * it is encrypted, compressed otherwise than deflated, or out of the archive
+ *
+ * @zip: archive of entry
+ * @entry: entry to check
+ *
+ * return: 0 if it can be unpacked, -1 otherwise
+ */
+int do_check_entry(const struct zip_t * zip,
+	const struct zip_entry_t * entry)
+{
+	if ((entry->flags & 0x0001) ||
+		(entry->method != 0 && entry->method != 8) ||
+		(entry->method == 0 && entry->packed != entry->size) ||
+		entry->size > (size_t)-1 || entry->offset > zip->size) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * unpack an entry of a zip archive
+ *
+ * @zip: archive of entry
+ * @entry: entry checked by do_check_entry()
+ * @buffer: buffer of at least the size of entry
+ *
+ * return: 0 on success, -1 if the entry is broken
+ */
+int do_unpack_entry(const struct zip_t * zip,
+	const struct zip_entry_t * entry, unsigned char * buffer)
+{
+	const unsigned char * map = zip->map;
+	size_t size = zip->size, offset = entry->offset, skip;
+	struct inflate_t inflate;
+
+	if (size < 30 || offset > size - 30 ||
+		do_get32(map + offset) != 0x04034b50) {
+		return -1;
+	}
+	skip = 30 + do_get16(map + offset + 26) + do_get16(map + offset + 28);
+	if (skip > size - offset || entry->packed > size - offset - skip) {
+		return -1;
+	}
+
+	if (entry->method == 0) {
+		memcpy(buffer, map + offset + skip, entry->size);
+	} else {
+		inflate.in = map + offset + skip;
+		inflate.in_end = inflate.in + entry->packed;
+		inflate.past = 0;
+		inflate.bits = 0;
+		inflate.count = 0;
+		inflate.out = buffer;
+		inflate.pos = 0;
+		inflate.size = entry->size;
+		if (do_inflate(&inflate) != 0 || inflate.pos != entry->size) {
+			return -1;
+		}
+	}
+	return do_crc32(buffer, entry->size) == entry->crc ? 0 : -1;
+}
+
+/*
+ * decompress a deflate stream
+ *
+ * @inflate: inflate state
+ *
+ * return: 0 on success, -1 if the stream is broken or does not fit
+ */
+static int do_inflate(struct inflate_t * inflate)
+{
+	struct huffman_t lengths, distances;
+	unsigned char fixed[288 + 30];
+	unsigned long length;
+	int last, i;
+
+	do {
+		last = do_bits(inflate, 1);
+		switch (do_bits(inflate, 2)) {
+		/* a stored block, starting at a byte boundary */
+		case 0:
+			do_bits(inflate, inflate->count & 7);
+			length = do_bits(inflate, 16);
+			if (do_bits(inflate, 16) != (~length & 0xffff)) {
+				return -1;
+			}
+			/* whole bytes in the bit buffer come first */
+			for (; length > 0 && inflate->count > 0; --length) {
+				if (inflate->pos == inflate->size) {
+					return -1;
+				}
+				inflate->out[inflate->pos++] = do_bits(inflate,
+					8);
+			}
+			if (length > (size_t)(inflate->in_end - inflate->in) ||
+				length > inflate->size - inflate->pos) {
+				return -1;
+			}
+			memcpy(inflate->out + inflate->pos, inflate->in,
+				length);
+			inflate->in += length;
+			inflate->pos += length;
+			break;
+
+		/* a block of fixed codes */
+		case 1:
+			for (i = 0; i < 288 + 30; ++i) {
+				fixed[i] = i < 144 ? 8 : i < 256 ? 9 :
+					i < 280 ? 7 : i < 288 ? 8 : 5;
+			}
+			do_build_huffman(&lengths, fixed, 288);
+			do_build_huffman(&distances, fixed + 288, 30);
+			if (do_inflate_codes(inflate, &lengths,
+				&distances) != 0) {
+				return -1;
+			}
+			break;
+
+		/* a block of codes given before it */
+		case 2:
+			if (do_read_codes(inflate, &lengths,
+				&distances) != 0 ||
+				do_inflate_codes(inflate, &lengths,
+				&distances) != 0) {
+				return -1;
+			}
+			break;
+
+		default:
+			return -1;
+		}
+
+		/* zeros past the end of input must not be taken */
+		if (inflate->past * 8 > (size_t)inflate->count) {
+			return -1;
+		}
+	} while (!last);
+	return 0;
+}
+
+/*
+ * decompress the codes of a block until its end
+ *
+ * @inflate: inflate state
+ * @lengths: code of literals and lengths
+ * @distances: code of distances
+ *
+ * return: 0 on success, -1 if the block is broken or does not fit
+ */
+static int do_inflate_codes(struct inflate_t * inflate,
+	const struct huffman_t * lengths, const struct huffman_t * distances)
+{
+	static const unsigned short length_base[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35,
+		43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+	};
+	static const unsigned char length_extra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+		4, 4, 4, 4, 5, 5, 5, 5, 0,
+	};
+	static const unsigned short distance_base[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193,
+		12289, 16385, 24577,
+	};
+	static const unsigned char distance_extra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+		9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+	};
+	unsigned char * out = inflate->out, * from;
+	size_t length, distance;
+	int symbol;
+
+	for (;;) {
+		if ((symbol = do_decode(inflate, lengths)) < 0) {
+			return -1;
+		}
+		if (symbol < 256) {
+			if (inflate->pos == inflate->size) {
+				return -1;
+			}
+			out[inflate->pos++] = symbol;
+			continue;
+		}
+		if (symbol == 256) {
+			return 0;
+		}
+
+		/* a copy of what is decompressed before */
+		if ((symbol -= 257) >= 29) {
+			return -1;
+		}
+		length = length_base[symbol] +
+			do_bits(inflate, length_extra[symbol]);
+		if ((symbol = do_decode(inflate, distances)) < 0 ||
+			symbol >= 30) {
+			return -1;
+		}
+		distance = distance_base[symbol] +
+			do_bits(inflate, distance_extra[symbol]);
+		if (distance > inflate->pos ||
+			length > inflate->size - inflate->pos) {
+			return -1;
+		}
+		from = out + inflate->pos - distance;
+		inflate->pos += length;
+		/* the copy may overlap what it makes */
+		for (; length > 0; --length) {
+			out[inflate->pos - length] = *from++;
+		}
+	}
+}
+
+/*
+ * read the codes of a block of codes given before it
+ *
+ * @inflate: inflate state
+ * @lengths: code of literals and lengths to build
+ * @distances: code of distances to build
+ *
+ * return: 0 on success, -1 if the codes are broken
+ */
+static int do_read_codes(struct inflate_t * inflate,
+	struct huffman_t * lengths, struct huffman_t * distances)
+{
+	static const unsigned char order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1,
+		15,
+	};
+	struct huffman_t codes;
+	unsigned char length[286 + 30];
+	int n, n_lengths, n_distances, symbol, value, repeat, i;
+
+	n_lengths = do_bits(inflate, 5) + 257;
+	n_distances = do_bits(inflate, 5) + 1;
+	n = do_bits(inflate, 4) + 4;
+	if (n_lengths > 286 || n_distances > 30) {
+		return -1;
+	}
+
+	/* lengths of the code of lengths of codes */
+	memset(length, 0, 19);
+	for (i = 0; i < n; ++i) {
+		length[order[i]] = do_bits(inflate, 3);
+	}
+	if (do_build_huffman(&codes, length, 19) != 0) {
+		return -1;
+	}
+
+	for (i = 0; i < n_lengths + n_distances; i += repeat) {
+		if ((symbol = do_decode(inflate, &codes)) < 0) {
+			return -1;
+		}
+		if (symbol < 16) {
+			length[i] = symbol;
+			repeat = 1;
+			continue;
+		}
+		if (symbol == 16) {
+			if (i == 0) {
+				return -1;
+			}
+			value = length[i - 1];
+			repeat = 3 + do_bits(inflate, 2);
+		} else {
+			value = 0;
+			repeat = symbol == 17 ? 3 + do_bits(inflate, 3) :
+				11 + do_bits(inflate, 7);
+		}
+		if (i + repeat > n_lengths + n_distances) {
+			return -1;
+		}
+		memset(length + i, value, repeat);
+	}
+
+	/* a block without an end cannot be right */
+	if (length[256] == 0 ||
+		do_build_huffman(lengths, length, n_lengths) != 0 ||
+		do_build_huffman(distances, length + n_lengths,
+		n_distances) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * build a canonical Huffman code from the lengths of codes of its symbols
+ * an incomplete code is taken, as a code not in it fails to decode
+ *
+ * @huffman: code to build
+ * @lengths: length of code of each symbol, 0 for no code
+ * @n: number of symbols
+ *
+ * return: 0 on success, -1 if there are too many codes of some length
+ */
+static int do_build_huffman(struct huffman_t * huffman,
+	const unsigned char * lengths, int n)
+{
+	unsigned short offsets[16];
+	unsigned int code = 0, reversed;
+	int left = 1, length, index = 0, i, k;
+
+	memset(huffman->count, 0, sizeof(huffman->count));
+	for (i = 0; i < n; ++i) {
+		++huffman->count[lengths[i]];
+	}
+	for (length = 1; length < 16; ++length) {
+		left = (left << 1) - huffman->count[length];
+		if (left < 0) {
+			return -1;
+		}
+	}
+
+	offsets[1] = 0;
+	for (length = 1; length < 15; ++length) {
+		offsets[length + 1] = offsets[length] +
+			huffman->count[length];
+	}
+	for (i = 0; i < n; ++i) {
+		if (lengths[i] != 0) {
+			huffman->symbol[offsets[lengths[i]]++] = i;
+		}
+	}
+
+	/* codes are read from their first bit, the lowest of the bits read */
+	memset(huffman->fast, 0, sizeof(huffman->fast));
+	for (length = 1; length <= HUFFMAN_FAST_BITS; ++length) {
+		for (i = 0; i < huffman->count[length]; ++i, ++code) {
+			reversed = 0;
+			for (k = 0; k < length; ++k) {
+				reversed |= (code >> k & 1) << (length - 1 - k);
+			}
+			for (k = reversed; k < 1 << HUFFMAN_FAST_BITS;
+				k += 1 << length) {
+				huffman->fast[k] =
+					huffman->symbol[index + i] << 4 |
+					length;
+			}
+		}
+		index += huffman->count[length];
+		code <<= 1;
+	}
+	return 0;
+}
+
+/*
+ * decode a symbol
+ *
+ * @inflate: inflate state
+ * @huffman: code to decode with
+ *
+ * return: the symbol, -1 if no code matches
+ */
+static inline int do_decode(struct inflate_t * inflate,
+	const struct huffman_t * huffman)
+{
+	int code = 0, first = 0, index = 0, count, length, entry;
+
+	do_need_bits(inflate, HUFFMAN_FAST_BITS);
+	entry = huffman->fast[inflate->bits &
+		((1 << HUFFMAN_FAST_BITS) - 1)];
+	if (entry != 0) {
+		inflate->bits >>= entry & 15;
+		inflate->count -= entry & 15;
+		return entry >> 4;
+	}
+
+	/* a long code is decoded bit by bit */
+	for (length = 1; length < 16; ++length) {
+		code |= do_bits(inflate, 1);
+		count = huffman->count[length];
+		if (code - count < first) {
+			return huffman->symbol[index + (code - first)];
+		}
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+/*
+ * take bits of input
+ *
+ * @inflate: inflate state
+ * @n: number of bits, no more than 16
+ *
+ * return: the bits, the first one lowest
+ */
+static inline unsigned long do_bits(struct inflate_t * inflate, int n)
+{
+	unsigned long bits;
+
+	do_need_bits(inflate, n);
+	bits = inflate->bits & ((1UL << n) - 1);
+	inflate->bits >>= n;
+	inflate->count -= n;
+	return bits;
+}
+
+/*
+ * fill the bit buffer with at least a number of bits
+ *
+ * @inflate: inflate state
+ * @n: number of bits, no more than 16
+ */
+static inline void do_need_bits(struct inflate_t * inflate, int n)
+{
+	while (inflate->count < n) {
+		if (inflate->in < inflate->in_end) {
+			inflate->bits |= (unsigned long)*inflate->in++ <<
+				inflate->count;
+		} else {
+			++inflate->past;
+		}
+		inflate->count += 8;
+	}
+}
+
+/* make the tables of CRC-32 once, before any worker uses them */
+static void do_make_crc_table(void)
+{
+	uint32_t c;
+	int i, k;
+
+	if (crc_table[0][255] != 0) {
+		return;
+	}
+	for (i = 0; i < 256; ++i) {
+		c = i;
+		for (k = 0; k < 8; ++k) {
+			c = c & 1 ? 0xedb88320 ^ c >> 1 : c >> 1;
+		}
+		crc_table[0][i] = c;
+	}
+	for (i = 0; i < 256; ++i) {
+		for (k = 1; k < 8; ++k) {
+			crc_table[k][i] = crc_table[0][crc_table[k - 1][i] &
+				0xff] ^ crc_table[k - 1][i] >> 8;
+		}
+	}
+}
+
+/*
+ * compute CRC-32 of data, as zip archives do
+ *
+ * @data: data
+ * @length: length of data
+ *
+ * return: CRC-32 of data
+ */
+static unsigned long do_crc32(const unsigned char * data, size_t length)
+{
+	uint32_t c = 0xffffffff, low, high;
+
+	for (; length >= 8; length -= 8, data += 8) {
+		low = c ^ (uint32_t)do_get32(data);
+		high = (uint32_t)do_get32(data + 4);
+		c = crc_table[7][low & 0xff] ^ crc_table[6][low >> 8 & 0xff] ^
+			crc_table[5][low >> 16 & 0xff] ^
+			crc_table[4][low >> 24] ^ crc_table[3][high & 0xff] ^
+			crc_table[2][high >> 8 & 0xff] ^
+			crc_table[1][high >> 16 & 0xff] ^
+			crc_table[0][high >> 24];
+	}
+	while (length-- > 0) {
+		c = crc_table[0][(c ^ *data++) & 0xff] ^ c >> 8;
+	}
+	return c ^ 0xffffffff;
+}
+
+/*********************************** hashes ***********************************/
+
+/*
+ * hash data with XXH64
+ *
+ * @data: data to hash
+ * @length: length of data
+ * @seed: seed of hash
+ *
+ * return: the hash
+ */
+uint64_t do_xxh64(const unsigned char * data, size_t length, uint64_t seed)
+{
+	const unsigned char * end = data + length;
+	uint64_t v1, v2, v3, v4, hash;
+
+	if (length >= 32) {
+		v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+		v2 = seed + XXH_PRIME2;
+		v3 = seed;
+		v4 = seed - XXH_PRIME1;
+		for (; end - data >= 32; data += 32) {
+			v1 = do_xxh_round(v1, do_get64(data));
+			v2 = do_xxh_round(v2, do_get64(data + 8));
+			v3 = do_xxh_round(v3, do_get64(data + 16));
+			v4 = do_xxh_round(v4, do_get64(data + 24));
+		}
+		hash = do_rotate(v1, 1) + do_rotate(v2, 7) +
+			do_rotate(v3, 12) + do_rotate(v4, 18);
+		hash = do_xxh_merge(hash, v1);
+		hash = do_xxh_merge(hash, v2);
+		hash = do_xxh_merge(hash, v3);
+		hash = do_xxh_merge(hash, v4);
+	} else {
+		hash = seed + XXH_PRIME5;
+	}
+	hash += length;
+
+	for (; end - data >= 8; data += 8) {
+		hash ^= do_xxh_round(0, do_get64(data));
+		hash = do_rotate(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+	}
+	if (end - data >= 4) {
+		hash ^= do_get32(data) * XXH_PRIME1;
+		hash = do_rotate(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+		data += 4;
+	}
+	for (; data < end; ++data) {
+		hash ^= *data * XXH_PRIME5;
+		hash = do_rotate(hash, 11) * XXH_PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+static inline uint64_t do_xxh_round(uint64_t acc, uint64_t input)
+{
+	return do_rotate(acc + input * XXH_PRIME2, 31) * XXH_PRIME1;
+}
+
+static inline uint64_t do_xxh_merge(uint64_t acc, uint64_t value)
+{
+	return (acc ^ do_xxh_round(0, value)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+static inline uint64_t do_rotate(uint64_t value, int bits)
+{
+	return value << bits | value >> (64 - bits);
+}
+
+/* read a little endian integer */
+static inline uint64_t do_get64(const unsigned char * p)
+{
+	return do_get32(p) | do_get32(p + 4) << 32;
+}
+
+static inline uint64_t do_get32(const unsigned char * p)
+{
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+		(uint64_t)p[3] << 24;
+}
+
+static inline unsigned long do_get16(const unsigned char * p)
+{
+	return (unsigned long)p[0] | (unsigned long)p[1] << 8;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
@@ -0,0 +1,75 @@
+/*
+ * lexfile.h - sources in zip archives and hashes of sources, shared by the
+ * modes of lex-java
+ *
+ * Copyright (C) 2015 Chaos Shen
+ *
+ * This file is part of parse-java.
+ *
+ * parse-java is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * parse-java is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with parse-java.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LEXFILE_H
+#define LEXFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * zip archive type, an archive in memory and where its central directory is
+ * read up to
+ */
+struct zip_t
+{
+	const unsigned char * map;
+	size_t size;
+	const unsigned char * next; /* next header of central directory */
+	const unsigned char * end;  /* end of central directory */
+	uint64_t count;             /* entries not read yet */
+};
+
+/*
+ * entry type of a zip archive, as its central directory header gives it, with
+ * sizes and offset of ZIP64 taken
+ */
+struct zip_entry_t
+{
+	const unsigned char * name; /* not terminated, in the archive */
+	size_t length;
+	uint64_t size;
+	uint64_t packed;            /* compressed size */
+	uint64_t offset;            /* offset of local header */
+	int flags;
+	int method;
+	unsigned long crc;
+};
+
+int do_open_zip(struct zip_t * zip, const unsigned char * map, size_t size);
+int do_next_entry(struct zip_t * zip, struct zip_entry_t * entry);
+int do_check_entry(const struct zip_t * zip,
+	const struct zip_entry_t * entry);
+int do_unpack_entry(const struct zip_t * zip,
+	const struct zip_entry_t * entry, unsigned char * buffer);
+
+uint64_t do_xxh64(const unsigned char * data, size_t length, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LEXFILE_H */
@@ -0,0 +1,3981 @@
+/*
+ * lexjava.c - scanner of Java source code
+ *
+ * Copyright (C) 2015 Chaos Shen
+ *
+ * This file is part of parse-java.
+ *
+ * parse-java is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * parse-java is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with parse-java.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _MSC_VER
+/*
+ * if using MSVC, suppress stupid security warnings, define snprintf and inline
+ */
+# define _CRT_SECURE_NO_WARNINGS
+# define snprintf _snprintf
+# define inline
+#endif /* _MSC_VER */
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexjava.h"
+#include "lexdfa.h"
+
+/* run kernels of SSE2 and AVX2, selected at runtime by CPUID */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define USE_SIMD
+# include <immintrin.h>
+#endif /* __GNUC__ && (__x86_64__ || __i386__) */
+
+#define BUF_SIZE LEX_BUF_SIZE
+
+/* size of chunks a mapped file is split into to scan in parallel */
+#ifndef CHUNK_SIZE
+# define CHUNK_SIZE (256 * 1024)
+#endif /* CHUNK_SIZE */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * scanner state type, which is everything a scan carries from one buffer to
+ * the next
+ */
+struct scan_t
+{
+	const struct lex_sink * sink;
+	/* kernel to jump over a run of characters staying in a run state */
+	size_t (* run)(const struct dfa_run_t * run, const char * buffer,
+		size_t i, size_t end);
+	int state;
+	size_t start;               /* start of current word in current buffer */
+	int condition_flag;
+	int words;
+	int lines;
+	int words_in_line;
+	size_t base;                /* offset of current buffer in the source */
+	size_t line_start;          /* offset where current line starts */
+	size_t flag_pos;            /* end of the last '?' or ':', 0 if none */
+	size_t comment;             /* bytes of comments ended */
+	size_t comment_start;       /* offset of a comment left, see below */
+	int comment_left;           /* a comment is left at the end of a buffer */
+	/*
+	 * called where the scanner is in the initial state again, to stop
+	 * the scan if it returns nonzero, or NULL
+	 */
+	int (* mark)(struct scan_t * scan, size_t i, int condition_flag);
+	void * data;                /* data of mark */
+};
+
+/*
+ * event type of a chunk, which is a word, a wrong word if type is WRONG, a
+ * line if type is 0, or a comment if type is minus its comment kind
+ */
+struct event_t
+{
+	const char * word;
+	size_t length;
+	int type;
+	size_t pos;                 /* see struct token_t */
+};
+
+/* mark type, a position where a chunk is in the initial state */
+struct mark_t
+{
+	size_t pos;
+	size_t event;               /* index of the first event after it */
+};
+
+/*
+ * chunk type, a part of a mapped file scanned ahead in parallel, see parallel
+ * scan section
+ */
+struct chunk_t
+{
+	size_t begin;
+	size_t end;
+	int flag;                   /* condition flag assumed at begin */
+	struct event_t * events;
+	size_t count;
+	size_t capacity;
+	struct mark_t * marks;
+	size_t mark_count;
+	size_t mark_capacity;
+	size_t flag_pos;            /* end of the last '?' or ':', 0 if none */
+	int state;                  /* state at end */
+	size_t start;               /* start of current word at end */
+	int exit_flag;              /* condition flag at end */
+	int failed;                 /* out of memory, events are incomplete */
+	int ready;
+	int syncing;                /* checking marks instead of adding them */
+	size_t cursor;              /* the first mark not passed when syncing */
+	size_t synced;              /* index of the mark synced */
+	const struct scan_t * scan; /* scan ahead, while scanning ahead */
+	size_t pos;                 /* start of the word being reported */
+};
+
+/* rescan type, a document being scanned again, see incremental scan section */
+struct rescan_t
+{
+	struct doc_t * doc;
+	size_t end;                 /* end of edit in new text */
+	size_t old_end;             /* end of edit in old text */
+	size_t cursor;              /* the first old checkpoint not passed */
+	size_t synced;              /* index of old checkpoint synced */
+	size_t base;                /* offset of the last checkpoint */
+	size_t token;               /* index of the first token scanned */
+	int lines;                  /* line count at the last checkpoint */
+	int failed;                 /* out of memory */
+	const struct scan_t * scan;
+	size_t pos;                 /* start of the word being reported */
+};
+
+/* lexer type, see token iterator section */
+struct lexer_t
+{
+	struct scan_t scan;
+	struct lex_sink sink;
+	const char * buffer;
+	size_t length;
+	char * word;                /* the word left, followed by a newline */
+	size_t word_length;
+	size_t word_capacity;
+	int part;                   /* 0 for buffer, 1 for word, 2 for end */
+	size_t pos;                 /* position to scan on in current part */
+	struct lex_token * tokens;  /* tokens scanned, taken from head */
+	size_t head;
+	size_t count;
+	size_t capacity;
+	int failed;                 /* out of memory */
+	size_t fed;                 /* length of the chunks fed */
+	struct lex_position next;   /* position of the word being reported */
+};
+
+#ifdef USE_THREADS
+/*
+ * parallel scan type, shared by the threads scanning chunks ahead and the one
+ * merging them in order
+ */
+struct parallel_t
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	const char * map;
+	size_t size;
+	size_t (* run)(const struct dfa_run_t * run, const char * buffer,
+		size_t i, size_t end);
+	struct chunk_t * slots;     /* chunk k is scanned in slot k % window */
+	size_t window;
+	size_t count;               /* number of chunks */
+	size_t next;                /* the next chunk to scan */
+	size_t merged;              /* number of chunks merged */
+	int positions;              /* whether positions are wanted */
+	int comments;               /* whether comments are wanted */
+};
+#endif /* USE_THREADS */
+
+static void do_init_scan(struct scan_t * scan, const struct lex_sink * sink);
+static void do_lex_input(struct scan_t * scan, struct input_t * in,
+	size_t keep);
+static size_t do_scan_buffer(struct scan_t * scan, const char * buffer,
+	size_t i, size_t end);
+static void do_open_input(struct input_t * in, FILE * src);
+static const char * do_read(struct input_t * in, size_t keep,
+	size_t * nread);
+static int do_reserve(struct input_t * in, size_t size);
+static void do_close_input(struct input_t * in);
+static inline void do_output_word(const struct lex_sink * sink,
+	const char * word, size_t length, int type);
+static inline void do_output_wrong_word(const struct lex_sink * sink,
+	const char * word, size_t length, int lines);
+static inline void do_output_space(const struct lex_sink * sink, char c);
+static inline void do_output_position(const struct scan_t * scan,
+	size_t start);
+static void do_output_comment(struct scan_t * scan, int state, size_t start,
+	size_t end);
+static inline void do_leave_comment(struct scan_t * scan);
+static inline void do_end_comment(struct scan_t * scan, size_t end);
+static inline int do_judgement(const char * word, size_t length);
+static int do_judge_unicode(const char * word, size_t length);
+static int do_decode_word(const char * word, size_t length, char * ascii,
+	size_t * n);
+static inline unsigned long do_decode_escape(const unsigned char ** p);
+static inline unsigned long do_decode_utf8(const unsigned char ** p,
+	const unsigned char * end);
+static inline int do_is_identifier(unsigned long c, int start);
+static inline int do_in_ranges(const unsigned long (* ranges)[2],
+	size_t count, unsigned long c);
+static inline void do_update_word_count(int * words, int * words_in_line);
+static inline void do_update_line_count(const struct lex_sink * sink,
+	int * lines, int * words_in_line);
+static inline void do_output_word_count(const struct lex_sink * sink,
+	int words);
+
+static void do_integer(const char * word, size_t length,
+	struct lex_number * number);
+static void do_real(const char * word, size_t length,
+	struct lex_number * number);
+static inline void do_add_digit(uint64_t * mantissa, int digit, int * exact,
+	int * nonzero);
+static inline int do_digit(char c);
+
+static void do_text_word(void * data, const char * word, size_t length,
+	int type);
+static void do_text_wrong_word(void * data, const char * word, size_t length,
+	int lines);
+static void do_text_line_count(void * data, int lines, int words_in_line);
+static void do_text_word_count(void * data, int words);
+static void do_text_position_word(void * data, const char * word,
+	size_t length, int type);
+static void do_text_position_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_text_position_line_count(void * data, int lines,
+	int words_in_line);
+static void do_text_position_word_count(void * data, int words);
+static void do_text_position(void * data, size_t offset, int line,
+	size_t column);
+static void do_put_text_position(FILE * out, struct lex_position * last,
+	const struct lex_position * next);
+static inline void do_set_position(struct lex_position * position,
+	size_t offset, int line, size_t column);
+
+static void do_symbol_word(void * data, const char * word, size_t length,
+	int type);
+static void do_symbol_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_symbol_line_count(void * data, int lines, int words_in_line);
+static void do_symbol_word_count(void * data, int words);
+static void do_symbol_position(void * data, size_t offset, int line,
+	size_t column);
+static inline void do_end_symbol_record(struct symbol_sink_t * symbol);
+
+static void do_binary_word(void * data, const char * word, size_t length,
+	int type);
+static void do_binary_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_binary_line_count(void * data, int lines, int words_in_line);
+static void do_binary_word_count(void * data, int words);
+static void do_binary_position(void * data, size_t offset, int line,
+	size_t column);
+static inline void do_put_kind(struct binary_sink_t * binary, int type);
+static inline void do_put_number(FILE * out, const char * word,
+	size_t length, int type);
+static inline int do_is_expected(const struct binary_sink_t * binary);
+static void do_put_binary_position(struct binary_sink_t * binary,
+	const char * word, size_t length, int type);
+static void do_index_word(void * data, const char * word, size_t length,
+	int type);
+static void do_index_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_index_line_count(void * data, int lines, int words_in_line);
+static void do_index_word_count(void * data, int words);
+static void do_index_position(void * data, size_t offset, int line,
+	size_t column);
+static void do_index_comment(void * data, size_t offset, size_t length,
+	int kind);
+static void do_space_word(void * data, const char * word, size_t length,
+	int type);
+static void do_space_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_space_line_count(void * data, int lines, int words_in_line);
+static void do_space_word_count(void * data, int words);
+static void do_space_position(void * data, size_t offset, int line,
+	size_t column);
+static void do_space_comment(void * data, size_t offset, size_t length,
+	int kind);
+static inline void do_pass_position(struct space_sink_t * space,
+	const struct lex_position * position);
+static inline void do_flush_space(struct space_sink_t * space);
+static void do_comment_word(void * data, const char * word, size_t length,
+	int type);
+static void do_comment_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_comment_line_count(void * data, int lines,
+	int words_in_line);
+static void do_comment_word_count(void * data, int words);
+static void do_comment_position(void * data, size_t offset, int line,
+	size_t column);
+static void do_comment_comment(void * data, size_t offset, size_t length,
+	int kind);
+
+static void do_count_lines(struct lex_stats * stats, const char * text,
+	size_t length, size_t * column);
+static inline void do_add_histogram(unsigned long * histogram,
+	size_t value);
+static void do_stats_word(void * data, const char * word, size_t length,
+	int type);
+static void do_stats_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_stats_line_count(void * data, int lines, int words_in_line);
+static void do_stats_word_count(void * data, int words);
+
+static inline void do_put_varint(FILE * out, uint64_t value);
+static inline void do_put_fixed(FILE * out, unsigned long value, int size);
+static inline void do_put_string(FILE * out, const char * string,
+	size_t length);
+static inline unsigned int do_hash(const char * string, size_t length);
+
+static int do_mark(struct scan_t * scan, size_t i, int condition_flag);
+static inline int do_can_sync(const struct chunk_t * chunk, size_t i,
+	int condition_flag);
+static void do_add_event(struct chunk_t * chunk, const char * word,
+	size_t length, int type, size_t pos);
+static void do_chunk_word(void * data, const char * word, size_t length,
+	int type);
+static void do_chunk_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_chunk_line_count(void * data, int lines, int words_in_line);
+static void do_chunk_word_count(void * data, int words);
+static void do_chunk_position(void * data, size_t offset, int line,
+	size_t column);
+static void do_chunk_comment(void * data, size_t offset, size_t length,
+	int kind);
+static void do_merge_chunk(struct scan_t * scan, struct chunk_t * chunk,
+	const char * map);
+static void do_replay(struct scan_t * scan, const struct chunk_t * chunk,
+	size_t from);
+static int do_rescan(struct doc_t * doc, size_t from, size_t end,
+	size_t old_end);
+static int do_doc_mark(struct scan_t * scan, size_t i, int condition_flag);
+static void do_add_token(struct rescan_t * rescan, const char * word,
+	size_t length, int type);
+static void do_doc_word(void * data, const char * word, size_t length,
+	int type);
+static void do_doc_wrong_word(void * data, const char * word, size_t length,
+	int lines);
+static void do_doc_line_count(void * data, int lines, int words_in_line);
+static void do_doc_word_count(void * data, int words);
+static void do_doc_position(void * data, size_t offset, int line,
+	size_t column);
+static void do_doc_comment(void * data, size_t offset, size_t length,
+	int kind);
+static int do_grow(void ** array, size_t * capacity, size_t size,
+	size_t count);
+
+static int do_lexer_mark(struct scan_t * scan, size_t i, int condition_flag);
+static void do_add_lexer_token(struct lexer_t * lexer, const char * word,
+	size_t length, int type, int lines, int words,
+	const struct lex_position * position);
+static void do_lexer_word(void * data, const char * word, size_t length,
+	int type);
+static void do_lexer_wrong_word(void * data, const char * word,
+	size_t length, int lines);
+static void do_lexer_line_count(void * data, int lines, int words_in_line);
+static void do_lexer_word_count(void * data, int words);
+static void do_lexer_position(void * data, size_t offset, int line,
+	size_t column);
+static int do_feed_mark(struct scan_t * scan, size_t i, int condition_flag);
+
+#ifdef USE_THREADS
+static void * do_scan_chunks(void * arg);
+static void do_scan_chunk(struct parallel_t * parallel, size_t k);
+#endif /* USE_THREADS */
+
+static size_t do_run(const struct dfa_run_t * run, const char * buffer,
+	size_t i, size_t end);
+#ifdef USE_SIMD
+static size_t do_run_sse2(const struct dfa_run_t * run, const char * buffer,
+	size_t i, size_t end);
+static size_t do_run_avx2(const struct dfa_run_t * run, const char * buffer,
+	size_t i, size_t end);
+#endif /* USE_SIMD */
+
+/*
+ * do lexical analysis
+ *
+ * @src: a FILE pointer of Java source file
+ * @sink: sink to report words and counts to
+ * @in: input source buffer, reused across calls
+ */
+void do_lex(FILE * src, const struct lex_sink * sink, struct input_t * in)
+{
+	struct scan_t scan;
+
+	do_init_scan(&scan, sink);
+	do_open_input(in, src);
+	do_lex_input(&scan, in, 0);
+	do_output_word_count(sink, scan.words);
+	do_close_input(in);
+}
+
+#ifdef USE_THREADS
+/*
+ * do lexical analysis of a mapped file with multiple threads, and report the
+ * same as do_lex() does
+ * the file is split into chunks, which are scanned ahead by other threads
+ * from the initial state, and merged in order by this thread, see parallel
+ * scan section
+ * streams and small files are scanned by this thread alone
+ *
+ * @src: a FILE pointer of Java source file
+ * @sink: sink to report words and counts to
+ * @in: input source buffer, reused across calls
+ * @threads: number of threads scanning ahead
+ */
+void do_lex_parallel(FILE * src, const struct lex_sink * sink,
+	struct input_t * in, int threads)
+{
+	struct parallel_t parallel;
+	struct scan_t scan;
+	struct chunk_t * chunk;
+	pthread_t * workers = NULL;
+	size_t k, keep;
+	int i, n = 0;
+
+	do_init_scan(&scan, sink);
+	do_open_input(in, src);
+
+	memset(&parallel, 0, sizeof(parallel));
+	parallel.map = in->map;
+	parallel.size = in->size;
+	parallel.run = scan.run;
+	parallel.positions = sink->position != NULL;
+	parallel.comments = sink->comment != NULL;
+	parallel.count = (in->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	parallel.window = (size_t)threads * 2;
+	if (in->map == NULL || threads < 2 || parallel.count < 2) {
+		goto sequential;
+	}
+	if ((parallel.slots = calloc(parallel.window,
+		sizeof(*parallel.slots))) == NULL ||
+		(workers = malloc(threads * sizeof(*workers))) == NULL) {
+		goto sequential;
+	}
+
+	pthread_mutex_init(&parallel.lock, NULL);
+	pthread_cond_init(&parallel.cond, NULL);
+	for (n = 0; n < threads; ++n) {
+		if (pthread_create(&workers[n], NULL, do_scan_chunks,
+			&parallel) != 0) {
+			break;
+		}
+	}
+	if (n == 0) {
+		pthread_cond_destroy(&parallel.cond);
+		pthread_mutex_destroy(&parallel.lock);
+		goto sequential;
+	}
+
+	/* merge chunks in order as soon as they are scanned */
+	for (k = 0; k < parallel.count; ++k) {
+		chunk = &parallel.slots[k % parallel.window];
+		pthread_mutex_lock(&parallel.lock);
+		while (!chunk->ready) {
+			pthread_cond_wait(&parallel.cond, &parallel.lock);
+		}
+		pthread_mutex_unlock(&parallel.lock);
+
+		do_merge_chunk(&scan, chunk, in->map);
+
+		pthread_mutex_lock(&parallel.lock);
+		chunk->ready = 0;
+		++parallel.merged;
+		pthread_cond_broadcast(&parallel.cond);
+		pthread_mutex_unlock(&parallel.lock);
+	}
+
+	for (i = 0; i < n; ++i) {
+		pthread_join(workers[i], NULL);
+	}
+	pthread_cond_destroy(&parallel.cond);
+	pthread_mutex_destroy(&parallel.lock);
+
+	/* the whole map is scanned, so only the newline added is left */
+	in->mapped = 1;
+	do_leave_comment(&scan);
+	keep = dfa_idle[scan.state] ? 0 : in->size - scan.start;
+	scan.base = in->size - keep;
+	do_lex_input(&scan, in, keep);
+	goto out;
+
+sequential:
+	do_lex_input(&scan, in, 0);
+out:
+	do_output_word_count(sink, scan.words);
+	do_close_input(in);
+	if (parallel.slots != NULL) {
+		for (k = 0; k < parallel.window; ++k) {
+			free(parallel.slots[k].events);
+			free(parallel.slots[k].marks);
+		}
+		free(parallel.slots);
+	}
+	free(workers);
+}
+#endif /* USE_THREADS */
+
+/*
+ * set up a scan from the beginning of a source
+ *
+ * @scan: scanner state
+ * @sink: sink to report words and counts to
+ */
+static void do_init_scan(struct scan_t * scan, const struct lex_sink * sink)
+{
+	memset(scan, 0, sizeof(*scan));
+	scan->sink = sink;
+	scan->state = DFA_STATE_START;
+	scan->run = do_run;
+
+#ifdef USE_SIMD
+	if (__builtin_cpu_supports("avx2")) {
+		scan->run = do_run_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		scan->run = do_run_sse2;
+	}
+#endif /* USE_SIMD */
+}
+
+/*
+ * scan the rest of an input source
+ *
+ * @scan: scanner state
+ * @in: input source
+ * @keep: number of bytes at the end of the last chunk read to keep, which
+ *        belong to current word
+ */
+static void do_lex_input(struct scan_t * scan, struct input_t * in,
+	size_t keep)
+{
+	const char * buffer;
+	size_t nread;
+
+	/*
+	 * current word is the span from start to i in current buffer, and only
+	 * when it is not finished at the end of a buffer, it is kept at the
+	 * beginning of the next buffer
+	 */
+	while ((buffer = do_read(in, keep, &nread)) != NULL) {
+		scan->start = 0;
+		do_scan_buffer(scan, buffer, keep, nread);
+		do_leave_comment(scan);
+
+		/* comments and initial state have no word to keep */
+		keep = dfa_idle[scan->state] ? 0 : nread - scan->start;
+		scan->base += nread - keep;
+	}
+	/* the last buffer is left, so the source ends at its offset */
+	do_end_comment(scan, 0);
+}
+
+/*
+ * run the scanner over a buffer
+ *
+ * @scan: scanner state
+ * @buffer: current buffer
+ * @i: index of the first character to scan
+ * @end: length of current buffer
+ *
+ * return: end, or where the scan is stopped by the mark of scanner state
+ */
+static size_t do_scan_buffer(struct scan_t * scan, const char * buffer,
+	size_t i, size_t end)
+{
+	const struct lex_sink * sink = scan->sink;
+	size_t start = scan->start;
+	int state = scan->state, condition_flag = scan->condition_flag, type;
+	unsigned int next;
+
+	while (i < end) {
+		next = dfa_next[state][dfa_class[(unsigned char)buffer[i]]];
+
+		/* move on scanning */
+		if (next < DFA_RUN) {
+			state = next;
+			++i;
+			continue;
+		}
+
+		/*
+		 * meet a newline in a comment, or enter a run state and jump
+		 * to the first character leaving it
+		 */
+		if (next != DFA_ACCEPT) {
+			state = next & DFA_STATE_MASK;
+			++i;
+			if (next & DFA_LINE) {
+				scan->line_start = scan->base + i;
+				do_update_line_count(sink, &scan->lines,
+					&scan->words_in_line);
+			}
+			if (next & DFA_RUN) {
+				i = scan->run(&dfa_run[state], buffer, i, end);
+			}
+			continue;
+		}
+
+		/*
+		 * accept current word, and scan current character again from
+		 * the first state
+		 */
+		if (sink->position != NULL &&
+			dfa_accept[state] != DFA_QUESTION &&
+			dfa_accept[state] != DFA_SKIP) {
+			do_output_position(scan, start);
+		}
+		switch (dfa_accept[state]) {
+		/* get a keyword, boolean value or identifier */
+		case DFA_WORD:
+			do_output_word(sink, buffer + start, i - start,
+				do_judgement(buffer + start, i - start));
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			break;
+
+		/* get an identifier or keyword out of ASCII, or a wrong word */
+		case DFA_UNICODE:
+			type = do_judge_unicode(buffer + start, i - start);
+			if (type == WRONG) {
+				do_output_wrong_word(sink, buffer + start,
+					i - start, scan->lines + 1);
+			} else {
+				do_output_word(sink, buffer + start, i - start,
+					type);
+			}
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			break;
+
+		/* get a wrong word */
+		case DFA_WRONG:
+			do_output_wrong_word(sink, buffer + start, i - start,
+				scan->lines + 1);
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			break;
+
+		/* catch a ' ', '\t' or '\r' */
+		case DFA_SPACE:
+			do_output_space(sink, buffer[start]);
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			break;
+
+		/* catch a '\n' */
+		case DFA_NEWLINE:
+			do_output_space(sink, buffer[start]);
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			scan->line_start = scan->base + i;
+			do_update_line_count(sink, &scan->lines,
+				&scan->words_in_line);
+			break;
+
+		/* catch a ':', or a ':' after '?' */
+		case DFA_COLON:
+			if (condition_flag) {
+				do_output_word(sink, "?:", 2, CONDITION);
+			} else {
+				do_output_word(sink, buffer + start, i - start,
+					COLON);
+			}
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			scan->flag_pos = i;
+			break;
+
+		/* a '?' is dropped, while a second one is wrong */
+		case DFA_QUESTION:
+			scan->flag_pos = i;
+			if (condition_flag) {
+				state = DFA_STATE_WRONG;
+				continue;
+			}
+			condition_flag = 1;
+			break;
+
+		/* the end of a comment */
+		case DFA_SKIP:
+			scan->comment += i - start;
+			if (sink->comment != NULL) {
+				do_output_comment(scan, state, start, i);
+			}
+			break;
+
+		/* get a word of the accepted type */
+		default:
+			do_output_word(sink, buffer + start, i - start,
+				dfa_accept[state]);
+			do_update_word_count(&scan->words,
+				&scan->words_in_line);
+			break;
+		}
+		state = DFA_STATE_START;
+		start = i;
+
+		if (scan->mark != NULL &&
+			scan->mark(scan, i, condition_flag)) {
+			break;
+		}
+	}
+
+	scan->state = state;
+	scan->start = start;
+	scan->condition_flag = condition_flag;
+	return i;
+}
+
+/*
+ * prepare an input source, mapping it into memory if it is a regular file
+ *
+ * @in: input source to prepare, whose buffer is kept from previous use
+ * @src: a FILE pointer of Java source file
+ */
+static void do_open_input(struct input_t * in, FILE * src)
+{
+#ifdef USE_MMAP
+	struct stat st;
+	void * map;
+#endif /* USE_MMAP */
+
+	in->fp = src;
+	in->map = NULL;
+	in->size = 0;
+	in->mapped = 0;
+	in->end = 0;
+	in->length = 0;
+
+#ifdef USE_MMAP
+	/* pipes, terminals and empty files fall back to the stream */
+	if (fstat(fileno(src), &st) != 0 || !S_ISREG(st.st_mode) ||
+		st.st_size <= 0) {
+		return;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(src), 0);
+	if (map == MAP_FAILED) {
+		return;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	in->map = map;
+	in->size = st.st_size;
+#endif /* USE_MMAP */
+}
+
+/*
+ * get the next chunk of input
+ * a mapped file is returned as a whole, followed by a chunk of a single
+ * newline, while a stream is returned 4 KB at a time with a newline manually
+ * added to the last chunk
+ *
+ * @in: input source
+ * @keep: number of bytes at the end of the previous chunk to keep at the
+ *        beginning of this one
+ * @nread: a pointer to store the length of the chunk, including kept bytes
+ *
+ * return: the chunk on success, NULL if there is no more input
+ */
+static const char * do_read(struct input_t * in, size_t keep,
+	size_t * nread)
+{
+	size_t want, n;
+
+	if (in->end) {
+		return NULL;
+	}
+
+	if (in->map != NULL) {
+		if (!in->mapped) {
+			in->mapped = 1;
+			*nread = in->size;
+			return in->map;
+		}
+		if (do_reserve(in, keep + 1) != 0) {
+			return NULL;
+		}
+		memcpy(in->buffer, in->map + in->size - keep, keep);
+		in->buffer[keep] = '\n';
+		in->end = 1;
+		*nread = keep + 1;
+		return in->buffer;
+	}
+
+	/* read at least as much as kept, so a long word costs linear time */
+	want = keep < BUF_SIZE ? BUF_SIZE : keep;
+	if (keep != 0) {
+		memmove(in->buffer, in->buffer + in->length - keep, keep);
+	}
+	if (do_reserve(in, keep + want + 1) != 0) {
+		return NULL;
+	}
+	n = fread(in->buffer + keep, sizeof(char), want, in->fp);
+	/* manually add a newline at the last buffer */
+	if (n < want) {
+		in->buffer[keep + n] = '\n';
+		++n;
+		in->end = 1;
+	}
+	in->length = keep + n;
+	*nread = in->length;
+	return in->buffer;
+}
+
+/*
+ * make sure the buffer of an input source has at least the given size
+ *
+ * @in: input source
+ * @size: size wanted
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+static int do_reserve(struct input_t * in, size_t size)
+{
+	size_t capacity = in->capacity ? in->capacity : BUF_SIZE << 1;
+	char * buffer;
+
+	if (size <= in->capacity) {
+		return 0;
+	}
+	while (capacity < size) {
+		capacity <<= 1;
+	}
+	if ((buffer = realloc(in->buffer, capacity)) == NULL) {
+		perror("lex-java: cannot allocate input buffer");
+		return -1;
+	}
+	in->buffer = buffer;
+	in->capacity = capacity;
+	return 0;
+}
+
+/*
+ * finish an input source, the FILE pointer is left open and the buffer is
+ * kept for next use
+ *
+ * @in: input source to finish
+ */
+static void do_close_input(struct input_t * in)
+{
+#ifdef USE_MMAP
+	if (in->map != NULL) {
+		munmap((void *)in->map, in->size);
+		in->map = NULL;
+	}
+#endif /* USE_MMAP */
+}
+
+/*
+ * release the buffer of an input source
+ *
+ * @in: input source
+ */
+void do_free_input(struct input_t * in)
+{
+	free(in->buffer);
+	in->buffer = NULL;
+	in->capacity = 0;
+}
+
+/*
+ * report a word to sink
+ *
+ * @sink: sink to report to
+ * @word: word to report, not terminated
+ * @length: length of word
+ * @type: word type, see attribute list in lexjava.h
+ */
+static inline void do_output_word(const struct lex_sink * sink,
+	const char * word, size_t length, int type)
+{
+	sink->word(sink->data, word, length, type);
+}
+
+/*
+ * report a wrong word with line number to sink
+ *
+ * @sink: sink to report to
+ * @word: wrong word to report, not terminated
+ * @length: length of word
+ * @lines: current line number
+ */
+static inline void do_output_wrong_word(const struct lex_sink * sink,
+	const char * word, size_t length, int lines)
+{
+	sink->wrong_word(sink->data, word, length, lines);
+}
+
+/*
+ * report a space to sink, where '\t', '\r' and '\n' are escaped
+ *
+ * @sink: sink to report to
+ * @c: the space
+ */
+static inline void do_output_space(const struct lex_sink * sink, char c)
+{
+	switch (c) {
+	case '\t':
+		sink->word(sink->data, "\\t", 2, SPACE);
+		break;
+
+	case '\r':
+		sink->word(sink->data, "\\r", 2, SPACE);
+		break;
+
+	case '\n':
+		sink->word(sink->data, "\\n", 2, SPACE);
+		break;
+
+	default:
+		sink->word(sink->data, " ", 1, SPACE);
+		break;
+	}
+}
+
+/*
+ * report where a word starts to a sink wanting positions
+ *
+ * @scan: scanner state
+ * @start: start of word in current buffer
+ */
+static inline void do_output_position(const struct scan_t * scan,
+	size_t start)
+{
+	size_t offset = scan->base + start;
+
+	scan->sink->position(scan->sink->data, offset, scan->lines + 1,
+		offset - scan->line_start + 1);
+}
+
+/*
+ * report a comment ended to a sink wanting comments
+ *
+ * @scan: scanner state
+ * @state: state accepting the comment
+ * @start: start of comment in current buffer, unless it is left
+ * @end: end of comment in current buffer, after the character accepting it
+ */
+static void do_output_comment(struct scan_t * scan, int state, size_t start,
+	size_t end)
+{
+	size_t offset = scan->comment_left ? scan->comment_start :
+		scan->base + start;
+	int kind = LEX_COMMENT_BLOCK;
+
+	end += scan->base;
+	if (state == DFA_STATE_LINE_COMMENT_END) {
+		kind = LEX_COMMENT_LINE;
+		--end;
+	} else if (state == DFA_STATE_JAVADOC_END) {
+		kind = LEX_COMMENT_JAVADOC;
+	}
+	scan->sink->comment(scan->sink->data, offset, end - offset, kind);
+	scan->comment_left = 0;
+}
+
+/*
+ * keep where a comment not ended starts, before current buffer is left,
+ * as comments are not kept across buffers
+ *
+ * @scan: scanner state at the end of current buffer
+ */
+static inline void do_leave_comment(struct scan_t * scan)
+{
+	if (scan->sink->comment != NULL && !scan->comment_left &&
+		dfa_idle[scan->state] && scan->state != DFA_STATE_START) {
+		scan->comment_start = scan->base + scan->start;
+		scan->comment_left = 1;
+	}
+}
+
+/*
+ * report a line comment ended by the newline added to a source, which has
+ * nothing after it to be accepted by
+ *
+ * @scan: scanner state at the end of source
+ * @end: end of source after the newline, counted from the offset of current
+ *       buffer
+ */
+static inline void do_end_comment(struct scan_t * scan, size_t end)
+{
+	if (scan->sink->comment != NULL &&
+		scan->state == DFA_STATE_LINE_COMMENT_END) {
+		do_output_comment(scan, scan->state, scan->start, end);
+	}
+}
+
+/*
+ * determine if a word is a boolean value, a keyword or an identifier
+ *
+ * @word: word to judge, not terminated
+ * @length: length of word
+ *
+ * return: word type, see attribute list in lexjava.h
+ */
+static inline int do_judgement(const char * word, size_t length)
+{
+	int i = dfa_keyword(word, length);
+
+	return i < 0 ? IDENTIFIER : dfa_keywords[i].type;
+}
+
+/*
+ * ranges of non-ASCII code points in no Java identifier, which are mostly
+ * blocks of punctuation and symbols, with private use and surrogates
+ */
+static const unsigned long non_identifier[][2] = {
+	{0xa0, 0xa1}, {0xa6, 0xa9}, {0xab, 0xac}, {0xae, 0xb4}, {0xb6, 0xb9},
+	{0xbb, 0xbf}, {0xd7, 0xd7}, {0xf7, 0xf7}, {0x2c2, 0x2c5},
+	{0x2d2, 0x2df}, {0x2e5, 0x2eb}, {0x2ed, 0x2ed}, {0x2ef, 0x2ff},
+	{0x375, 0x375}, {0x37e, 0x37e}, {0x384, 0x385}, {0x387, 0x387},
+	{0x3f6, 0x3f6}, {0x482, 0x482}, {0x55a, 0x55f}, {0x589, 0x58a},
+	{0x58d, 0x58e}, {0x5be, 0x5be}, {0x5c0, 0x5c0}, {0x5c3, 0x5c3},
+	{0x5c6, 0x5c6}, {0x5f3, 0x5f4}, {0x606, 0x60a}, {0x60c, 0x60f},
+	{0x61b, 0x61b}, {0x61d, 0x61f}, {0x66a, 0x66d}, {0x6d4, 0x6d4},
+	{0x6de, 0x6de}, {0x6e9, 0x6e9}, {0x6fd, 0x6fe}, {0x700, 0x70d},
+	{0x964, 0x965}, {0x970, 0x970}, {0xe4f, 0xe4f}, {0xe5a, 0xe5b},
+	{0x2000, 0x200a}, {0x2010, 0x2029}, {0x202f, 0x203e},
+	{0x2041, 0x2053}, {0x2055, 0x205f}, {0x2070, 0x2070},
+	{0x2072, 0x207e}, {0x2080, 0x208f}, {0x2100, 0x2101},
+	{0x2103, 0x2106}, {0x2108, 0x2109}, {0x2114, 0x2114},
+	{0x2116, 0x2118}, {0x211e, 0x2123}, {0x2125, 0x2125},
+	{0x2127, 0x2127}, {0x2129, 0x2129}, {0x212e, 0x212e},
+	{0x213a, 0x213b}, {0x2140, 0x2144}, {0x214a, 0x214d},
+	{0x214f, 0x215f}, {0x2189, 0x2bff}, {0x2ce5, 0x2cea},
+	{0x2cf9, 0x2cff}, {0x2e00, 0x2fff}, {0x3000, 0x3004},
+	{0x3008, 0x3020}, {0x3030, 0x3030}, {0x3036, 0x3037},
+	{0x303d, 0x303f}, {0x309b, 0x309c}, {0x30a0, 0x30a0},
+	{0x30fb, 0x30fb}, {0x3190, 0x319f}, {0x31c0, 0x31ef},
+	{0x3200, 0x33ff}, {0x4dc0, 0x4dff}, {0xa490, 0xa4cf},
+	{0xa4fe, 0xa4ff}, {0xa60d, 0xa60f}, {0xa673, 0xa673},
+	{0xa67e, 0xa67e}, {0xa6f2, 0xa6f7}, {0xa700, 0xa716},
+	{0xa720, 0xa721}, {0xa789, 0xa78a}, {0xa828, 0xa82b},
+	{0xa830, 0xa837}, {0xa839, 0xa839}, {0xd800, 0xf8ff},
+	{0xfb29, 0xfb29}, {0xfd3e, 0xfd3f}, {0xfdfd, 0xfdfd},
+	{0xfe10, 0xfe19}, {0xfe30, 0xfe32}, {0xfe35, 0xfe4c},
+	{0xfe50, 0xfe68}, {0xfe6a, 0xfe6b}, {0xff01, 0xff03},
+	{0xff05, 0xff0f}, {0xff1a, 0xff20}, {0xff3b, 0xff3e},
+	{0xff40, 0xff40}, {0xff5b, 0xff65}, {0xffe2, 0xffe4},
+	{0xffe8, 0xffee}, {0xfffc, 0xffff}, {0x10100, 0x1013f},
+	{0x1d000, 0x1d24f}, {0x1d300, 0x1d35f}, {0x1f000, 0x1faff},
+	{0xf0000, 0x10ffff},
+};
+
+/*
+ * ranges of non-ASCII code points in Java identifiers but not at the
+ * beginning, which are combining marks, digits and ignorable controls
+ */
+static const unsigned long identifier_part[][2] = {
+	{0x80, 0x9f}, {0xad, 0xad}, {0x300, 0x36f}, {0x483, 0x489},
+	{0x591, 0x5bd}, {0x5bf, 0x5bf}, {0x5c1, 0x5c2}, {0x5c4, 0x5c5},
+	{0x5c7, 0x5c7}, {0x600, 0x605}, {0x610, 0x61a}, {0x61c, 0x61c},
+	{0x64b, 0x669}, {0x670, 0x670}, {0x6d6, 0x6dd}, {0x6df, 0x6e4},
+	{0x6e7, 0x6e8}, {0x6ea, 0x6ed}, {0x6f0, 0x6f9}, {0x70f, 0x70f},
+	{0x711, 0x711}, {0x730, 0x74a}, {0x7a6, 0x7b0}, {0x7c0, 0x7c9},
+	{0x7eb, 0x7f3}, {0x900, 0x903}, {0x93a, 0x93c}, {0x93e, 0x94f},
+	{0x951, 0x957}, {0x962, 0x963}, {0x966, 0x96f}, {0x981, 0x983},
+	{0x9bc, 0x9bc}, {0x9be, 0x9cd}, {0x9d7, 0x9d7}, {0x9e2, 0x9e3},
+	{0x9e6, 0x9ef}, {0xa01, 0xa03}, {0xa3c, 0xa51}, {0xa66, 0xa71},
+	{0xa75, 0xa75}, {0xa81, 0xa83}, {0xabc, 0xabc}, {0xabe, 0xacd},
+	{0xae2, 0xae3}, {0xae6, 0xaef}, {0xb01, 0xb03}, {0xb3c, 0xb3c},
+	{0xb3e, 0xb57}, {0xb62, 0xb63}, {0xb66, 0xb6f}, {0xb82, 0xb82},
+	{0xbbe, 0xbd7}, {0xbe6, 0xbef}, {0xc00, 0xc04}, {0xc3c, 0xc3c},
+	{0xc3e, 0xc56}, {0xc62, 0xc63}, {0xc66, 0xc6f}, {0xc81, 0xc83},
+	{0xcbc, 0xcbc}, {0xcbe, 0xcd6}, {0xce2, 0xce3}, {0xce6, 0xcef},
+	{0xd00, 0xd03}, {0xd3b, 0xd3c}, {0xd3e, 0xd4d}, {0xd57, 0xd57},
+	{0xd62, 0xd63}, {0xd66, 0xd6f}, {0xe31, 0xe31}, {0xe34, 0xe3a},
+	{0xe47, 0xe4e}, {0xe50, 0xe59}, {0xeb1, 0xeb1}, {0xeb4, 0xebc},
+	{0xec8, 0xece}, {0xed0, 0xed9}, {0xf18, 0xf19}, {0xf20, 0xf29},
+	{0xf35, 0xf35}, {0xf37, 0xf37}, {0xf39, 0xf39}, {0xf3e, 0xf3f},
+	{0xf71, 0xf84}, {0xf86, 0xf87}, {0xf8d, 0xfbc}, {0x102b, 0x103e},
+	{0x1040, 0x1049}, {0x1056, 0x1059}, {0x17b4, 0x17d3},
+	{0x17dd, 0x17dd}, {0x17e0, 0x17e9}, {0x180b, 0x1819},
+	{0x1ab0, 0x1aff}, {0x1dc0, 0x1dff}, {0x200b, 0x200f},
+	{0x202a, 0x202e}, {0x2060, 0x206f}, {0x20d0, 0x20ff},
+	{0x2cef, 0x2cf1}, {0x2d7f, 0x2d7f}, {0x2de0, 0x2dff},
+	{0x302a, 0x302f}, {0x3099, 0x309a}, {0xa620, 0xa629},
+	{0xa66f, 0xa672}, {0xa674, 0xa67d}, {0xa69e, 0xa69f},
+	{0xa6f0, 0xa6f1}, {0xa802, 0xa802}, {0xa806, 0xa806},
+	{0xa80b, 0xa80b}, {0xa823, 0xa827}, {0xfb1e, 0xfb1e},
+	{0xfe00, 0xfe0f}, {0xfe20, 0xfe2f}, {0xfeff, 0xfeff},
+	{0xff10, 0xff19}, {0xfff9, 0xfffb}, {0x1d7ce, 0x1d7ff},
+	{0xe0001, 0xe0001}, {0xe0020, 0xe007f}, {0xe0100, 0xe01ef},
+};
+
+/*
+ * determine if a word with UTF-8 characters or unicode escapes is a boolean
+ * value, a keyword, an identifier or a wrong word, by decoding it
+ * the ASCII words spelt in escapes are judged as do_judgement() does, and
+ * the rest are identifiers unless not well encoded, or having a character
+ * not in Java identifiers, roughly by blocks of Unicode
+ *
+ * @word: word to judge, not terminated
+ * @length: length of word
+ *
+ * return: word type, see attribute list in lexjava.h
+ */
+static int do_judge_unicode(const char * word, size_t length)
+{
+	char ascii[16];
+	size_t n;
+
+	switch (do_decode_word(word, length, ascii, &n)) {
+	case -1:
+		return WRONG;
+	case 1:
+		return do_judgement(ascii, n);
+	default:
+		return IDENTIFIER;
+	}
+}
+
+/*
+ * decode a word with UTF-8 characters or unicode escapes, checking it is a
+ * Java identifier
+ *
+ * @word: word to decode, whose escapes are well formed
+ * @length: length of word
+ * @ascii: buffer of 16 characters to save the word to if it is short ASCII
+ * @n: a pointer to length of word saved to ascii
+ *
+ * return: 1 if saved to ascii, 0 if not, -1 if not an identifier
+ */
+static int do_decode_word(const char * word, size_t length, char * ascii,
+	size_t * n)
+{
+	const unsigned char * p = (const unsigned char *)word;
+	const unsigned char * end = p + length;
+	unsigned long c, low;
+	int saved = 1;
+
+	for (*n = 0; p < end; ++*n) {
+		if (*p == '\\') {
+			c = do_decode_escape(&p);
+			/* a supplementary character is escaped as a pair */
+			if (c >= 0xd800 && c < 0xdc00 && p < end && *p == '\\') {
+				low = do_decode_escape(&p);
+				if (low < 0xdc00 || low >= 0xe000) {
+					return -1;
+				}
+				c = 0x10000 + ((c - 0xd800) << 10) + low - 0xdc00;
+			}
+		} else if (*p < 0x80) {
+			c = *p++;
+		} else {
+			c = do_decode_utf8(&p, end);
+		}
+
+		if (!do_is_identifier(c, *n == 0)) {
+			return -1;
+		}
+		if (c >= 0x80 || *n == 16) {
+			saved = 0;
+		} else if (saved) {
+			ascii[*n] = (char)c;
+		}
+	}
+	return saved;
+}
+
+/*
+ * decode a unicode escape, whose 'u' may be repeated
+ *
+ * @p: a pointer to escape, moved after it
+ *
+ * return: code unit escaped
+ */
+static inline unsigned long do_decode_escape(const unsigned char ** p)
+{
+	const unsigned char * s = *p + 1;
+	unsigned long c = 0;
+	int i;
+
+	while (*s == 'u') {
+		++s;
+	}
+	for (i = 0; i < 4; ++i, ++s) {
+		c = c << 4 | (*s <= '9' ? *s - '0' : (*s | 0x20) - 'a' + 10);
+	}
+	*p = s;
+	return c;
+}
+
+/*
+ * decode a UTF-8 character
+ *
+ * @p: a pointer to character, moved after it if well encoded
+ * @end: end of word
+ *
+ * return: code point, or 0xffffffff if not well encoded, overlong, a
+ *         surrogate or out of Unicode
+ */
+static inline unsigned long do_decode_utf8(const unsigned char ** p,
+	const unsigned char * end)
+{
+	static const unsigned long least[] = { 0, 0x80, 0x800, 0x10000 };
+	const unsigned char * s = *p;
+	unsigned long c = *s++;
+	int n, i;
+
+	if (c >= 0xc0 && c < 0xe0) {
+		n = 1;
+		c &= 0x1f;
+	} else if (c >= 0xe0 && c < 0xf0) {
+		n = 2;
+		c &= 0x0f;
+	} else if (c >= 0xf0 && c < 0xf8) {
+		n = 3;
+		c &= 0x07;
+	} else {
+		return 0xffffffff;
+	}
+	if (end - s < n) {
+		return 0xffffffff;
+	}
+	for (i = 0; i < n; ++i) {
+		if ((s[i] & 0xc0) != 0x80) {
+			return 0xffffffff;
+		}
+		c = c << 6 | (s[i] & 0x3f);
+	}
+	if (c < least[n] || c > 0x10ffff || (c >= 0xd800 && c < 0xe000)) {
+		return 0xffffffff;
+	}
+	*p = s + n;
+	return c;
+}
+
+/*
+ * determine if a character is in Java identifiers, see
+ * Character.isJavaIdentifierStart() and Character.isJavaIdentifierPart()
+ *
+ * @c: code point
+ * @start: nonzero if character begins an identifier
+ *
+ * return: 1 if so, 0 otherwise
+ */
+static inline int do_is_identifier(unsigned long c, int start)
+{
+	if (c < 0x80) {
+		if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') {
+			return 1;
+		}
+		if (c == '$' || c == '_') {
+			return 1;
+		}
+		/* digits and ignorable controls */
+		return !start && ((c >= '0' && c <= '9') || c <= 0x08 ||
+			(c >= 0x0e && c <= 0x1b) || c == 0x7f);
+	}
+	if (c > 0x10ffff || do_in_ranges(non_identifier,
+		sizeof(non_identifier) / sizeof(*non_identifier), c)) {
+		return 0;
+	}
+	return !start || !do_in_ranges(identifier_part,
+		sizeof(identifier_part) / sizeof(*identifier_part), c);
+}
+
+/*
+ * determine if a code point is in one of sorted ranges
+ *
+ * @ranges: sorted ranges, each of the first and the last code points
+ * @count: number of ranges
+ * @c: code point
+ *
+ * return: 1 if so, 0 otherwise
+ */
+static inline int do_in_ranges(const unsigned long (* ranges)[2],
+	size_t count, unsigned long c)
+{
+	size_t low = 0, high = count, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (c < ranges[middle][0]) {
+			high = middle;
+		} else if (c > ranges[middle][1]) {
+			low = middle + 1;
+		} else {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * get the keyword ID of a word
+ *
+ * @word: word to look up, not terminated
+ * @length: length of word
+ *
+ * return: keyword ID, see keyword ID list in lexjava.h, KW_NONE if not a
+ *         keyword or a boolean value
+ */
+int do_keyword(const char * word, size_t length)
+{
+	int i = dfa_keyword(word, length);
+	char ascii[16];
+	size_t n;
+
+	/* a keyword may be spelt in unicode escapes */
+	if (i < 0 && memchr(word, '\\', length) != NULL &&
+		do_decode_word(word, length, ascii, &n) == 1) {
+		i = dfa_keyword(ascii, n);
+	}
+
+	return i < 0 ? KW_NONE : dfa_keywords[i].id;
+}
+
+/*
+ * update word count
+ *
+ * @words: total word count
+ * @words_in_line: current line word count
+ */
+static inline void do_update_word_count(int * words, int * words_in_line)
+{
+	++*words;
+	++*words_in_line;
+}
+
+/*
+ * update and report line count and in-line word count
+ *
+ * @sink: sink to report to
+ * @lines: line count
+ * @words_in_line: current line word count
+ */
+static inline void do_update_line_count(const struct lex_sink * sink,
+	int * lines, int * words_in_line)
+{
+	++*lines;
+	sink->line_count(sink->data, *lines, *words_in_line);
+	*words_in_line = 0;
+}
+
+/*
+ * report total word count to sink
+ *
+ * @sink: sink to report to
+ * @words: total word count
+ */
+static inline void do_output_word_count(const struct lex_sink * sink,
+	int words)
+{
+	sink->word_count(sink->data, words);
+}
+
+/***************************** numeric constants ******************************/
+/*
+ * the value of a numeric constant is worked out from its spelling only when
+ * it is wanted, so the scanner costs nothing more otherwise
+ * digits are accumulated one by one skipping underscores, and a floating
+ * constant is converted exactly by a single multiplication or division when
+ * its digits and its power of ten both fit a double, or by the C library
+ * otherwise
+ */
+
+/* powers of ten a double holds exactly */
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/*
+ * get the value of an integer or floating constant
+ *
+ * @word: spelling of constant, not terminated
+ * @length: length of word
+ * @type: INT or FLOAT
+ * @number: a pointer to store the value
+ *
+ * return: 0 on success, -1 if word is not a valid constant of type, is out
+ *         of range or spelled in LEX_BUF_SIZE bytes or more, in which case
+ *         number has LEX_NUMBER_BAD
+ */
+int do_number(const char * word, size_t length, int type,
+	struct lex_number * number)
+{
+	memset(number, 0, sizeof(struct lex_number));
+	if (type == INT) {
+		do_integer(word, length, number);
+	} else if (type == FLOAT) {
+		number->flags = LEX_NUMBER_FLOAT;
+		do_real(word, length, number);
+	} else {
+		number->flags = LEX_NUMBER_BAD;
+	}
+	return number->flags & LEX_NUMBER_BAD ? -1 : 0;
+}
+
+/*
+ * get the value of an integer constant, in decimal, or in hex, binary or
+ * octal after a prefix '0x', '0b' or '0'
+ *
+ * @word: spelling of constant
+ * @length: length of word
+ * @number: a pointer to store the value
+ */
+static void do_integer(const char * word, size_t length,
+	struct lex_number * number)
+{
+	const char * end = word + length;
+	uint64_t value = 0;
+	int shift = 0, digit, digits = 0, underscore = 0, overflow = 0;
+
+	if (length > 1 && word[0] == '0') {
+		if ((word[1] | 0x20) == 'x') {
+			shift = 4;
+			word += 2;
+		} else if ((word[1] | 0x20) == 'b') {
+			shift = 1;
+			word += 2;
+		} else {
+			/* the leading '0' is an octal digit as well */
+			shift = 3;
+		}
+	}
+
+	for (; word < end; ++word) {
+		/* an underscore is only between digits */
+		if (*word == '_' && digits > 0) {
+			underscore = 1;
+			continue;
+		}
+		digit = do_digit(*word);
+		if (digit >= (shift ? 1 << shift : 10)) {
+			break;
+		}
+		if (shift) {
+			overflow |= value >> (64 - shift) != 0;
+			value = value << shift | digit;
+		} else {
+			overflow |= value > (UINT64_MAX - digit) / 10;
+			value = value * 10 + digit;
+		}
+		++digits;
+		underscore = 0;
+	}
+	if (word < end && !underscore && (*word | 0x20) == 'l') {
+		number->flags |= LEX_NUMBER_LONG;
+		++word;
+	}
+	if (word < end || digits == 0 || underscore || overflow) {
+		number->flags |= LEX_NUMBER_BAD;
+	}
+
+	/* a decimal constant may be 2^31 or 2^63 only to be negated */
+	if (number->flags & LEX_NUMBER_LONG) {
+		if (!shift && value > (uint64_t)1 << 63) {
+			number->flags |= LEX_NUMBER_BAD;
+		}
+		number->integer = (int64_t)value;
+	} else if (!shift) {
+		if (value > (uint64_t)1 << 31) {
+			number->flags |= LEX_NUMBER_BAD;
+		}
+		number->integer = value == (uint64_t)1 << 31 ?
+			(int64_t)value : (int32_t)value;
+	} else {
+		if (value > 0xffffffff) {
+			number->flags |= LEX_NUMBER_BAD;
+		}
+		number->integer = (int32_t)value;
+	}
+}
+
+/*
+ * get the value of a floating constant, which is decimal
+ *
+ * @word: spelling of constant
+ * @length: length of word
+ * @number: a pointer to store the value
+ */
+static void do_real(const char * word, size_t length,
+	struct lex_number * number)
+{
+	char buffer[LEX_BUF_SIZE];
+	const char * p;
+	uint64_t mantissa = 0;
+	int scale = 0, exponent = 0, negative = 0, digits = 0, exact = 1;
+	int nonzero = 0, single;
+	size_t i, n = 0;
+	float real;
+
+	/* copy without underscores and suffix, as the C library wants */
+	if (length >= LEX_BUF_SIZE || length == 0) {
+		number->flags |= LEX_NUMBER_BAD;
+		return;
+	}
+	for (i = 0; i < length; ++i) {
+		if (word[i] != '_') {
+			buffer[n++] = word[i];
+		} else if (i == 0 || i + 1 == length ||
+			(do_digit(word[i - 1]) >= 10 && word[i - 1] != '_') ||
+			(do_digit(word[i + 1]) >= 10 && word[i + 1] != '_')) {
+			number->flags |= LEX_NUMBER_BAD;
+			return;
+		}
+	}
+	buffer[n] = '\0';
+	switch (buffer[n - 1] | 0x20) {
+	case 'f':
+		number->flags |= LEX_NUMBER_SINGLE;
+		/* fall through */
+	case 'd':
+		buffer[--n] = '\0';
+		break;
+	default:
+		/* digits only are of an integer constant */
+		if (strspn(buffer, "0123456789") == n) {
+			number->flags |= LEX_NUMBER_BAD;
+			return;
+		}
+	}
+	single = number->flags & LEX_NUMBER_SINGLE;
+
+	for (p = buffer; *p >= '0' && *p <= '9'; ++p, ++digits) {
+		do_add_digit(&mantissa, *p - '0', &exact, &nonzero);
+	}
+	if (*p == '.') {
+		for (++p; *p >= '0' && *p <= '9'; ++p, ++digits) {
+			do_add_digit(&mantissa, *p - '0', &exact, &nonzero);
+			--scale;
+		}
+	}
+	if (digits == 0) {
+		number->flags |= LEX_NUMBER_BAD;
+		return;
+	}
+	if ((*p | 0x20) == 'e') {
+		if (*++p == '+' || *p == '-') {
+			negative = *p++ == '-';
+		}
+		if (*p < '0' || *p > '9') {
+			number->flags |= LEX_NUMBER_BAD;
+			return;
+		}
+		for (; *p >= '0' && *p <= '9'; ++p) {
+			/* far out of range of any double anyway */
+			if (exponent < 100000) {
+				exponent = exponent * 10 + *p - '0';
+			}
+		}
+	}
+	if (*p != '\0') {
+		number->flags |= LEX_NUMBER_BAD;
+		return;
+	}
+	scale += negative ? -exponent : exponent;
+
+	/* exact operands give a correctly rounded result */
+	if (exact && !single && mantissa <= (uint64_t)1 << 53 &&
+		scale >= -22 && scale <= 22) {
+		number->real = scale < 0 ?
+			(double)mantissa / powers_of_ten[-scale] :
+			(double)mantissa * powers_of_ten[scale];
+	} else if (exact && single && mantissa <= (uint64_t)1 << 24 &&
+		scale >= -10 && scale <= 10) {
+		real = scale < 0 ?
+			(float)mantissa / (float)powers_of_ten[-scale] :
+			(float)mantissa * (float)powers_of_ten[scale];
+		number->real = real;
+	} else if (single) {
+		number->real = strtof(buffer, NULL);
+	} else {
+		number->real = strtod(buffer, NULL);
+	}
+
+	/* too large, or too small not to round to 0 */
+	if (number->real > (single ? FLT_MAX : DBL_MAX) ||
+		(nonzero && number->real == 0)) {
+		number->flags |= LEX_NUMBER_BAD;
+	}
+}
+
+/*
+ * add a decimal digit to a mantissa, unless it no longer fits
+ *
+ * @mantissa: a pointer to mantissa
+ * @digit: digit to add
+ * @exact: a pointer to a flag cleared once a digit does not fit
+ * @nonzero: a pointer to a flag set once a digit is not 0
+ */
+static inline void do_add_digit(uint64_t * mantissa, int digit, int * exact,
+	int * nonzero)
+{
+	if (*mantissa > (UINT64_MAX - digit) / 10) {
+		*exact = 0;
+	} else {
+		*mantissa = *mantissa * 10 + digit;
+	}
+	*nonzero |= digit != 0;
+}
+
+/*
+ * get the value of a digit of any radix up to 36
+ *
+ * @c: character
+ *
+ * return: value of digit, 36 if c is not a digit
+ */
+static inline int do_digit(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') {
+		return (c | 0x20) - 'a' + 10;
+	}
+	return 36;
+}
+
+/******************************** text sink ***********************************/
+/*
+ * the text sink prints everything to a file, one line each, which is the
+ * format of 'scanner_output'
+ */
+
+/*
+ * set up a text sink
+ *
+ * @sink: sink to set up
+ * @out: a FILE pointer of output file
+ */
+void do_text_sink(struct lex_sink * sink, FILE * out)
+{
+	sink->word = do_text_word;
+	sink->wrong_word = do_text_wrong_word;
+	sink->line_count = do_text_line_count;
+	sink->word_count = do_text_word_count;
+	sink->position = NULL;
+	sink->comment = NULL;
+	sink->data = out;
+}
+
+/*
+ * set up a text sink printing position fields, see lexjava.h
+ *
+ * @sink: sink to set up
+ * @text: text sink state
+ * @out: a FILE pointer of output file
+ */
+void do_text_position_sink(struct lex_sink * sink, struct text_sink_t * text,
+	FILE * out)
+{
+	text->out = out;
+	do_set_position(&text->last, 0, 1, 1);
+
+	sink->word = do_text_position_word;
+	sink->wrong_word = do_text_position_wrong_word;
+	sink->line_count = do_text_position_line_count;
+	sink->word_count = do_text_position_word_count;
+	sink->position = do_text_position;
+	sink->comment = NULL;
+	sink->data = text;
+}
+
+/* print a word to output file */
+static void do_text_word(void * data, const char * word, size_t length,
+	int type)
+{
+	fprintf(data, "0x%x\t%.*s\n", type, (int)length, word);
+}
+
+/* print a wrong word with line number to output file */
+static void do_text_wrong_word(void * data, const char * word, size_t length,
+	int lines)
+{
+	fprintf(data, "0x%x\t%.*s at line %d\n", WRONG, (int)length, word,
+		lines);
+}
+
+/* print line count and in-line word count to output file */
+static void do_text_line_count(void * data, int lines, int words_in_line)
+{
+	if (words_in_line < 2) {
+		fprintf(data, "line %d has %d word\n", lines, words_in_line);
+	} else {
+		fprintf(data, "line %d has %d words\n", lines, words_in_line);
+	}
+}
+
+/* print total word count to output file */
+static void do_text_word_count(void * data, int words)
+{
+	fprintf(data, "total %d words\n", words);
+}
+
+static void do_text_position_word(void * data, const char * word,
+	size_t length, int type)
+{
+	struct text_sink_t * text = data;
+
+	fprintf(text->out, "0x%x\t%.*s", type, (int)length, word);
+	do_put_text_position(text->out, &text->last, &text->next);
+}
+
+static void do_text_position_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	struct text_sink_t * text = data;
+
+	fprintf(text->out, "0x%x\t%.*s at line %d", WRONG, (int)length, word,
+		lines);
+	do_put_text_position(text->out, &text->last, &text->next);
+}
+
+static void do_text_position_line_count(void * data, int lines,
+	int words_in_line)
+{
+	do_text_line_count(((struct text_sink_t *)data)->out, lines,
+		words_in_line);
+}
+
+static void do_text_position_word_count(void * data, int words)
+{
+	do_text_word_count(((struct text_sink_t *)data)->out, words);
+}
+
+static void do_text_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	do_set_position(&((struct text_sink_t *)data)->next, offset, line,
+		column);
+}
+
+/*
+ * print the position field of a word and end its record
+ *
+ * @out: a FILE pointer of output file
+ * @last: position of the word before, replaced with next
+ * @next: position of the word
+ */
+static void do_put_text_position(FILE * out, struct lex_position * last,
+	const struct lex_position * next)
+{
+	if (next->line == last->line) {
+		fprintf(out, "\t+%lu\n",
+			(unsigned long)(next->offset - last->offset));
+	} else {
+		fprintf(out, "\t+%lu+%d:%lu\n",
+			(unsigned long)(next->offset - last->offset),
+			next->line - last->line, (unsigned long)next->column);
+	}
+	*last = *next;
+}
+
+/*
+ * set a position
+ *
+ * @position: position to set
+ * @offset: byte offset
+ * @line: line number
+ * @column: column in bytes
+ */
+static inline void do_set_position(struct lex_position * position,
+	size_t offset, int line, size_t column)
+{
+	position->offset = offset;
+	position->line = line;
+	position->column = column;
+}
+
+/******************************* symbol sink **********************************/
+/*
+ * the symbol sink prints the text format with identifiers as symbol IDs, see
+ * lexjava.h
+ * the symbol table is kept across calls, so it can be reused for many files,
+ * while IDs start from 0 in every file
+ */
+
+/*
+ * set up a symbol sink
+ *
+ * @sink: sink to set up
+ * @symbol: symbol sink state, zero-filled or previously used
+ * @out: a FILE pointer of output file
+ * @positions: whether position fields are printed, see lexjava.h
+ */
+void do_symbol_sink(struct lex_sink * sink, struct symbol_sink_t * symbol,
+	FILE * out, int positions)
+{
+	symbol->out = out;
+	symbol->positions = positions;
+	do_set_position(&symbol->last, 0, 1, 1);
+	do_clear_intern(&symbol->symbols);
+
+	sink->word = do_symbol_word;
+	sink->wrong_word = do_symbol_wrong_word;
+	sink->line_count = do_symbol_line_count;
+	sink->word_count = do_symbol_word_count;
+	sink->position = positions ? do_symbol_position : NULL;
+	sink->comment = NULL;
+	sink->data = symbol;
+}
+
+/*
+ * release a symbol sink state
+ *
+ * @symbol: symbol sink state
+ */
+void do_free_symbol_sink(struct symbol_sink_t * symbol)
+{
+	do_free_intern(&symbol->symbols);
+}
+
+/* print a word, with a new identifier defined first */
+static void do_symbol_word(void * data, const char * word, size_t length,
+	int type)
+{
+	struct symbol_sink_t * symbol = data;
+	long id;
+	int added;
+
+	/* an identifier that cannot be interned keeps its spelling */
+	if (type != IDENTIFIER || (id = do_intern(&symbol->symbols, word,
+		length, &added)) < 0) {
+		fprintf(symbol->out, "0x%x\t%.*s", type, (int)length, word);
+		do_end_symbol_record(symbol);
+		return;
+	}
+	if (added) {
+		fprintf(symbol->out, "symbol %ld %.*s\n", id, (int)length,
+			word);
+	}
+	fprintf(symbol->out, "0x%x\t#%ld", type, id);
+	do_end_symbol_record(symbol);
+}
+
+static void do_symbol_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	struct symbol_sink_t * symbol = data;
+
+	fprintf(symbol->out, "0x%x\t%.*s at line %d", WRONG, (int)length,
+		word, lines);
+	do_end_symbol_record(symbol);
+}
+
+static void do_symbol_line_count(void * data, int lines, int words_in_line)
+{
+	do_text_line_count(((struct symbol_sink_t *)data)->out, lines,
+		words_in_line);
+}
+
+static void do_symbol_word_count(void * data, int words)
+{
+	do_text_word_count(((struct symbol_sink_t *)data)->out, words);
+}
+
+static void do_symbol_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	do_set_position(&((struct symbol_sink_t *)data)->next, offset, line,
+		column);
+}
+
+/*
+ * end the record of a word, with its position field if wanted
+ *
+ * @symbol: symbol sink state
+ */
+static inline void do_end_symbol_record(struct symbol_sink_t * symbol)
+{
+	if (symbol->positions) {
+		do_put_text_position(symbol->out, &symbol->last,
+			&symbol->next);
+	} else {
+		putc('\n', symbol->out);
+	}
+}
+
+/******************************* binary sink **********************************/
+/*
+ * the binary sink writes the binary scanner output format, see lexjava.h
+ * the intern table is kept across calls, so it can be reused for many files
+ */
+
+/*
+ * set up a binary sink and write the header
+ *
+ * @sink: sink to set up
+ * @binary: binary sink state, zero-filled or previously used
+ * @out: a FILE pointer of output file
+ * @flags: binary format flags
+ *
+ * return: 0 on success, -1 otherwise
+ */
+int do_binary_sink(struct lex_sink * sink, struct binary_sink_t * binary,
+	FILE * out, int flags)
+{
+	binary->out = out;
+	binary->flags = flags;
+	do_set_position(&binary->last, 0, 1, 1);
+	binary->expected = binary->last;
+	do_clear_intern(&binary->strings);
+
+	sink->word = do_binary_word;
+	sink->wrong_word = do_binary_wrong_word;
+	sink->line_count = do_binary_line_count;
+	sink->word_count = do_binary_word_count;
+	sink->position = flags & LEX_BIN_POSITIONS ? do_binary_position : NULL;
+	sink->comment = NULL;
+	sink->data = binary;
+
+	fwrite(LEX_BIN_MAGIC, 1, 4, out);
+	putc(LEX_BIN_VERSION, out);
+	putc(flags, out);
+	return ferror(out) ? -1 : 0;
+}
+
+/*
+ * release a binary sink state
+ *
+ * @binary: binary sink state
+ */
+void do_free_binary_sink(struct binary_sink_t * binary)
+{
+	do_free_intern(&binary->strings);
+}
+
+/* write a word, interning keywords, identifiers and booleans */
+static void do_binary_word(void * data, const char * word, size_t length,
+	int type)
+{
+	struct binary_sink_t * binary = data;
+	long index;
+	int added;
+
+	do_put_kind(binary, type);
+	if (type == KEYWORD || type == IDENTIFIER || type == BOOLEAN) {
+		index = do_intern(&binary->strings, word, length, &added);
+		if (index >= 0 && !added) {
+			do_put_varint(binary->out, index + 1);
+			do_put_binary_position(binary, word, length, type);
+			return;
+		}
+		/* a new string, or one that cannot be interned */
+		putc(0, binary->out);
+	}
+	do_put_string(binary->out, word, length);
+	if ((binary->flags & LEX_BIN_VALUES) && (type == INT || type == FLOAT)) {
+		do_put_number(binary->out, word, length, type);
+	}
+	do_put_binary_position(binary, word, length, type);
+}
+
+/* write a wrong word with line number */
+static void do_binary_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	struct binary_sink_t * binary = data;
+
+	do_put_kind(binary, WRONG);
+	do_put_string(binary->out, word, length);
+	do_put_varint(binary->out, lines);
+	do_put_binary_position(binary, word, length, WRONG);
+}
+
+/* write in-line word count if line records are wanted */
+static void do_binary_line_count(void * data, int lines, int words_in_line)
+{
+	struct binary_sink_t * binary = data;
+
+	if (binary->flags & LEX_BIN_LINES) {
+		putc(LEX_BIN_LINE, binary->out);
+		do_put_varint(binary->out, words_in_line);
+	}
+}
+
+/* write total word count */
+static void do_binary_word_count(void * data, int words)
+{
+	struct binary_sink_t * binary = data;
+
+	putc(LEX_BIN_TOTAL, binary->out);
+	do_put_varint(binary->out, words);
+}
+
+static void do_binary_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	do_set_position(&((struct binary_sink_t *)data)->next, offset, line,
+		column);
+}
+
+/*
+ * write the kind of a word, with LEX_BIN_EXPECTED if it is at its expected
+ * position
+ *
+ * @binary: binary sink state
+ * @type: word type
+ */
+static inline void do_put_kind(struct binary_sink_t * binary, int type)
+{
+	if ((binary->flags & LEX_BIN_POSITIONS) && do_is_expected(binary)) {
+		putc((type - 0x100) | LEX_BIN_EXPECTED, binary->out);
+	} else {
+		putc(type - 0x100, binary->out);
+	}
+}
+
+/*
+ * write the value of an integer or floating constant
+ *
+ * @out: a FILE pointer of output file
+ * @word: spelling of constant
+ * @length: length of spelling
+ * @type: INT or FLOAT
+ */
+static inline void do_put_number(FILE * out, const char * word,
+	size_t length, int type)
+{
+	struct lex_number number;
+	uint64_t bits;
+
+	do_number(word, length, type, &number);
+	do_put_varint(out, number.flags);
+	if (number.flags & LEX_NUMBER_FLOAT) {
+		memcpy(&bits, &number.real, sizeof(bits));
+		do_put_fixed(out, (unsigned long)(bits & 0xffffffff), 4);
+		do_put_fixed(out, (unsigned long)(bits >> 32), 4);
+	} else {
+		/* zigzag, so that small negative values are short as well */
+		bits = (uint64_t)number.integer << 1;
+		do_put_varint(out, number.integer < 0 ? ~bits : bits);
+	}
+}
+
+/*
+ * check if the word to write is at its expected position
+ *
+ * @binary: binary sink state
+ *
+ * return: 1 if so, 0 otherwise
+ */
+static inline int do_is_expected(const struct binary_sink_t * binary)
+{
+	return binary->next.offset == binary->expected.offset &&
+		binary->next.line == binary->expected.line &&
+		binary->next.column == binary->expected.column;
+}
+
+/*
+ * write the position field of a word if wanted and not expected, and expect
+ * the next word where it ends
+ *
+ * @binary: binary sink state
+ * @word: spelling of word
+ * @length: length of spelling
+ * @type: word type
+ */
+static void do_put_binary_position(struct binary_sink_t * binary,
+	const char * word, size_t length, int type)
+{
+	const struct lex_position * next = &binary->next;
+	struct lex_position * expected = &binary->expected;
+	size_t i, bytes = length;
+
+	if (!(binary->flags & LEX_BIN_POSITIONS)) {
+		return;
+	}
+	if (!do_is_expected(binary)) {
+		if (next->line == binary->last.line) {
+			do_put_varint(binary->out,
+				(next->offset - binary->last.offset) << 1);
+		} else {
+			do_put_varint(binary->out,
+				(next->offset - binary->last.offset) << 1 | 1);
+			do_put_varint(binary->out,
+				next->line - binary->last.line);
+			do_put_varint(binary->out, next->column);
+		}
+	}
+	binary->last = *next;
+
+	/* escaped spaces and '?:' are spelled longer than they are */
+	if (type == SPACE) {
+		for (i = 0; i < length; ++i) {
+			bytes -= word[i] == '\\';
+		}
+	} else if (type == CONDITION) {
+		bytes = 1;
+	}
+	if (type == SPACE && word[length - 1] == 'n') {
+		do_set_position(expected, next->offset + bytes, next->line + 1,
+			1);
+	} else {
+		do_set_position(expected, next->offset + bytes, next->line,
+			next->column + bytes);
+	}
+}
+
+/*
+ * write an unsigned LEB128 varint
+ *
+ * @out: a FILE pointer of output file
+ * @value: value to write
+ */
+static inline void do_put_varint(FILE * out, uint64_t value)
+{
+	while (value >= 0x80) {
+		putc((int)(value & 0x7f) | 0x80, out);
+		value >>= 7;
+	}
+	putc((int)value, out);
+}
+
+/*
+ * write a fixed size unsigned integer in little endian
+ *
+ * @out: a FILE pointer of output file
+ * @value: value to write
+ * @size: number of bytes to write
+ */
+static inline void do_put_fixed(FILE * out, unsigned long value, int size)
+{
+	int i;
+
+	for (i = 0; i < size; ++i) {
+		putc((int)(value & 0xff), out);
+		/* in 2 steps, as value may be narrower than 8 bytes */
+		value = value >> 4 >> 4;
+	}
+}
+
+/*
+ * write a string as varint length and bytes
+ *
+ * @out: a FILE pointer of output file
+ * @string: string to write
+ * @length: length of string
+ */
+static inline void do_put_string(FILE * out, const char * string,
+	size_t length)
+{
+	do_put_varint(out, length);
+	fwrite(string, 1, length, out);
+}
+
+/***************************** line index sink ********************************/
+/*
+ * the line index sink keeps lines out of another sink, and writes them to a
+ * line index instead, see lexjava.h
+ * a line is reported at its end, so its record has the offset where the
+ * output was at the end of the line before
+ */
+
+/*
+ * set up a line index sink and write the header
+ *
+ * @sink: sink to set up
+ * @index: line index sink state
+ * @inner: sink to pass words and the total word count to
+ * @out: a FILE pointer of output file of inner
+ * @fp: a FILE pointer of line index file
+ *
+ * return: 0 on success, -1 otherwise
+ */
+int do_index_sink(struct lex_sink * sink, struct index_sink_t * index,
+	const struct lex_sink * inner, FILE * out, FILE * fp)
+{
+	index->sink = inner;
+	index->out = out;
+	index->index = fp;
+	/* a seek lets stdio keep the offset, so telling it needs no syscall */
+	fseek(out, 0, SEEK_CUR);
+	index->start = ftell(out);
+
+	sink->word = do_index_word;
+	sink->wrong_word = do_index_wrong_word;
+	sink->line_count = do_index_line_count;
+	sink->word_count = do_index_word_count;
+	sink->position = inner->position != NULL ? do_index_position : NULL;
+	sink->comment = inner->comment != NULL ? do_index_comment : NULL;
+	sink->data = index;
+
+	fwrite(LEX_INDEX_MAGIC, 1, 4, fp);
+	putc(LEX_INDEX_VERSION, fp);
+	do_put_fixed(fp, 0, 3);
+	return ferror(fp) ? -1 : 0;
+}
+
+static void do_index_word(void * data, const char * word, size_t length,
+	int type)
+{
+	const struct lex_sink * sink = ((struct index_sink_t *)data)->sink;
+
+	sink->word(sink->data, word, length, type);
+}
+
+static void do_index_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	const struct lex_sink * sink = ((struct index_sink_t *)data)->sink;
+
+	sink->wrong_word(sink->data, word, length, lines);
+}
+
+/* write offset and in-line word count of a line */
+static void do_index_line_count(void * data, int lines, int words_in_line)
+{
+	struct index_sink_t * index = data;
+
+	if (index->start < 0) {
+		do_put_fixed(index->index, 0xffffffff, 4);
+		do_put_fixed(index->index, 0xffffffff, 4);
+	} else {
+		do_put_fixed(index->index, (unsigned long)index->start, 8);
+	}
+	do_put_fixed(index->index, (unsigned long)words_in_line, 4);
+	index->start = ftell(index->out);
+}
+
+static void do_index_word_count(void * data, int words)
+{
+	const struct lex_sink * sink = ((struct index_sink_t *)data)->sink;
+
+	sink->word_count(sink->data, words);
+}
+
+static void do_index_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	const struct lex_sink * sink = ((struct index_sink_t *)data)->sink;
+
+	sink->position(sink->data, offset, line, column);
+}
+
+static void do_index_comment(void * data, size_t offset, size_t length,
+	int kind)
+{
+	const struct lex_sink * sink = ((struct index_sink_t *)data)->sink;
+
+	sink->comment(sink->data, offset, length, kind);
+}
+
+/******************************** space sink **********************************/
+/*
+ * the space sink keeps spaces out of another sink, or all but a word for each
+ * run of them, which is spelled as its spaces are, so a run of a single space
+ * is passed on as it is
+ * a run is passed on when anything else is met, comments included, and a
+ * newline is the last space of a run, so it is passed on before the line
+ * a position is held until its word is passed on, and a run is where its
+ * first space is
+ */
+
+/*
+ * set up a space sink
+ *
+ * @sink: sink to set up
+ * @space: space sink state
+ * @inner: sink to pass words and counts to
+ * @mode: space sink mode
+ */
+void do_space_sink(struct lex_sink * sink, struct space_sink_t * space,
+	const struct lex_sink * inner, int mode)
+{
+	space->sink = inner;
+	space->mode = mode;
+	space->length = 0;
+	space->words = 0;
+	space->words_in_line = 0;
+
+	sink->word = do_space_word;
+	sink->wrong_word = do_space_wrong_word;
+	sink->line_count = do_space_line_count;
+	sink->word_count = do_space_word_count;
+	sink->position = inner->position != NULL ? do_space_position : NULL;
+	/* comments end runs, so they are wanted for runs */
+	sink->comment = inner->comment != NULL || mode == LEX_SPACE_RUN ?
+		do_space_comment : NULL;
+	sink->data = space;
+}
+
+/* drop a space or add it to current run, and pass other words on */
+static void do_space_word(void * data, const char * word, size_t length,
+	int type)
+{
+	struct space_sink_t * space = data;
+
+	if (type != SPACE) {
+		do_flush_space(space);
+		do_pass_position(space, &space->next);
+		space->sink->word(space->sink->data, word, length, type);
+		return;
+	}
+	if (space->mode == LEX_SPACE_RUN) {
+		if (space->length + length > LEX_SPACE_RUN_SIZE) {
+			do_flush_space(space);
+		}
+		if (space->length == 0) {
+			space->start = space->next;
+		}
+		memcpy(space->run + space->length, word, length);
+		space->length += length;
+		/* only the first space of a run is counted */
+		if (space->length == length) {
+			return;
+		}
+	}
+	++space->words;
+	++space->words_in_line;
+}
+
+static void do_space_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	struct space_sink_t * space = data;
+
+	do_flush_space(space);
+	do_pass_position(space, &space->next);
+	space->sink->wrong_word(space->sink->data, word, length, lines);
+}
+
+/* pass in-line word count on without spaces not passed on */
+static void do_space_line_count(void * data, int lines, int words_in_line)
+{
+	struct space_sink_t * space = data;
+
+	do_flush_space(space);
+	space->sink->line_count(space->sink->data, lines,
+		words_in_line - space->words_in_line);
+	space->words_in_line = 0;
+}
+
+/* pass total word count on without spaces not passed on */
+static void do_space_word_count(void * data, int words)
+{
+	struct space_sink_t * space = data;
+
+	do_flush_space(space);
+	space->sink->word_count(space->sink->data, words - space->words);
+}
+
+static void do_space_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	do_set_position(&((struct space_sink_t *)data)->next, offset, line,
+		column);
+}
+
+/* end current run, and pass the comment on if wanted */
+static void do_space_comment(void * data, size_t offset, size_t length,
+	int kind)
+{
+	struct space_sink_t * space = data;
+
+	do_flush_space(space);
+	if (space->sink->comment != NULL) {
+		space->sink->comment(space->sink->data, offset, length, kind);
+	}
+}
+
+/*
+ * pass a position on if the sink passed to wants positions
+ *
+ * @space: space sink state
+ * @position: position to pass on
+ */
+static inline void do_pass_position(struct space_sink_t * space,
+	const struct lex_position * position)
+{
+	if (space->sink->position != NULL) {
+		space->sink->position(space->sink->data, position->offset,
+			position->line, position->column);
+	}
+}
+
+/*
+ * pass current run of spaces on as a word, if any
+ *
+ * @space: space sink state
+ */
+static inline void do_flush_space(struct space_sink_t * space)
+{
+	if (space->length != 0) {
+		do_pass_position(space, &space->start);
+		space->sink->word(space->sink->data, space->run,
+			space->length, SPACE);
+		space->length = 0;
+	}
+}
+
+/**************************** comment index sink ******************************/
+/*
+ * the comment index sink passes everything on to another sink, and writes
+ * the comments it is told of to a comment index, see lexjava.h
+ */
+
+/*
+ * set up a comment index sink and write the header
+ *
+ * @sink: sink to set up
+ * @comment: comment index sink state
+ * @inner: sink to pass words and counts to
+ * @fp: a FILE pointer of comment index file
+ *
+ * return: 0 on success, -1 otherwise
+ */
+int do_comment_sink(struct lex_sink * sink, struct comment_sink_t * comment,
+	const struct lex_sink * inner, FILE * fp)
+{
+	comment->sink = inner;
+	comment->index = fp;
+
+	sink->word = do_comment_word;
+	sink->wrong_word = do_comment_wrong_word;
+	sink->line_count = do_comment_line_count;
+	sink->word_count = do_comment_word_count;
+	sink->position = inner->position != NULL ? do_comment_position : NULL;
+	sink->comment = do_comment_comment;
+	sink->data = comment;
+
+	fwrite(LEX_COMMENT_MAGIC, 1, 4, fp);
+	putc(LEX_COMMENT_VERSION, fp);
+	do_put_fixed(fp, 0, 3);
+	return ferror(fp) ? -1 : 0;
+}
+
+static void do_comment_word(void * data, const char * word, size_t length,
+	int type)
+{
+	const struct lex_sink * sink = ((struct comment_sink_t *)data)->sink;
+
+	sink->word(sink->data, word, length, type);
+}
+
+static void do_comment_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	const struct lex_sink * sink = ((struct comment_sink_t *)data)->sink;
+
+	sink->wrong_word(sink->data, word, length, lines);
+}
+
+static void do_comment_line_count(void * data, int lines,
+	int words_in_line)
+{
+	const struct lex_sink * sink = ((struct comment_sink_t *)data)->sink;
+
+	sink->line_count(sink->data, lines, words_in_line);
+}
+
+static void do_comment_word_count(void * data, int words)
+{
+	const struct lex_sink * sink = ((struct comment_sink_t *)data)->sink;
+
+	sink->word_count(sink->data, words);
+}
+
+static void do_comment_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	const struct lex_sink * sink = ((struct comment_sink_t *)data)->sink;
+
+	sink->position(sink->data, offset, line, column);
+}
+
+/* write offset, length and kind of a comment */
+static void do_comment_comment(void * data, size_t offset, size_t length,
+	int kind)
+{
+	struct comment_sink_t * comment = data;
+
+	do_put_fixed(comment->index, (unsigned long)offset, 8);
+	do_put_fixed(comment->index, length > 0xffffffff ? 0xffffffff :
+		(unsigned long)length, 4);
+	putc(kind, comment->index);
+}
+
+/******************************** statistics **********************************/
+/*
+ * statistics are taken by a sink that only counts, so nothing is formatted
+ * or written, while line lengths and comments are measured on the input
+ */
+
+/*
+ * do lexical analysis for statistics only
+ *
+ * @src: a FILE pointer of Java source file
+ * @stats: statistics to fill
+ * @in: input source buffer, reused across calls
+ */
+void do_lex_stats(FILE * src, struct lex_stats * stats, struct input_t * in)
+{
+	struct lex_sink sink;
+	struct scan_t scan;
+	const char * buffer;
+	size_t nread, keep = 0, column = 0, length;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->files = 1;
+	sink.word = do_stats_word;
+	sink.wrong_word = do_stats_wrong_word;
+	sink.line_count = do_stats_line_count;
+	sink.word_count = do_stats_word_count;
+	sink.position = NULL;
+	sink.comment = NULL;
+	sink.data = stats;
+
+	do_init_scan(&scan, &sink);
+	do_open_input(in, src);
+	while ((buffer = do_read(in, keep, &nread)) != NULL) {
+		scan.start = 0;
+		do_scan_buffer(&scan, buffer, keep, nread);
+
+		/* the newline added to the last buffer is not in the source */
+		length = nread - keep - (in->end ? 1 : 0);
+		do_count_lines(stats, buffer + keep, length, &column);
+		stats->bytes += length;
+
+		/* a comment not ended is counted so far, as it is not kept */
+		if (dfa_idle[scan.state] && scan.state != DFA_STATE_START) {
+			scan.comment += nread - scan.start - (in->end ? 1 : 0);
+		}
+		keep = dfa_idle[scan.state] ? 0 : nread - scan.start;
+	}
+	if (column != 0) {
+		do_add_histogram(stats->line_lengths, column);
+		++stats->lines;
+	}
+	stats->comment_bytes = scan.comment;
+	do_output_word_count(&sink, scan.words);
+	do_close_input(in);
+}
+
+/*
+ * add up statistics
+ *
+ * @total: statistics to add to
+ * @stats: statistics to add
+ */
+void do_add_stats(struct lex_stats * total, const struct lex_stats * stats)
+{
+	int i;
+
+	total->files += stats->files;
+	total->bytes += stats->bytes;
+	total->lines += stats->lines;
+	total->words += stats->words;
+	total->comment_bytes += stats->comment_bytes;
+	for (i = 0; i < LEX_STATS_KINDS; ++i) {
+		total->kinds[i] += stats->kinds[i];
+	}
+	for (i = 0; i < LEX_STATS_BUCKETS; ++i) {
+		total->line_lengths[i] += stats->line_lengths[i];
+		total->identifier_lengths[i] += stats->identifier_lengths[i];
+	}
+}
+
+/*
+ * count the lengths of lines ended in a piece of source
+ *
+ * @stats: statistics
+ * @text: piece of source
+ * @length: length of text
+ * @column: a pointer to length of the line not ended before text, updated
+ *          for the line not ended in text
+ */
+static void do_count_lines(struct lex_stats * stats, const char * text,
+	size_t length, size_t * column)
+{
+	const char * end = text + length, * p;
+
+	while ((p = memchr(text, '\n', end - text)) != NULL) {
+		do_add_histogram(stats->line_lengths, *column + (p - text));
+		++stats->lines;
+		*column = 0;
+		text = p + 1;
+	}
+	*column += end - text;
+}
+
+/*
+ * count a value in a histogram
+ *
+ * @histogram: histogram of LEX_STATS_BUCKETS buckets
+ * @value: value to count
+ */
+static inline void do_add_histogram(unsigned long * histogram, size_t value)
+{
+	++histogram[value < LEX_STATS_BUCKETS - 1 ? value :
+		LEX_STATS_BUCKETS - 1];
+}
+
+static void do_stats_word(void * data, const char * word, size_t length,
+	int type)
+{
+	struct lex_stats * stats = data;
+
+	++stats->kinds[type - 0x100];
+	if (type == IDENTIFIER) {
+		do_add_histogram(stats->identifier_lengths, length);
+	}
+}
+
+static void do_stats_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	++((struct lex_stats *)data)->kinds[WRONG - 0x100];
+}
+
+static void do_stats_line_count(void * data, int lines, int words_in_line)
+{
+}
+
+static void do_stats_word_count(void * data, int words)
+{
+	((struct lex_stats *)data)->words = words;
+}
+
+/******************************* intern table *********************************/
+
+/*
+ * intern a string
+ *
+ * @table: intern table
+ * @string: string to intern, not necessarily terminated
+ * @length: length of string
+ * @added: a pointer to store whether the string is newly added
+ *
+ * return: index of the string on success, -1 if out of memory
+ */
+long do_intern(struct intern_t * table, const char * string, size_t length,
+	int * added)
+{
+	unsigned int hash = do_hash(string, length);
+	struct intern_entry_t * entry, * entries;
+	size_t i, mask, size;
+	void * p;
+
+	/* keep the load factor below 1/2 */
+	if ((table->count + 1) << 1 > table->capacity) {
+		size = table->capacity ? table->capacity << 1 : 1024;
+		if ((entries = calloc(size, sizeof(*entries))) == NULL) {
+			return -1;
+		}
+		for (i = 0; i < table->capacity; ++i) {
+			entry = &table->entries[i];
+			if (entry->offset != 0) {
+				mask = entry->hash & (size - 1);
+				while (entries[mask].offset != 0) {
+					mask = (mask + 1) & (size - 1);
+				}
+				entries[mask] = *entry;
+			}
+		}
+		free(table->entries);
+		table->entries = entries;
+		table->capacity = size;
+	}
+
+	mask = table->capacity - 1;
+	for (i = hash & mask; table->entries[i].offset != 0;
+		i = (i + 1) & mask) {
+		entry = &table->entries[i];
+		if (entry->hash == hash && entry->length == length &&
+			memcmp(table->pool + entry->offset, string,
+			length) == 0) {
+			*added = 0;
+			return entry->index;
+		}
+	}
+
+	/* copy the string into pool, terminated */
+	if (table->length + length + 1 > table->size) {
+		size = table->size ? table->size : BUF_SIZE;
+		while (table->length + length + 1 > size) {
+			size <<= 1;
+		}
+		if ((p = realloc(table->pool, size)) == NULL) {
+			return -1;
+		}
+		table->pool = p;
+		table->size = size;
+	}
+	if (table->length == 0) {
+		/* offset 0 marks an unused entry */
+		table->length = 1;
+	}
+
+	entry = &table->entries[i];
+	entry->offset = table->length;
+	entry->length = length;
+	entry->hash = hash;
+	entry->index = table->count++;
+	memcpy(table->pool + table->length, string, length);
+	table->pool[table->length + length] = '\0';
+	table->length += length + 1;
+
+	*added = 1;
+	return entry->index;
+}
+
+/*
+ * empty an intern table, keeping its memory
+ *
+ * @table: intern table
+ */
+void do_clear_intern(struct intern_t * table)
+{
+	if (table->entries != NULL) {
+		memset(table->entries, 0, table->capacity *
+			sizeof(*table->entries));
+	}
+	table->count = 0;
+	table->length = 0;
+}
+
+/*
+ * release an intern table
+ *
+ * @table: intern table
+ */
+void do_free_intern(struct intern_t * table)
+{
+	free(table->entries);
+	free(table->pool);
+	memset(table, 0, sizeof(*table));
+}
+
+/*
+ * FNV-1a hash of a string
+ *
+ * @string: string to hash
+ * @length: length of string
+ *
+ * return: hash value
+ */
+static inline unsigned int do_hash(const char * string, size_t length)
+{
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; ++i) {
+		hash ^= (unsigned char)string[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/******************************* parallel scan ********************************/
+
+/*
+ * a chunk is scanned ahead from the initial state with a '?' assumed met,
+ * which is true for every chunk but the first one of most sources, and what
+ * it reports is recorded as events, with a mark at each position where it is
+ * in the initial state again
+ *
+ * the thread merging chunks in order knows the true state at the beginning of
+ * a chunk, and when it is the initial state, the events of the chunk are
+ * replayed to the real sink as they are
+ * otherwise, the chunk is scanned again with the true state into the real
+ * sink, until the scanner is in the initial state at a mark, which is almost
+ * always soon after the beginning, and the events after the mark are
+ * replayed instead
+ * either way, the condition flag must agree, or the chunk must have no '?'
+ * or ':' left after the mark, and counts are recomputed while replaying
+ */
+
+/*
+ * add a mark to a chunk, or check if a scan can sync with a chunk
+ *
+ * @scan: scanner state, whose data is the chunk being scanned
+ * @i: position where the scanner is in the initial state
+ * @condition_flag: condition flag at i
+ *
+ * return: 1 if a scan syncing with the chunk should stop, 0 otherwise
+ */
+static int do_mark(struct scan_t * scan, size_t i, int condition_flag)
+{
+	struct chunk_t * chunk = scan->data;
+	struct mark_t * marks;
+	size_t capacity;
+
+	if (chunk->syncing) {
+		while (chunk->cursor < chunk->mark_count &&
+			chunk->marks[chunk->cursor].pos < i) {
+			++chunk->cursor;
+		}
+		if (chunk->cursor < chunk->mark_count &&
+			chunk->marks[chunk->cursor].pos == i &&
+			do_can_sync(chunk, i, condition_flag)) {
+			chunk->synced = chunk->cursor;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (chunk->failed) {
+		return 0;
+	}
+	if (chunk->mark_count == chunk->mark_capacity) {
+		capacity = chunk->mark_capacity ?
+			chunk->mark_capacity << 1 : 256;
+		if ((marks = realloc(chunk->marks,
+			capacity * sizeof(*marks))) == NULL) {
+			chunk->failed = 1;
+			return 0;
+		}
+		chunk->marks = marks;
+		chunk->mark_capacity = capacity;
+	}
+	chunk->marks[chunk->mark_count].pos = i;
+	chunk->marks[chunk->mark_count].event = chunk->count;
+	++chunk->mark_count;
+	return 0;
+}
+
+/*
+ * check if the events of a chunk after a mark are what a scan in the initial
+ * state there would report
+ *
+ * @chunk: chunk scanned
+ * @i: position of the mark
+ * @condition_flag: condition flag of the scan at i
+ *
+ * return: 1 if so, 0 otherwise
+ */
+static inline int do_can_sync(const struct chunk_t * chunk, size_t i,
+	int condition_flag)
+{
+	/* the flag is sticky, so it is only known at the beginning if unset */
+	if (condition_flag == chunk->flag &&
+		(chunk->flag || i == chunk->begin)) {
+		return 1;
+	}
+	return chunk->flag_pos <= i;
+}
+
+/*
+ * record an event of a chunk
+ *
+ * @chunk: chunk being scanned
+ * @word: word of the event, or NULL for a line or a comment
+ * @length: length of word or comment
+ * @type: event type, see struct event_t
+ * @pos: where the word or comment starts, or where the next line starts for
+ *       a line
+ */
+static void do_add_event(struct chunk_t * chunk, const char * word,
+	size_t length, int type, size_t pos)
+{
+	struct event_t * events;
+	size_t capacity;
+
+	if (chunk->failed) {
+		return;
+	}
+	if (chunk->count == chunk->capacity) {
+		capacity = chunk->capacity ? chunk->capacity << 1 : 1024;
+		if ((events = realloc(chunk->events,
+			capacity * sizeof(*events))) == NULL) {
+			chunk->failed = 1;
+			return;
+		}
+		chunk->events = events;
+		chunk->capacity = capacity;
+	}
+	chunk->events[chunk->count].word = word;
+	chunk->events[chunk->count].length = length;
+	chunk->events[chunk->count].type = type;
+	chunk->events[chunk->count].pos = pos;
+	++chunk->count;
+}
+
+static void do_chunk_word(void * data, const char * word, size_t length,
+	int type)
+{
+	struct chunk_t * chunk = data;
+
+	do_add_event(chunk, word, length, type, chunk->pos);
+}
+
+static void do_chunk_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	struct chunk_t * chunk = data;
+
+	do_add_event(chunk, word, length, WRONG, chunk->pos);
+}
+
+static void do_chunk_line_count(void * data, int lines, int words_in_line)
+{
+	struct chunk_t * chunk = data;
+
+	do_add_event(chunk, NULL, 0, 0, chunk->scan->line_start);
+}
+
+static void do_chunk_word_count(void * data, int words)
+{
+}
+
+static void do_chunk_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	((struct chunk_t *)data)->pos = offset;
+}
+
+static void do_chunk_comment(void * data, size_t offset, size_t length,
+	int kind)
+{
+	do_add_event(data, NULL, length, -kind, offset);
+}
+
+/*
+ * merge a chunk scanned ahead into a scan reaching its beginning
+ *
+ * @scan: scanner state at the beginning of chunk
+ * @chunk: chunk scanned ahead
+ * @map: mapped file
+ */
+static void do_merge_chunk(struct scan_t * scan, struct chunk_t * chunk,
+	const char * map)
+{
+	size_t mark = 0;
+
+	chunk->syncing = 1;
+	chunk->cursor = 0;
+	if (chunk->failed || scan->state != DFA_STATE_START ||
+		!do_can_sync(chunk, chunk->begin, scan->condition_flag)) {
+		/* scan again until syncing at a mark */
+		scan->mark = chunk->failed ? NULL : do_mark;
+		scan->data = chunk;
+		chunk->synced = chunk->mark_count;
+		do_scan_buffer(scan, map, chunk->begin, chunk->end);
+		scan->mark = NULL;
+		if (chunk->synced == chunk->mark_count) {
+			return;
+		}
+		mark = chunk->synced;
+	}
+
+	do_replay(scan, chunk, chunk->marks[mark].event);
+	/* the flag of the chunk is taken unless it is left as it is */
+	if (chunk->flag_pos > chunk->marks[mark].pos) {
+		scan->condition_flag = chunk->exit_flag;
+	}
+	scan->state = chunk->state;
+	scan->start = chunk->start;
+}
+
+/*
+ * report the events of a chunk to the real sink, counting words and lines
+ *
+ * @scan: scanner state
+ * @chunk: chunk scanned ahead
+ * @from: index of the first event to report
+ */
+static void do_replay(struct scan_t * scan, const struct chunk_t * chunk,
+	size_t from)
+{
+	const struct event_t * event = chunk->events + from;
+	const struct event_t * end = chunk->events + chunk->count;
+
+	for (; event < end; ++event) {
+		if (event->type < 0) {
+			scan->sink->comment(scan->sink->data, event->pos,
+				event->length, -event->type);
+			continue;
+		}
+		if (event->type == 0) {
+			scan->line_start = event->pos;
+			do_update_line_count(scan->sink, &scan->lines,
+				&scan->words_in_line);
+			continue;
+		}
+		if (scan->sink->position != NULL) {
+			do_output_position(scan, event->pos);
+		}
+		if (event->type == WRONG) {
+			do_output_wrong_word(scan->sink, event->word,
+				event->length, scan->lines + 1);
+		} else {
+			do_output_word(scan->sink, event->word, event->length,
+				event->type);
+		}
+		do_update_word_count(&scan->words, &scan->words_in_line);
+	}
+}
+
+#ifdef USE_THREADS
+/*
+ * thread scanning chunks ahead, no more than a window of chunks ahead of the
+ * one being merged
+ *
+ * @arg: parallel scan
+ *
+ * return: NULL
+ */
+static void * do_scan_chunks(void * arg)
+{
+	struct parallel_t * parallel = arg;
+	size_t k;
+
+	for (;;) {
+		pthread_mutex_lock(&parallel->lock);
+		while (parallel->next < parallel->count &&
+			parallel->next >= parallel->merged + parallel->window) {
+			pthread_cond_wait(&parallel->cond, &parallel->lock);
+		}
+		if (parallel->next >= parallel->count) {
+			pthread_mutex_unlock(&parallel->lock);
+			break;
+		}
+		k = parallel->next++;
+		pthread_mutex_unlock(&parallel->lock);
+
+		do_scan_chunk(parallel, k);
+
+		pthread_mutex_lock(&parallel->lock);
+		parallel->slots[k % parallel->window].ready = 1;
+		pthread_cond_broadcast(&parallel->cond);
+		pthread_mutex_unlock(&parallel->lock);
+	}
+	return NULL;
+}
+
+/*
+ * scan a chunk ahead from the initial state, recording its events and marks
+ *
+ * @parallel: parallel scan
+ * @k: index of chunk
+ */
+static void do_scan_chunk(struct parallel_t * parallel, size_t k)
+{
+	struct chunk_t * chunk = &parallel->slots[k % parallel->window];
+	struct lex_sink sink;
+	struct scan_t scan;
+
+	chunk->begin = k * CHUNK_SIZE;
+	chunk->end = chunk->begin + CHUNK_SIZE;
+	if (chunk->end > parallel->size) {
+		chunk->end = parallel->size;
+	}
+	chunk->flag = k != 0;
+	chunk->count = 0;
+	chunk->mark_count = 0;
+	chunk->failed = 0;
+	chunk->syncing = 0;
+	chunk->pos = 0;
+
+	sink.word = do_chunk_word;
+	sink.wrong_word = do_chunk_wrong_word;
+	sink.line_count = do_chunk_line_count;
+	sink.word_count = do_chunk_word_count;
+	sink.position = parallel->positions ? do_chunk_position : NULL;
+	sink.comment = parallel->comments ? do_chunk_comment : NULL;
+	sink.data = chunk;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.sink = &sink;
+	scan.run = parallel->run;
+	scan.state = DFA_STATE_START;
+	scan.start = chunk->begin;
+	scan.condition_flag = chunk->flag;
+	scan.mark = do_mark;
+	scan.data = chunk;
+	chunk->scan = &scan;
+
+	do_mark(&scan, chunk->begin, chunk->flag);
+	do_scan_buffer(&scan, parallel->map, chunk->begin, chunk->end);
+	chunk->flag_pos = scan.flag_pos;
+	chunk->state = scan.state;
+	chunk->start = scan.start;
+	chunk->exit_flag = scan.condition_flag;
+}
+#endif /* USE_THREADS */
+
+/***************************** incremental scan *******************************/
+
+/*
+ * a document keeps a checkpoint on each line, at the first position where the
+ * scanner is in the initial state, which is right after a newline, or after
+ * the comment a newline is in
+ * what is scanned before a checkpoint never looks at the text after it, so an
+ * edit is scanned again from the last checkpoint not after it, and once the
+ * scanner passes the edit and meets an old checkpoint at the same place of
+ * the old text with the same condition flag, the rest is the same as before
+ * but for counts and offsets, which are kept by checkpoints
+ */
+
+/*
+ * open a document, scanning it as a whole
+ *
+ * @doc: document, zeroed or used before
+ * @text: source text
+ * @size: size of text
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+int do_open_doc(struct doc_t * doc, const char * text, size_t size)
+{
+	if (do_grow((void **)&doc->text, &doc->capacity, sizeof(char),
+		size + 1) != 0 ||
+		do_grow((void **)&doc->checkpoints, &doc->checkpoint_capacity,
+		sizeof(struct checkpoint_t), 1) != 0) {
+		return -1;
+	}
+	memcpy(doc->text, text, size);
+	doc->text[size] = '\n';
+	doc->size = size;
+	doc->count = 0;
+	doc->words = 0;
+
+	memset(doc->checkpoints, 0, sizeof(struct checkpoint_t));
+	doc->checkpoint_count = 1;
+	return do_rescan(doc, 0, 0, 0);
+}
+
+/*
+ * replace a span of a document, scanning it again incrementally
+ *
+ * @doc: document
+ * @offset: offset of span
+ * @removed: length of span
+ * @text: text to replace with
+ * @length: length of text
+ *
+ * return: 0 on success, -1 if the span is out of range or out of memory, in
+ *         which case the document is to be opened again
+ */
+int do_edit_doc(struct doc_t * doc, size_t offset, size_t removed,
+	const char * text, size_t length)
+{
+	size_t low = 0, high, middle;
+
+	if (offset > doc->size || removed > doc->size - offset ||
+		do_grow((void **)&doc->text, &doc->capacity, sizeof(char),
+		doc->size - removed + length + 1) != 0) {
+		return -1;
+	}
+	memmove(doc->text + offset + length, doc->text + offset + removed,
+		doc->size - offset - removed + 1);
+	memcpy(doc->text + offset, text, length);
+	doc->size = doc->size - removed + length;
+
+	/* find the last checkpoint not after the edit */
+	high = doc->checkpoint_count;
+	while (high - low > 1) {
+		middle = low + (high - low) / 2;
+		if (doc->checkpoints[middle].pos <= offset) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return do_rescan(doc, low, offset + length, offset + removed);
+}
+
+/*
+ * report the tokens of a document to a sink, the same as do_lex() does
+ *
+ * @doc: document
+ * @sink: sink to report words and counts to
+ */
+void do_report_doc(const struct doc_t * doc, const struct lex_sink * sink)
+{
+	const struct token_t * token;
+	const char * word;
+	int words = 0, lines = 0, words_in_line = 0;
+	size_t i, j = 0, base = 0, line_start = 0, offset;
+
+	for (i = 0; i < doc->count; ++i) {
+		while (j < doc->checkpoint_count &&
+			doc->checkpoints[j].token <= i) {
+			base = doc->checkpoints[j++].pos;
+		}
+		token = &doc->tokens[i];
+		offset = base + token->pos;
+		if (token->type < 0) {
+			if (sink->comment != NULL) {
+				sink->comment(sink->data, offset,
+					token->length, -token->type);
+			}
+			continue;
+		}
+		if (token->type == 0) {
+			line_start = offset;
+			do_update_line_count(sink, &lines, &words_in_line);
+			continue;
+		}
+		if (sink->position != NULL) {
+			sink->position(sink->data, offset, lines + 1,
+				offset - line_start + 1);
+		}
+		word = token->literal != NULL ? token->literal :
+			doc->text + offset;
+		if (token->type == WRONG) {
+			do_output_wrong_word(sink, word, token->length,
+				lines + 1);
+		} else {
+			do_output_word(sink, word, token->length, token->type);
+		}
+		do_update_word_count(&words, &words_in_line);
+	}
+	do_output_word_count(sink, doc->words);
+}
+
+/*
+ * release a document
+ *
+ * @doc: document
+ */
+void do_free_doc(struct doc_t * doc)
+{
+	free(doc->text);
+	free(doc->tokens);
+	free(doc->checkpoints);
+	free(doc->new_tokens);
+	free(doc->new_checkpoints);
+	memset(doc, 0, sizeof(*doc));
+}
+
+/*
+ * scan a document from a checkpoint until syncing with an old checkpoint, and
+ * splice what is scanned into the document
+ *
+ * @doc: document, whose text is edited
+ * @from: index of checkpoint to scan from
+ * @end: end of edit in new text
+ * @old_end: end of edit in old text
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+static int do_rescan(struct doc_t * doc, size_t from, size_t end,
+	size_t old_end)
+{
+	struct checkpoint_t start = doc->checkpoints[from], * old;
+	struct rescan_t rescan;
+	struct lex_sink sink;
+	struct scan_t scan;
+	size_t first, tail = 0, kept, token = 0, i;
+	int synced, words, lines;
+
+	/* so that no array is NULL */
+	if (do_grow((void **)&doc->tokens, &doc->token_capacity,
+		sizeof(struct token_t), 1) != 0 ||
+		do_grow((void **)&doc->new_tokens, &doc->new_token_capacity,
+		sizeof(struct token_t), 1) != 0 ||
+		do_grow((void **)&doc->new_checkpoints,
+		&doc->new_checkpoint_capacity, sizeof(struct checkpoint_t),
+		1) != 0) {
+		return -1;
+	}
+
+	rescan.doc = doc;
+	rescan.end = end;
+	rescan.old_end = old_end;
+	rescan.cursor = from + 1;
+	rescan.synced = doc->checkpoint_count;
+	rescan.base = start.pos;
+	rescan.token = start.token;
+	rescan.lines = start.lines;
+	rescan.failed = 0;
+	rescan.scan = &scan;
+	rescan.pos = 0;
+	doc->new_count = 0;
+	doc->new_checkpoint_count = 0;
+
+	sink.word = do_doc_word;
+	sink.wrong_word = do_doc_wrong_word;
+	sink.line_count = do_doc_line_count;
+	sink.word_count = do_doc_word_count;
+	sink.position = do_doc_position;
+	sink.comment = do_doc_comment;
+	sink.data = &rescan;
+
+	do_init_scan(&scan, &sink);
+	scan.start = start.pos;
+	scan.condition_flag = start.condition_flag;
+	scan.words = start.words;
+	scan.lines = start.lines;
+	scan.mark = do_doc_mark;
+	scan.data = &rescan;
+
+	doc->from = start.pos;
+	doc->to = do_scan_buffer(&scan, doc->text, start.pos, doc->size + 1);
+	do_end_comment(&scan, doc->to);
+	if (rescan.failed) {
+		return -1;
+	}
+
+	/* keep the old tokens and checkpoints from the one synced */
+	first = start.token + doc->new_count;
+	synced = rescan.synced < doc->checkpoint_count;
+	words = lines = 0;
+	if (synced) {
+		old = &doc->checkpoints[rescan.synced];
+		token = old->token;
+		tail = doc->count - token;
+		words = scan.words - old->words;
+		lines = scan.lines - old->lines;
+	}
+	kept = doc->checkpoint_count - rescan.synced;
+	if (do_grow((void **)&doc->tokens, &doc->token_capacity,
+		sizeof(struct token_t), first + tail) != 0 ||
+		do_grow((void **)&doc->checkpoints, &doc->checkpoint_capacity,
+		sizeof(struct checkpoint_t),
+		from + 1 + doc->new_checkpoint_count + kept) != 0) {
+		return -1;
+	}
+
+	memmove(doc->tokens + first, doc->tokens + doc->count - tail,
+		tail * sizeof(struct token_t));
+	memcpy(doc->tokens + start.token, doc->new_tokens,
+		doc->new_count * sizeof(struct token_t));
+	doc->count = first + tail;
+
+	old = doc->checkpoints + from + 1 + doc->new_checkpoint_count;
+	memmove(old, doc->checkpoints + rescan.synced,
+		kept * sizeof(struct checkpoint_t));
+	memcpy(doc->checkpoints + from + 1, doc->new_checkpoints,
+		doc->new_checkpoint_count * sizeof(struct checkpoint_t));
+	doc->checkpoint_count = from + 1 + doc->new_checkpoint_count + kept;
+
+	/* only counts and offsets differ after syncing */
+	for (i = 0; i < kept; ++i) {
+		old[i].pos = old[i].pos - old_end + end;
+		old[i].token = old[i].token - token + first;
+		old[i].words += words;
+		old[i].lines += lines;
+	}
+	doc->words = synced ? doc->words + words : scan.words;
+	return 0;
+}
+
+/*
+ * check if a scan of a document is at a checkpoint, and add it or sync with
+ * an old one
+ *
+ * @scan: scanner state, whose data is the rescan
+ * @i: position where the scanner is in the initial state
+ * @condition_flag: condition flag at i
+ *
+ * return: 1 if the scan syncs or runs out of memory, 0 otherwise
+ */
+static int do_doc_mark(struct scan_t * scan, size_t i, int condition_flag)
+{
+	struct rescan_t * rescan = scan->data;
+	struct doc_t * doc = rescan->doc;
+	struct checkpoint_t * checkpoint;
+	size_t old;
+
+	/* only the first mark of a line is a checkpoint */
+	if (scan->lines == rescan->lines) {
+		return 0;
+	}
+	rescan->lines = scan->lines;
+
+	if (i >= rescan->end) {
+		old = i - rescan->end + rescan->old_end;
+		while (rescan->cursor < doc->checkpoint_count &&
+			doc->checkpoints[rescan->cursor].pos < old) {
+			++rescan->cursor;
+		}
+		checkpoint = &doc->checkpoints[rescan->cursor];
+		if (rescan->cursor < doc->checkpoint_count &&
+			checkpoint->pos == old &&
+			checkpoint->condition_flag == condition_flag) {
+			rescan->synced = rescan->cursor;
+			return 1;
+		}
+	}
+
+	if (do_grow((void **)&doc->new_checkpoints,
+		&doc->new_checkpoint_capacity, sizeof(struct checkpoint_t),
+		doc->new_checkpoint_count + 1) != 0) {
+		rescan->failed = 1;
+		return 1;
+	}
+	checkpoint = &doc->new_checkpoints[doc->new_checkpoint_count++];
+	checkpoint->pos = i;
+	checkpoint->token = rescan->token + doc->new_count;
+	checkpoint->condition_flag = condition_flag;
+	checkpoint->words = scan->words;
+	checkpoint->lines = scan->lines;
+	rescan->base = i;
+	return 0;
+}
+
+/*
+ * record a token of a document being scanned
+ *
+ * @rescan: rescan of document
+ * @word: spelling of token, or NULL for a line or a comment
+ * @length: length of spelling or comment
+ * @type: token type, see struct token_t
+ */
+static void do_add_token(struct rescan_t * rescan, const char * word,
+	size_t length, int type)
+{
+	struct doc_t * doc = rescan->doc;
+	struct token_t * token;
+
+	if (rescan->failed) {
+		return;
+	}
+	if (do_grow((void **)&doc->new_tokens, &doc->new_token_capacity,
+		sizeof(struct token_t), doc->new_count + 1) != 0) {
+		rescan->failed = 1;
+		return;
+	}
+	token = &doc->new_tokens[doc->new_count++];
+	token->literal = NULL;
+	token->pos = (type != 0 ? rescan->pos : rescan->scan->line_start) -
+		rescan->base;
+	token->length = length;
+	token->type = type;
+	if (type > 0 &&
+		(word < doc->text || word > doc->text + doc->size)) {
+		token->literal = word;
+	}
+}
+
+static void do_doc_word(void * data, const char * word, size_t length,
+	int type)
+{
+	do_add_token(data, word, length, type);
+}
+
+static void do_doc_wrong_word(void * data, const char * word, size_t length,
+	int lines)
+{
+	do_add_token(data, word, length, WRONG);
+}
+
+static void do_doc_line_count(void * data, int lines, int words_in_line)
+{
+	do_add_token(data, NULL, 0, 0);
+}
+
+static void do_doc_word_count(void * data, int words)
+{
+}
+
+static void do_doc_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	((struct rescan_t *)data)->pos = offset;
+}
+
+static void do_doc_comment(void * data, size_t offset, size_t length,
+	int kind)
+{
+	((struct rescan_t *)data)->pos = offset;
+	do_add_token(data, NULL, length, -kind);
+}
+
+/*
+ * make sure an array has room for a number of elements
+ *
+ * @array: a pointer to array
+ * @capacity: a pointer to number of elements array has room for
+ * @size: size of an element
+ * @count: number of elements wanted
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+static int do_grow(void ** array, size_t * capacity, size_t size,
+	size_t count)
+{
+	size_t n = *capacity ? *capacity : 16;
+	void * p;
+
+	if (count <= *capacity) {
+		return 0;
+	}
+	while (n < count) {
+		n <<= 1;
+	}
+	if ((p = realloc(*array, n * size)) == NULL) {
+		return -1;
+	}
+	*array = p;
+	*capacity = n;
+	return 0;
+}
+
+/****************************** token iterator ********************************/
+
+/*
+ * open a lexer taking tokens one by one from a buffer, which is scanned as a
+ * source file followed by a newline, and must be kept until the lexer is
+ * closed
+ *
+ * @buffer: Java source
+ * @length: length of buffer
+ *
+ * return: the lexer, NULL if out of memory
+ */
+struct lexer_t * do_open_lexer(const char * buffer, size_t length)
+{
+	struct lexer_t * lexer;
+
+	if ((lexer = calloc(1, sizeof(struct lexer_t))) == NULL) {
+		return NULL;
+	}
+	lexer->sink.word = do_lexer_word;
+	lexer->sink.wrong_word = do_lexer_wrong_word;
+	lexer->sink.line_count = do_lexer_line_count;
+	lexer->sink.word_count = do_lexer_word_count;
+	lexer->sink.position = do_lexer_position;
+	lexer->sink.comment = NULL;
+	lexer->sink.data = lexer;
+
+	do_init_scan(&lexer->scan, &lexer->sink);
+	lexer->scan.mark = do_lexer_mark;
+	lexer->scan.data = lexer;
+	lexer->buffer = buffer;
+	lexer->length = length;
+	return lexer;
+}
+
+/*
+ * take the next token of a lexer, in the same order as a sink is reported
+ * tokens, and valid until the next call
+ *
+ * @lexer: lexer
+ * @token: a pointer to store the token
+ *
+ * return: 1 on success, 0 if there is no more token or out of memory
+ */
+int do_next_token(struct lexer_t * lexer, struct lex_token * token)
+{
+	size_t keep;
+
+	while (lexer->head == lexer->count) {
+		lexer->head = lexer->count = 0;
+		if (lexer->failed || lexer->part == 2) {
+			return 0;
+		}
+		if (lexer->part == 1) {
+			lexer->pos = do_scan_buffer(&lexer->scan, lexer->word,
+				lexer->pos, lexer->word_length);
+			if (lexer->pos == lexer->word_length) {
+				lexer->part = 2;
+			}
+			continue;
+		}
+
+		lexer->pos = do_scan_buffer(&lexer->scan, lexer->buffer,
+			lexer->pos, lexer->length);
+		if (lexer->pos < lexer->length) {
+			continue;
+		}
+
+		/* go on with the word left followed by a newline */
+		keep = dfa_idle[lexer->scan.state] ? 0 :
+			lexer->length - lexer->scan.start;
+		if (do_grow((void **)&lexer->word, &lexer->word_capacity, 1,
+			keep + 1) != 0) {
+			lexer->failed = 1;
+			return 0;
+		}
+		memcpy(lexer->word, lexer->buffer + lexer->length - keep, keep);
+		lexer->word[keep] = '\n';
+		lexer->word_length = keep + 1;
+		lexer->scan.start = 0;
+		lexer->scan.base = lexer->length - keep;
+		lexer->pos = keep;
+		lexer->part = 1;
+	}
+
+	*token = lexer->tokens[lexer->head++];
+	return 1;
+}
+
+/*
+ * close a lexer
+ *
+ * @lexer: lexer
+ */
+void do_close_lexer(struct lexer_t * lexer)
+{
+	if (lexer != NULL) {
+		free(lexer->tokens);
+		free(lexer->word);
+		free(lexer);
+	}
+}
+
+/*
+ * stop the scan of a lexer once it has tokens to take
+ *
+ * @scan: scanner state, whose data is the lexer
+ * @i: position where the scanner is in the initial state
+ * @condition_flag: condition flag at i
+ *
+ * return: 1 if the lexer has tokens, 0 otherwise
+ */
+static int do_lexer_mark(struct scan_t * scan, size_t i, int condition_flag)
+{
+	struct lexer_t * lexer = scan->data;
+
+	return lexer->count != 0;
+}
+
+/*
+ * queue a token of a lexer
+ *
+ * @lexer: lexer
+ * @word: word of token
+ * @length: length of word
+ * @type: word type, WRONG for a wrong word, or 0 for the end of a line
+ * @lines: line number of word, or number of lines so far
+ * @words: number of words so far including it, or words in line
+ * @position: where the word starts, or where the next line starts
+ */
+static void do_add_lexer_token(struct lexer_t * lexer, const char * word,
+	size_t length, int type, int lines, int words,
+	const struct lex_position * position)
+{
+	struct lex_token * token;
+
+	if (do_grow((void **)&lexer->tokens, &lexer->capacity,
+		sizeof(struct lex_token), lexer->count + 1) != 0) {
+		lexer->failed = 1;
+		return;
+	}
+	token = &lexer->tokens[lexer->count++];
+	token->word = word;
+	token->length = length;
+	token->type = type;
+	token->lines = lines;
+	token->words = words;
+	token->offset = position->offset;
+	token->column = position->column;
+	if (type == INT || type == FLOAT) {
+		do_number(word, length, type, &token->number);
+	} else {
+		memset(&token->number, 0, sizeof(struct lex_number));
+	}
+}
+
+static void do_lexer_word(void * data, const char * word, size_t length,
+	int type)
+{
+	struct lexer_t * lexer = data;
+
+	do_add_lexer_token(lexer, word, length, type, lexer->scan.lines + 1,
+		lexer->scan.words + 1, &lexer->next);
+}
+
+static void do_lexer_wrong_word(void * data, const char * word,
+	size_t length, int lines)
+{
+	struct lexer_t * lexer = data;
+
+	do_add_lexer_token(lexer, word, length, WRONG, lines,
+		lexer->scan.words + 1, &lexer->next);
+}
+
+static void do_lexer_line_count(void * data, int lines, int words_in_line)
+{
+	struct lexer_t * lexer = data;
+	struct lex_position position;
+
+	do_set_position(&position, lexer->scan.line_start, lines + 1, 1);
+	do_add_lexer_token(lexer, NULL, 0, 0, lines, words_in_line,
+		&position);
+}
+
+static void do_lexer_word_count(void * data, int words)
+{
+}
+
+static void do_lexer_position(void * data, size_t offset, int line,
+	size_t column)
+{
+	do_set_position(&((struct lexer_t *)data)->next, offset, line, column);
+}
+
+/****************************** push-based lexer ******************************/
+
+/*
+ * a lexer may also be fed a source chunk by chunk, reporting to a sink as it
+ * goes, without the chunks being kept
+ * a word left at the end of a chunk is copied into the word buffer, and the
+ * next chunk is appended to it bit by bit, doubling each time, until the
+ * word is accepted, after which the chunk is scanned in place
+ */
+
+/*
+ * start a lexer to be fed chunks of a source
+ *
+ * @sink: sink to report words and counts to
+ *
+ * return: the lexer, NULL if out of memory
+ */
+struct lexer_t * do_start_lexer(const struct lex_sink * sink)
+{
+	struct lexer_t * lexer;
+
+	if ((lexer = calloc(1, sizeof(struct lexer_t))) == NULL) {
+		return NULL;
+	}
+	lexer->sink = *sink;
+	do_init_scan(&lexer->scan, &lexer->sink);
+	return lexer;
+}
+
+/*
+ * feed a chunk of source to a lexer, which may end anywhere, even in the
+ * middle of a word
+ *
+ * @lexer: lexer started by do_start_lexer()
+ * @chunk: chunk of source, which is not kept after return
+ * @length: length of chunk
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+int do_feed_lexer(struct lexer_t * lexer, const char * chunk, size_t length)
+{
+	struct scan_t * scan = &lexer->scan;
+	size_t i = 0, n, end, keep;
+
+	/* finish the word left first */
+	while (lexer->word_length != 0 && i < length) {
+		n = lexer->word_length < 64 ? 64 : lexer->word_length;
+		if (n > length - i) {
+			n = length - i;
+		}
+		end = lexer->word_length + n;
+		if (do_grow((void **)&lexer->word, &lexer->word_capacity, 1,
+			end) != 0) {
+			return -1;
+		}
+		memcpy(lexer->word + lexer->word_length, chunk + i, n);
+
+		scan->base = lexer->fed + i - lexer->word_length;
+		scan->mark = do_feed_mark;
+		end = do_scan_buffer(scan, lexer->word, lexer->word_length,
+			end);
+		scan->mark = NULL;
+		do_leave_comment(scan);
+		i += end - lexer->word_length;
+		/* the word is accepted, or has become a comment */
+		if (end < lexer->word_length + n || dfa_idle[scan->state]) {
+			lexer->word_length = 0;
+		} else {
+			lexer->word_length = end;
+		}
+	}
+	if (lexer->word_length != 0) {
+		lexer->fed += length;
+		return 0;
+	}
+
+	scan->start = i;
+	scan->base = lexer->fed;
+	do_scan_buffer(scan, chunk, i, length);
+	do_leave_comment(scan);
+	keep = dfa_idle[scan->state] ? 0 : length - scan->start;
+	if (do_grow((void **)&lexer->word, &lexer->word_capacity, 1,
+		keep + 1) != 0) {
+		return -1;
+	}
+	memcpy(lexer->word, chunk + length - keep, keep);
+	lexer->word_length = keep;
+	lexer->fed += length;
+	scan->start = 0;
+	return 0;
+}
+
+/*
+ * finish a lexer fed chunks of source, as if it were followed by a newline,
+ * and report the word count
+ *
+ * @lexer: lexer started by do_start_lexer()
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+int do_finish_lexer(struct lexer_t * lexer)
+{
+	size_t keep = lexer->word_length;
+
+	if (do_grow((void **)&lexer->word, &lexer->word_capacity, 1,
+		keep + 1) != 0) {
+		return -1;
+	}
+	lexer->word[keep] = '\n';
+	lexer->scan.start = 0;
+	lexer->scan.base = lexer->fed - keep;
+	do_scan_buffer(&lexer->scan, lexer->word, keep, keep + 1);
+	do_end_comment(&lexer->scan, keep + 1);
+	lexer->word_length = 0;
+	do_output_word_count(&lexer->sink, lexer->scan.words);
+	return 0;
+}
+
+/*
+ * stop the scan of the word left at the first word accepted
+ *
+ * @scan: scanner state
+ * @i: position where the scanner is in the initial state
+ * @condition_flag: condition flag at i
+ *
+ * return: 1
+ */
+static int do_feed_mark(struct scan_t * scan, size_t i, int condition_flag)
+{
+	return 1;
+}
+
+/******************************** run kernels *********************************/
+/*
+ * a kernel returns the index of the first character leaving a run state, which
+ * either is one of the characters it stops at, or is out of all the ranges it
+ * stays in, see lexjava.dfa
+ *
+ * the vector kernels leave the last few characters to the scalar one
+ */
+
+/*
+ * scalar run kernel
+ *
+ * @run: how to run the state
+ * @buffer: current buffer
+ * @i: index of the first character to check
+ * @end: length of current buffer
+ *
+ * return: index of the first character leaving the state, or end
+ */
+static size_t do_run(const struct dfa_run_t * run, const char * buffer,
+	size_t i, size_t end)
+{
+	const unsigned char * p = (const unsigned char *)buffer;
+	const char * stop;
+	int k;
+
+	if (run->type == DFA_RUN_STOP) {
+		if (run->count == 1) {
+			stop = memchr(buffer + i, run->bytes[0], end - i);
+			return stop != NULL ? stop - buffer : end;
+		}
+		for (; i < end; ++i) {
+			for (k = 0; k < run->count; ++k) {
+				if (p[i] == run->bytes[k]) {
+					return i;
+				}
+			}
+		}
+		return end;
+	}
+
+	for (; i < end; ++i) {
+		for (k = 0; k < run->count; k += 2) {
+			if (p[i] >= run->bytes[k] && p[i] <= run->bytes[k + 1]) {
+				break;
+			}
+		}
+		if (k == run->count) {
+			return i;
+		}
+	}
+	return end;
+}
+
+#ifdef USE_SIMD
+/*
+ * run kernel of SSE2, checking 16 characters at a time
+ * a character c is in a range [lo, hi] if (c - lo) <= (hi - lo) unsigned
+ */
+__attribute__((target("sse2")))
+static size_t do_run_sse2(const struct dfa_run_t * run, const char * buffer,
+	size_t i, size_t end)
+{
+	__m128i lo[DFA_RUN_BYTES], span[DFA_RUN_BYTES];
+	__m128i chunk, hit, sub;
+	int k, n = 0;
+	unsigned int mask;
+
+	for (k = 0; k < run->count; ++k, ++n) {
+		lo[n] = _mm_set1_epi8((char)run->bytes[k]);
+		if (run->type == DFA_RUN_STAY) {
+			span[n] = _mm_set1_epi8((char)(run->bytes[k + 1] -
+				run->bytes[k]));
+			++k;
+		}
+	}
+
+	for (; i + 16 <= end; i += 16) {
+		chunk = _mm_loadu_si128((const __m128i *)(buffer + i));
+		if (run->type == DFA_RUN_STOP) {
+			hit = _mm_cmpeq_epi8(chunk, lo[0]);
+			for (k = 1; k < n; ++k) {
+				hit = _mm_or_si128(hit,
+					_mm_cmpeq_epi8(chunk, lo[k]));
+			}
+			mask = _mm_movemask_epi8(hit);
+		} else {
+			hit = _mm_setzero_si128();
+			for (k = 0; k < n; ++k) {
+				sub = _mm_sub_epi8(chunk, lo[k]);
+				hit = _mm_or_si128(hit, _mm_cmpeq_epi8(
+					_mm_min_epu8(sub, span[k]), sub));
+			}
+			mask = ~_mm_movemask_epi8(hit) & 0xffff;
+		}
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return do_run(run, buffer, i, end);
+}
+
+/* run kernel of AVX2, checking 32 characters at a time */
+__attribute__((target("avx2")))
+static size_t do_run_avx2(const struct dfa_run_t * run, const char * buffer,
+	size_t i, size_t end)
+{
+	__m256i lo[DFA_RUN_BYTES], span[DFA_RUN_BYTES];
+	__m256i chunk, hit, sub;
+	int k, n = 0;
+	unsigned int mask;
+
+	for (k = 0; k < run->count; ++k, ++n) {
+		lo[n] = _mm256_set1_epi8((char)run->bytes[k]);
+		if (run->type == DFA_RUN_STAY) {
+			span[n] = _mm256_set1_epi8((char)(run->bytes[k + 1] -
+				run->bytes[k]));
+			++k;
+		}
+	}
+
+	for (; i + 32 <= end; i += 32) {
+		chunk = _mm256_loadu_si256((const __m256i *)(buffer + i));
+		if (run->type == DFA_RUN_STOP) {
+			hit = _mm256_cmpeq_epi8(chunk, lo[0]);
+			for (k = 1; k < n; ++k) {
+				hit = _mm256_or_si256(hit,
+					_mm256_cmpeq_epi8(chunk, lo[k]));
+			}
+			mask = _mm256_movemask_epi8(hit);
+		} else {
+			hit = _mm256_setzero_si256();
+			for (k = 0; k < n; ++k) {
+				sub = _mm256_sub_epi8(chunk, lo[k]);
+				hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(
+					_mm256_min_epu8(sub, span[k]), sub));
+			}
+			mask = ~_mm256_movemask_epi8(hit);
+		}
+		if (mask) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return do_run_sse2(run, buffer, i, end);
+}
+#endif /* USE_SIMD */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
@@ -0,0 +1,587 @@
+/*
+ * lexjava.h - scanner of Java source code, shared by lex-java and parse-java
+ *
+ * Copyright (C) 2015 Chaos Shen
+ *
+ * This file is part of parse-java.
+ *
+ * parse-java is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * parse-java is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with parse-java.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LEXJAVA_H
+#define LEXJAVA_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * memory-mapped input and multiple threads are used wherever POSIX is
+ * available
+ */
+#ifndef _MSC_VER
+# define USE_MMAP
+# define USE_THREADS
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <sys/types.h>
+# include <dirent.h>
+# include <pthread.h>
+# include <unistd.h>
+#endif /* _MSC_VER */
+
+#define LEX_BUF_SIZE 4096
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* attribute list */
+enum
+{
+	WRONG          = 0x101,
+	SPACE          = 0x102,
+	KEYWORD        = 0x103,
+	IDENTIFIER     = 0x104,
+	BOOLEAN        = 0x105,
+	CHAR           = 0x106,
+	INT            = 0x107,
+	FLOAT          = 0x108,
+	STRING         = 0x109,
+	ASSIGN         = 0x110,
+	CONDITION      = 0x111,
+	LOGIC_OR       = 0x112,
+	LOGIC_AND      = 0x113,
+	BIT_OR         = 0x114,
+	XOR            = 0x115,
+	BIT_AND        = 0x116,
+	EQUAL          = 0x117,
+	COMPARE        = 0x118,
+	SHIFT          = 0x119,
+	ADD_SUB        = 0x11a,
+	MUL_DIV        = 0x11b,
+	PLUSPLUS       = 0x11c,
+	BRACKET_DOT    = 0x11d,
+	/* here is a chasm */
+	COMMA          = 0x120,
+	BIG_BRACKET    = 0x121,
+	SEMICOLON      = 0x122,
+	COLON          = 0x123, /* in addition */
+};
+
+/*
+ * keyword ID list, returned by do_keyword()
+ * boolean constants 'true' and 'false' have IDs as well
+ */
+enum
+{
+	KW_NONE,
+	KW_ABSTRACT,
+	KW_BOOLEAN,
+	KW_BREAK,
+	KW_BYTE,
+	KW_CASE,
+	KW_CATCH,
+	KW_CHAR,
+	KW_CLASS,
+	KW_CONST,
+	KW_CONTINUE,
+	KW_DEFAULT,
+	KW_DO,
+	KW_DOUBLE,
+	KW_ELSE,
+	KW_EXTENDS,
+	KW_FINAL,
+	KW_FINALLY,
+	KW_FLOAT,
+	KW_FOR,
+	KW_GOTO,
+	KW_IF,
+	KW_IMPLEMENTS,
+	KW_IMPORT,
+	KW_INSTANCEOF,
+	KW_INT,
+	KW_INTERFACE,
+	KW_LONG,
+	KW_NATIVE,
+	KW_NEW,
+	KW_NULL,
+	KW_PACKAGE,
+	KW_PRIVATE,
+	KW_PROTECTED,
+	KW_PUBLIC,
+	KW_RETURN,
+	KW_SHORT,
+	KW_STATIC,
+	KW_SUPER,
+	KW_SWITCH,
+	KW_SYNCHRONIZED,
+	KW_THIS,
+	KW_THROW,
+	KW_THROWS,
+	KW_TRANSIENT,
+	KW_TRY,
+	KW_VOID,
+	KW_VOLATILE,
+	KW_WHILE,
+	KW_TRUE,
+	KW_FALSE,
+};
+
+/*
+ * input source type
+ * a regular file is mapped into memory and scanned in one piece, while a pipe
+ * or a terminal is read through a growing buffer
+ * the buffer is kept across files, and released by do_free_input()
+ */
+struct input_t
+{
+	FILE * fp;
+	const char * map;           /* mapped file, NULL if not mapped */
+	size_t size;                /* size of mapped file */
+	int mapped;                 /* whether the mapped file is returned */
+	int end;                    /* whether the last chunk has been read */
+	char * buffer;              /* buffer of the last chunk */
+	size_t length;              /* length of the last chunk */
+	size_t capacity;            /* capacity of buffer */
+};
+
+/*
+ * token sink type
+ * the scanner reports every word, wrong word, line and the final word count
+ * to a sink, which may print them as text or hand them to a parser directly
+ * words are not terminated, but refer to the input with their lengths
+ * a sink wanting positions is told where each word and wrong word starts
+ * right before it, with its byte offset in the source, its line number and
+ * its column counted in bytes from 1, where a ':' after '?' starts at ':'
+ * a sink wanting comments is told the span of each one in the source once it
+ * ends, with its comment kind, which is not a word, so it is not counted
+ */
+struct lex_sink
+{
+	void (*word)(void * data, const char * word, size_t length, int type);
+	void (*wrong_word)(void * data, const char * word, size_t length,
+		int lines);
+	void (*line_count)(void * data, int lines, int words_in_line);
+	void (*word_count)(void * data, int words);
+	/* NULL if positions are not wanted */
+	void (*position)(void * data, size_t offset, int line, size_t column);
+	/* NULL if comments are not wanted */
+	void (*comment)(void * data, size_t offset, size_t length, int kind);
+	void * data;
+};
+
+/*
+ * comment kinds, where a line comment ends before its newline, and a Javadoc
+ * comment is a block comment whose opening is followed by another '*', other
+ * than an empty one of 4 bytes
+ */
+enum
+{
+	LEX_COMMENT_LINE = 1,
+	LEX_COMMENT_BLOCK,
+	LEX_COMMENT_JAVADOC,
+};
+
+/* position type, of where a word starts */
+struct lex_position
+{
+	size_t offset;
+	int line;
+	size_t column;
+};
+
+/*
+ * position fields, written after each word and wrong word when wanted, as
+ * deltas from the position of the one before, or from offset 0 at line 1
+ * column 1 for the first one:
+ *   offset delta     bytes from the word before
+ *   line delta       lines from the word before
+ *   column           only if line delta is not 0, as otherwise it is the
+ *                    column of the word before plus offset delta
+ * in text formats, they are a field '+D' or '+D+L:C' at the end of a record
+ * after a tab
+ * in binary format, a word starting right where the one before ends, which
+ * is the next line at column 1 after a newline, has no field but a kind with
+ * LEX_BIN_EXPECTED, so with spaces kept, almost every word takes no more
+ * bytes, while the field of any other word is varint (D << 1 | 1) and then
+ * varints L and C if L is not 0, or varint (D << 1) otherwise
+ * a word ends as many bytes after it starts as its spelling has, except that
+ * an escaped space is of 1 byte, and a ':' after '?' as well
+ */
+
+/*
+ * binary scanner output format
+ *
+ * a header of magic "LJTK", a version byte and a flag byte, followed by
+ * records, each of which starts with a kind byte:
+ *   0x01 ~ 0x23      a word of type (0x100 + kind), then
+ *                    - for keywords, identifiers and booleans, varint N,
+ *                      where N > 0 refers to the (N - 1)th interned string
+ *                      and N = 0 interns a new one given as varint length
+ *                      and bytes
+ *                    - for the others, varint length and bytes
+ *                    - for wrong words, varint line number in addition
+ *                    - with LEX_BIN_VALUES, for integer and floating
+ *                      constants, varint number flags, and then the
+ *                      value as a varint of its zigzag encoding, or as 8
+ *                      bytes of a double in little endian
+ *                    - with LEX_BIN_POSITIONS, position fields at last,
+ *                      see position fields above, where the kind may have
+ *                      LEX_BIN_EXPECTED
+ *   LEX_BIN_LINE     varint in-line word count, only with LEX_BIN_LINES
+ *   LEX_BIN_TOTAL    varint total word count, always the last record
+ *
+ * varints are unsigned LEB128, and words are spelled as in the text format
+ */
+#define LEX_BIN_MAGIC "LJTK"
+#define LEX_BIN_VERSION 1
+#define LEX_BIN_HEADER_SIZE 6
+
+/* binary format flags */
+#define LEX_BIN_LINES 0x01 /* line records are present */
+#define LEX_BIN_POSITIONS 0x02 /* position fields are present */
+#define LEX_BIN_VALUES 0x04 /* values of numeric constants are present */
+
+/* flag of the kind of a word at its expected position, see position fields */
+#define LEX_BIN_EXPECTED 0x80
+
+/* binary record kinds other than words */
+enum
+{
+	LEX_BIN_LINE   = 0x40,
+	LEX_BIN_TOTAL  = 0x41,
+};
+
+/*
+ * line index format, a sidecar table of the lines of a scanner output, which
+ * then has no line records
+ *
+ * a header of magic "LJLX", a version byte and 3 zero bytes, followed by a
+ * record of LEX_INDEX_RECORD_SIZE bytes for each line, which are
+ *   8 bytes          offset of the first record of the line in scanner
+ *                    output, all ones if the output cannot tell
+ *   4 bytes          in-line word count
+ * in little endian, so line N is at
+ * LEX_INDEX_HEADER_SIZE + (N - 1) * LEX_INDEX_RECORD_SIZE
+ */
+#define LEX_INDEX_MAGIC "LJLX"
+#define LEX_INDEX_VERSION 1
+#define LEX_INDEX_HEADER_SIZE 8
+#define LEX_INDEX_RECORD_SIZE 12
+
+/*
+ * comment index format, a sidecar table of the comments of a source, which
+ * are referred to by their spans in the source, not copied
+ *
+ * a header of magic "LJCM", a version byte and 3 zero bytes, followed by a
+ * record of LEX_COMMENT_RECORD_SIZE bytes for each comment in source order,
+ * which are
+ *   8 bytes          offset of the comment in the source
+ *   4 bytes          length of the comment, all ones if it does not fit
+ *   1 byte           comment kind
+ * in little endian
+ */
+#define LEX_COMMENT_MAGIC "LJCM"
+#define LEX_COMMENT_VERSION 1
+#define LEX_COMMENT_HEADER_SIZE 8
+#define LEX_COMMENT_RECORD_SIZE 13
+
+/*
+ * number type, the value of an integer or floating constant, see do_number()
+ * an int constant is sign-extended from 32 bits, except that a decimal one
+ * may be 2147483648, and a long one is taken as 64 bits
+ * a float constant is rounded to float, and then held as a double
+ */
+struct lex_number
+{
+	int flags;
+	int64_t integer;            /* value of an integer constant */
+	double real;                /* value of a floating constant */
+};
+
+/* number flags */
+#define LEX_NUMBER_FLOAT 0x01   /* a floating constant */
+#define LEX_NUMBER_LONG 0x02    /* an integer constant with suffix 'L' */
+#define LEX_NUMBER_SINGLE 0x04  /* a floating constant with suffix 'F' */
+#define LEX_NUMBER_BAD 0x08     /* not a valid constant or out of range */
+
+/* number of buckets of each histogram of statistics */
+#define LEX_STATS_BUCKETS 128
+
+/* number of word types, indexed by (type - 0x100) */
+#define LEX_STATS_KINDS 0x24
+
+/*
+ * statistics type, of a source or of many added up, see do_lex_stats()
+ * a histogram counts each value in its own bucket, except that values not
+ * less than LEX_STATS_BUCKETS - 1 are all in the last one
+ */
+struct lex_stats
+{
+	unsigned long files;
+	unsigned long bytes;
+	unsigned long lines;
+	unsigned long words;
+	unsigned long comment_bytes;
+	unsigned long kinds[LEX_STATS_KINDS];   /* words of each type */
+	unsigned long line_lengths[LEX_STATS_BUCKETS];  /* in bytes */
+	unsigned long identifier_lengths[LEX_STATS_BUCKETS];
+};
+
+/* intern table entry type */
+struct intern_entry_t
+{
+	size_t offset; /* offset of the string in pool, 0 if unused */
+	size_t length;
+	unsigned int hash;
+	unsigned int index;
+};
+
+/*
+ * intern table type, assigning each distinct string a dense index
+ * strings are copied into a pool, which starts with an unused byte
+ */
+struct intern_t
+{
+	struct intern_entry_t * entries;
+	size_t capacity;  /* power of 2 */
+	size_t count;
+	char * pool;
+	size_t length;
+	size_t size;
+};
+
+/*
+ * symbol sink type, printing the text format except that identifiers are
+ * interned, so each distinct identifier gets a dense symbol ID when first seen
+ * a record "symbol <ID> <SPELLING>" is printed before its first occurrence,
+ * and every occurrence is printed as '#<ID>' in place of its spelling
+ */
+struct symbol_sink_t
+{
+	FILE * out;
+	struct intern_t symbols;
+	int positions;              /* whether position fields are printed */
+	struct lex_position last;   /* position of the word printed before */
+	struct lex_position next;   /* position of the word to print */
+};
+
+/* text sink type with position fields, see position fields above */
+struct text_sink_t
+{
+	FILE * out;
+	struct lex_position last;
+	struct lex_position next;
+};
+
+/* binary sink type, see binary scanner output format above */
+struct binary_sink_t
+{
+	FILE * out;
+	int flags;
+	struct intern_t strings;
+	struct lex_position last;
+	struct lex_position next;
+	struct lex_position expected; /* where the word written ends */
+};
+
+/*
+ * line index sink type, passing everything but lines to another sink, and
+ * writing lines to a line index instead, see line index format above
+ * offsets are told by ftell() of the output of the other sink
+ */
+struct index_sink_t
+{
+	const struct lex_sink * sink;
+	FILE * out;                 /* output of sink */
+	FILE * index;
+	long start;                 /* offset of the line being scanned */
+};
+
+/*
+ * comment index sink type, passing everything but comments to another sink,
+ * and writing comments to a comment index, see comment index format above
+ */
+struct comment_sink_t
+{
+	const struct lex_sink * sink;
+	FILE * index;
+};
+
+/*
+ * maximum length of a word passed on by the space sink for a run of spaces,
+ * where a longer run is passed on in pieces, so that records stay short
+ */
+#define LEX_SPACE_RUN_SIZE 256
+
+/* space sink modes */
+enum
+{
+	LEX_SPACE_NONE = 1,         /* spaces are dropped */
+	LEX_SPACE_RUN,              /* each run of spaces is a single word */
+};
+
+/*
+ * space sink type, passing everything but spaces on to another sink, where a
+ * run of spaces ends at a newline, which is in the run
+ * counts passed on are of words passed on
+ */
+struct space_sink_t
+{
+	const struct lex_sink * sink;
+	int mode;
+	char run[LEX_SPACE_RUN_SIZE]; /* spelling of the run not passed on yet */
+	size_t length;
+	struct lex_position start;  /* position of the run */
+	struct lex_position next;   /* position of the word to come */
+	int words;                  /* spaces not passed on as words */
+	int words_in_line;          /* those of the line being scanned */
+};
+
+/*
+ * token type of a document, which is a word, a wrong word if type is WRONG,
+ * a line if type is 0, or a comment if type is minus its comment kind
+ */
+struct token_t
+{
+	const char * literal;       /* spelling not in text, or NULL */
+	/*
+	 * offset from its checkpoint of where the word or comment starts, or
+	 * of where the next line starts for a line
+	 */
+	size_t pos;
+	size_t length;
+	int type;
+};
+
+/*
+ * checkpoint type, the first position on a line where the scanner is in the
+ * initial state, with everything needed to scan on from there
+ */
+struct checkpoint_t
+{
+	size_t pos;
+	size_t token;               /* index of the first token after it */
+	int condition_flag;
+	int words;
+	int lines;
+};
+
+/*
+ * document type, a source kept in memory with its tokens and checkpoints
+ * an edit is scanned again from the checkpoint before it, only until the
+ * scanner meets an old checkpoint after it in the same state, and the tokens
+ * scanned are spliced into the old ones
+ * a document is zeroed before first use, and released by do_free_doc()
+ */
+struct doc_t
+{
+	char * text;                /* followed by a newline */
+	size_t size;
+	size_t capacity;
+	struct token_t * tokens;
+	size_t count;
+	size_t token_capacity;
+	struct checkpoint_t * checkpoints;
+	size_t checkpoint_count;
+	size_t checkpoint_capacity;
+	int words;
+	size_t from;                /* span scanned by the last edit */
+	size_t to;
+	/* tokens and checkpoints scanned by the last edit */
+	struct token_t * new_tokens;
+	size_t new_count;
+	size_t new_token_capacity;
+	struct checkpoint_t * new_checkpoints;
+	size_t new_checkpoint_count;
+	size_t new_checkpoint_capacity;
+};
+
+/*
+ * token type of a lexer, which is a word, a wrong word if type is WRONG, or
+ * the end of a line if type is 0
+ * tokens are taken in the same order as a sink is reported them
+ */
+struct lex_token
+{
+	const char * word;          /* not terminated, NULL for a line */
+	size_t length;
+	int type;
+	int lines;                  /* line number, or lines so far for a line */
+	int words;                  /* words so far, or words in line for a line */
+	/*
+	 * byte offset and column of the word, or of where the next line
+	 * starts for a line, see struct lex_sink
+	 */
+	size_t offset;
+	size_t column;
+	/* value of an integer or floating constant, zeroed for the others */
+	struct lex_number number;
+};
+
+/*
+ * lexer type, holding all state of a scan, so that tokens are taken one by
+ * one from a buffer, or chunks of a source are fed one by one, see token
+ * iterator and push-based lexer sections of lexjava.c
+ */
+struct lexer_t;
+
+void do_lex(FILE * src, const struct lex_sink * sink, struct input_t * in);
+#ifdef USE_THREADS
+void do_lex_parallel(FILE * src, const struct lex_sink * sink,
+	struct input_t * in, int threads);
+#endif /* USE_THREADS */
+void do_lex_stats(FILE * src, struct lex_stats * stats, struct input_t * in);
+void do_add_stats(struct lex_stats * total, const struct lex_stats * stats);
+void do_free_input(struct input_t * in);
+int do_open_doc(struct doc_t * doc, const char * text, size_t size);
+int do_edit_doc(struct doc_t * doc, size_t offset, size_t removed,
+	const char * text, size_t length);
+void do_report_doc(const struct doc_t * doc, const struct lex_sink * sink);
+void do_free_doc(struct doc_t * doc);
+struct lexer_t * do_open_lexer(const char * buffer, size_t length);
+int do_next_token(struct lexer_t * lexer, struct lex_token * token);
+void do_close_lexer(struct lexer_t * lexer);
+struct lexer_t * do_start_lexer(const struct lex_sink * sink);
+int do_feed_lexer(struct lexer_t * lexer, const char * chunk, size_t length);
+int do_finish_lexer(struct lexer_t * lexer);
+int do_keyword(const char * word, size_t length);
+int do_number(const char * word, size_t length, int type,
+	struct lex_number * number);
+void do_text_sink(struct lex_sink * sink, FILE * out);
+void do_text_position_sink(struct lex_sink * sink, struct text_sink_t * text,
+	FILE * out);
+void do_symbol_sink(struct lex_sink * sink, struct symbol_sink_t * symbol,
+	FILE * out, int positions);
+void do_free_symbol_sink(struct symbol_sink_t * symbol);
+int do_binary_sink(struct lex_sink * sink, struct binary_sink_t * binary,
+	FILE * out, int flags);
+void do_free_binary_sink(struct binary_sink_t * binary);
+int do_index_sink(struct lex_sink * sink, struct index_sink_t * index,
+	const struct lex_sink * inner, FILE * out, FILE * fp);
+void do_space_sink(struct lex_sink * sink, struct space_sink_t * space,
+	const struct lex_sink * inner, int mode);
+int do_comment_sink(struct lex_sink * sink, struct comment_sink_t * comment,
+	const struct lex_sink * inner, FILE * fp);
+
+long do_intern(struct intern_t * table, const char * string, size_t length,
+	int * added);
+void do_clear_intern(struct intern_t * table);
+void do_free_intern(struct intern_t * table);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LEXJAVA_H */
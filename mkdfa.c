@@ -0,0 +1,1092 @@
+/*
+ * mkdfa.c - generator of the transition table of Java scanner
+ *
+ * Copyright (C) 2015 Chaos Shen
+ *
+ * This file is part of parse-java.
+ *
+ * parse-java is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * parse-java is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with parse-java.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _MSC_VER
+/*
+ * if using MSVC, suppress stupid security warnings, define snprintf and inline
+ */
+# define _CRT_SECURE_NO_WARNINGS
+# define snprintf _snprintf
+# define inline
+#endif /* _MSC_VER */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUF_SIZE 1024
+#define MAX_STATES 0x3fff
+#define MAX_NAME 64
+#define MAX_STOPS 4
+#define MAX_RANGES 6
+#define MAX_SEEDS 0x100000
+
+/* get the size of an array, maybe defined */
+#ifndef ARRAY_SIZE
+# define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+#endif /* ARRAY_SIZE */
+
+/*
+ * a transition is stored as target state + 1, so 0 means no transition, with
+ * LINE set if it meets a newline
+ * the generated table uses DFA_ACCEPT for no transition and DFA_LINE for a
+ * newline instead, and also marks a target of run state with DFA_RUN
+ */
+#define LINE 0x8000
+#define RUN 0x4000
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* actions other than word types, see lexjava.dfa */
+const static char * actions[] = {
+	"word", "wrong", "space", "newline", "colon", "question", "skip",
+	"unicode",
+};
+
+/* state type */
+struct state_t
+{
+	char name[MAX_NAME];
+	char accept[MAX_NAME];      /* accept action, empty if none */
+	int idle;
+	int run;                    /* DFA_RUN_STOP or DFA_RUN_STAY if run */
+	int run_count;              /* number of stops, or range bounds */
+	unsigned char run_bytes[MAX_RANGES * 2];
+	int line;                   /* line number of declaration */
+	/* transitions on each character, with their targets not resolved */
+	int targets[256];
+	int lines[256];
+	int defined[256];
+};
+
+/* keyword type */
+struct keyword_t
+{
+	char spelling[MAX_NAME];
+	char type[MAX_NAME];        /* word type of lexjava.h */
+	unsigned int hash;
+	int slot;
+};
+
+/* names of targets, resolved after all states are declared */
+static char (* target_names)[MAX_NAME];
+static int target_count, target_capacity;
+
+static struct state_t * states;
+static int state_count, state_capacity;
+
+static struct keyword_t * keywords;
+static int keyword_count, keyword_capacity;
+
+/* parameters of the keyword hash, see hash_keyword() */
+static unsigned int keyword_seed;
+static int keyword_second, keyword_min, keyword_max;
+static int * keyword_disp;
+static int keyword_buckets;
+
+static const char * spec_name;
+
+static int parse_state(char * line, int lineno);
+static int parse_transition(char * line, int lineno);
+static int parse_keywords(char * line, int lineno);
+static char * next_token(char ** line, int lineno);
+static int parse_set(const char * token, int set[256], int lineno);
+static int parse_char(const char ** p, int lineno);
+static int add_target(const char * name);
+static int find_state(const char * name);
+static int resolve(void);
+static int resolve_run(struct state_t * state, int index);
+static int build_hash(void);
+static int try_seed(int * order, int * used, int * sizes);
+static unsigned int hash_keyword(unsigned int seed, const char * word,
+	size_t length);
+static void write_table(FILE * out);
+static void write_keywords(FILE * out);
+static void print_error(int lineno, const char * message, const char * arg);
+
+/*
+ * entry
+ */
+int main(int argc, char * argv[])
+{
+	FILE * fp1 = NULL, * fp2 = NULL;
+	const char * usage = "Usage: mkdfa <SPEC> <OUTPUT>\n";
+	char line[BUF_SIZE];
+	char err_msg[BUF_SIZE];
+	char * p;
+	int lineno = 0;
+
+	if (argc != 3) {
+		fprintf(stderr, "%s", usage);
+		goto error;
+	}
+	spec_name = argv[1];
+
+	/* open spec file */
+	if ((fp1 = fopen(argv[1], "r")) == NULL) {
+		snprintf(err_msg, BUF_SIZE, "mkdfa: cannot open '%s'", argv[1]);
+		perror(err_msg);
+		goto error;
+	}
+
+	/* read states and transitions line by line */
+	while (fgets(line, BUF_SIZE, fp1) != NULL) {
+		++lineno;
+		for (p = line; isspace((unsigned char)*p); ++p);
+		if (*p == '\0' || *p == '#') {
+			continue;
+		}
+		if (strncmp(p, "state", 5) == 0 &&
+			isspace((unsigned char)p[5])) {
+			if (parse_state(p + 5, lineno) != 0) {
+				goto error;
+			}
+		} else if (strncmp(p, "keyword", 7) == 0 &&
+			isspace((unsigned char)p[7])) {
+			if (parse_keywords(p + 7, lineno) != 0) {
+				goto error;
+			}
+		} else if (parse_transition(p, lineno) != 0) {
+			goto error;
+		}
+	}
+	if (state_count == 0) {
+		print_error(0, "no state is declared", NULL);
+		goto error;
+	}
+	if (keyword_count == 0) {
+		print_error(0, "no keyword is declared", NULL);
+		goto error;
+	}
+	if (resolve() != 0 || build_hash() != 0) {
+		goto error;
+	}
+
+	/* write the table */
+	if ((fp2 = fopen(argv[2], "w")) == NULL) {
+		snprintf(err_msg, BUF_SIZE, "mkdfa: cannot open '%s'", argv[2]);
+		perror(err_msg);
+		goto error;
+	}
+	write_table(fp2);
+
+	fclose(fp1);
+	if (fclose(fp2) != 0) {
+		fp1 = fp2 = NULL;
+		snprintf(err_msg, BUF_SIZE, "mkdfa: cannot write '%s'",
+			argv[2]);
+		perror(err_msg);
+		goto error;
+	}
+	free(states);
+	free(target_names);
+	free(keywords);
+	free(keyword_disp);
+	return 0;
+
+error:
+	if (fp1 != NULL) {
+		fclose(fp1);
+	}
+	if (fp2 != NULL) {
+		fclose(fp2);
+		remove(argv[2]);
+	}
+	free(states);
+	free(target_names);
+	free(keywords);
+	free(keyword_disp);
+	return 1;
+}
+
+/*
+ * parse a state declaration
+ *
+ * @line: the declaration after 'state'
+ * @lineno: line number in spec
+ *
+ * return: 0 on success, -1 on error
+ */
+static int parse_state(char * line, int lineno)
+{
+	struct state_t * state;
+	char * token;
+
+	if (state_count == MAX_STATES) {
+		print_error(lineno, "too many states", NULL);
+		return -1;
+	}
+	if (state_count == state_capacity) {
+		state_capacity = state_capacity ? state_capacity << 1 : 64;
+		state = realloc(states, state_capacity * sizeof(*states));
+		if (state == NULL) {
+			print_error(lineno, "out of memory", NULL);
+			return -1;
+		}
+		states = state;
+	}
+	state = &states[state_count];
+	memset(state, 0, sizeof(*state));
+	state->line = lineno;
+
+	if ((token = next_token(&line, lineno)) == NULL) {
+		print_error(lineno, "state name expected", NULL);
+		return -1;
+	}
+	if (strlen(token) >= MAX_NAME) {
+		print_error(lineno, "name too long", token);
+		return -1;
+	}
+	if (find_state(token) >= 0) {
+		print_error(lineno, "state declared twice", token);
+		return -1;
+	}
+	strcpy(state->name, token);
+
+	while ((token = next_token(&line, lineno)) != NULL) {
+		if (strcmp(token, "idle") == 0) {
+			state->idle = 1;
+		} else if (strcmp(token, "run") == 0) {
+			state->run = 1;
+		} else if (strcmp(token, "accept") == 0 &&
+			(token = next_token(&line, lineno)) != NULL &&
+			strlen(token) < MAX_NAME) {
+			strcpy(state->accept, token);
+		} else {
+			print_error(lineno, "bad state declaration", token);
+			return -1;
+		}
+	}
+
+	++state_count;
+	return 0;
+}
+
+/*
+ * parse a transition of the last declared state
+ *
+ * @line: the transition
+ * @lineno: line number in spec
+ *
+ * return: 0 on success, -1 on error
+ */
+static int parse_transition(char * line, int lineno)
+{
+	struct state_t * state;
+	int set[256];
+	char * token;
+	int target, newline = 0;
+	int c;
+
+	if (state_count == 0) {
+		print_error(lineno, "transition outside a state", NULL);
+		return -1;
+	}
+	state = &states[state_count - 1];
+
+	if ((token = next_token(&line, lineno)) == NULL ||
+		parse_set(token, set, lineno) != 0) {
+		return -1;
+	}
+	if ((token = next_token(&line, lineno)) == NULL) {
+		print_error(lineno, "target expected", NULL);
+		return -1;
+	}
+	if (strcmp(token, "accept") == 0) {
+		target = 0;
+	} else if ((target = add_target(token)) < 0) {
+		print_error(lineno, "bad target", token);
+		return -1;
+	}
+	if ((token = next_token(&line, lineno)) != NULL) {
+		if (strcmp(token, "line") != 0 || target == 0 ||
+			next_token(&line, lineno) != NULL) {
+			print_error(lineno, "bad transition", token);
+			return -1;
+		}
+		newline = 1;
+	}
+
+	/* the first transition matching a character wins */
+	for (c = 0; c < 256; ++c) {
+		if (set[c] && !state->defined[c]) {
+			state->defined[c] = lineno;
+			state->targets[c] = target;
+			state->lines[c] = newline;
+		}
+	}
+	return 0;
+}
+
+/*
+ * parse a keyword declaration
+ *
+ * @line: the declaration after 'keyword'
+ * @lineno: line number in spec
+ *
+ * return: 0 on success, -1 on error
+ */
+static int parse_keywords(char * line, int lineno)
+{
+	struct keyword_t * keyword;
+	char * type, * token;
+	int i;
+
+	if ((type = next_token(&line, lineno)) == NULL ||
+		!isupper((unsigned char)type[0]) || strlen(type) >= MAX_NAME) {
+		print_error(lineno, "word type expected", type);
+		return -1;
+	}
+
+	while ((token = next_token(&line, lineno)) != NULL) {
+		if (strlen(token) >= MAX_NAME) {
+			print_error(lineno, "keyword too long", token);
+			return -1;
+		}
+		for (i = 0; i < keyword_count; ++i) {
+			if (strcmp(keywords[i].spelling, token) == 0) {
+				print_error(lineno, "keyword declared twice",
+					token);
+				return -1;
+			}
+		}
+		if (keyword_count == keyword_capacity) {
+			keyword_capacity = keyword_capacity ?
+				keyword_capacity << 1 : 64;
+			keyword = realloc(keywords,
+				keyword_capacity * sizeof(*keywords));
+			if (keyword == NULL) {
+				print_error(lineno, "out of memory", NULL);
+				return -1;
+			}
+			keywords = keyword;
+		}
+		keyword = &keywords[keyword_count++];
+		strcpy(keyword->spelling, token);
+		strcpy(keyword->type, type);
+	}
+	return 0;
+}
+
+/*
+ * get next token of a line, where a quoted character or a set may contain
+ * spaces, and a '#' starts a comment
+ *
+ * @line: a pointer to the rest of the line, moved past the token
+ * @lineno: line number in spec
+ *
+ * return: the token terminated, NULL if there is no more token
+ */
+static char * next_token(char ** line, int lineno)
+{
+	char * p = *line, * token;
+	char close = 0;
+
+	while (isspace((unsigned char)*p)) {
+		++p;
+	}
+	if (*p == '\0' || *p == '#') {
+		*line = p;
+		return NULL;
+	}
+
+	token = p;
+	if (*p == '\'') {
+		close = '\'';
+	} else if (*p == '[') {
+		close = ']';
+	}
+	if (close) {
+		for (++p; *p != '\0' && *p != close; ++p) {
+			if (*p == '\\' && p[1] != '\0') {
+				++p;
+			}
+		}
+		if (*p == close) {
+			++p;
+		}
+	} else {
+		while (*p != '\0' && !isspace((unsigned char)*p)) {
+			++p;
+		}
+	}
+
+	if (*p != '\0') {
+		*p++ = '\0';
+	}
+	*line = p;
+	return token;
+}
+
+/*
+ * parse a set of characters, which is 'c', [...] or any
+ *
+ * @token: the set
+ * @set: an array to mark the characters in the set
+ * @lineno: line number in spec
+ *
+ * return: 0 on success, -1 on error
+ */
+static int parse_set(const char * token, int set[256], int lineno)
+{
+	const char * p = token + 1;
+	int c, last;
+
+	memset(set, 0, 256 * sizeof(int));
+
+	if (strcmp(token, "any") == 0) {
+		for (c = 0; c < 256; ++c) {
+			set[c] = 1;
+		}
+		return 0;
+	}
+
+	if (token[0] == '\'') {
+		if ((c = parse_char(&p, lineno)) < 0 || strcmp(p, "'") != 0) {
+			print_error(lineno, "bad character", token);
+			return -1;
+		}
+		set[c] = 1;
+		return 0;
+	}
+
+	if (token[0] == '[') {
+		while (*p != ']' && *p != '\0') {
+			if ((c = parse_char(&p, lineno)) < 0) {
+				return -1;
+			}
+			/* a '-' not at either end makes a range */
+			last = c;
+			if (p[0] == '-' && p[1] != ']' && p[1] != '\0') {
+				++p;
+				if ((last = parse_char(&p, lineno)) < c) {
+					print_error(lineno, "bad range", token);
+					return -1;
+				}
+			}
+			for (; c <= last; ++c) {
+				set[c] = 1;
+			}
+		}
+		if (strcmp(p, "]") != 0) {
+			print_error(lineno, "bad set", token);
+			return -1;
+		}
+		return 0;
+	}
+
+	print_error(lineno, "characters expected", token);
+	return -1;
+}
+
+/*
+ * parse a character of a set, which may be escaped as in C
+ *
+ * @p: a pointer to the character, moved past it
+ * @lineno: line number in spec
+ *
+ * return: the character, -1 on error
+ */
+static int parse_char(const char ** p, int lineno)
+{
+	int c = (unsigned char)*(*p)++, i, d;
+
+	if (c != '\\') {
+		return c ? c : -1;
+	}
+
+	switch (c = (unsigned char)*(*p)++) {
+	case 't':
+		return '\t';
+
+	case 'r':
+		return '\r';
+
+	case 'n':
+		return '\n';
+
+	case '\\': case '\'': case '\"': case '[': case ']': case '-':
+		return c;
+
+	/* a byte in 2 hex digits */
+	case 'x':
+		for (c = i = 0; i < 2; ++i) {
+			d = (unsigned char)*(*p)++;
+			if (!isxdigit(d)) {
+				print_error(lineno, "bad escape", NULL);
+				return -1;
+			}
+			c = c << 4 | (isdigit(d) ? d - '0' : tolower(d) - 'a' + 10);
+		}
+		return c;
+
+	default:
+		print_error(lineno, "bad escape", NULL);
+		return -1;
+	}
+}
+
+/*
+ * get the index of a target name, adding it if not seen
+ *
+ * @name: target name
+ *
+ * return: index + 1, -1 on error
+ */
+static int add_target(const char * name)
+{
+	char (* names)[MAX_NAME];
+	int i;
+
+	if (strlen(name) >= MAX_NAME) {
+		return -1;
+	}
+	for (i = 0; i < target_count; ++i) {
+		if (strcmp(target_names[i], name) == 0) {
+			return i + 1;
+		}
+	}
+	if (target_count == target_capacity) {
+		target_capacity = target_capacity ? target_capacity << 1 : 64;
+		names = realloc(target_names,
+			target_capacity * sizeof(*target_names));
+		if (names == NULL) {
+			return -1;
+		}
+		target_names = names;
+	}
+	strcpy(target_names[target_count], name);
+	return ++target_count;
+}
+
+/*
+ * find a state by name
+ *
+ * @name: state name
+ *
+ * return: index of the state, -1 if not found
+ */
+static int find_state(const char * name)
+{
+	int i;
+
+	for (i = 0; i < state_count; ++i) {
+		if (strcmp(states[i].name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * resolve targets into states, and check that every state either has a
+ * transition or an accept action on every character, and that every run state
+ * can be run
+ *
+ * return: 0 on success, -1 on error
+ */
+static int resolve(void)
+{
+	struct state_t * state;
+	int i, c, target;
+	int j, found;
+
+	for (i = 0; i < state_count; ++i) {
+		state = &states[i];
+
+		if (state->accept[0] != '\0' &&
+			!isupper((unsigned char)state->accept[0])) {
+			for (j = 0, found = 0; j < ARRAY_SIZE(actions); ++j) {
+				found |= strcmp(state->accept, actions[j]) == 0;
+			}
+			if (!found) {
+				print_error(state->line, "unknown action",
+					state->accept);
+				return -1;
+			}
+		}
+
+		for (c = 0; c < 256; ++c) {
+			if (state->targets[c] == 0) {
+				if (state->accept[0] == '\0') {
+					print_error(state->line,
+						"no transition nor accept "
+						"action in state",
+						state->name);
+					return -1;
+				}
+				continue;
+			}
+			target = find_state(
+				target_names[state->targets[c] - 1]);
+			if (target < 0) {
+				print_error(state->defined[c],
+					"undeclared state",
+					target_names[state->targets[c] - 1]);
+				return -1;
+			}
+			state->targets[c] = (target + 1) |
+				(state->lines[c] ? LINE : 0) |
+				(states[target].run ? RUN : 0);
+		}
+	}
+
+	for (i = 0; i < state_count; ++i) {
+		if (states[i].run && resolve_run(&states[i], i) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * find the characters a run state stops at, or the ranges it stays in
+ *
+ * @state: run state, whose transitions are resolved
+ * @index: index of the state
+ *
+ * return: 0 on success, -1 if the state cannot be run
+ */
+static int resolve_run(struct state_t * state, int index)
+{
+	int stay[256];
+	int c, stops = 0, ranges = 0;
+
+	/* a run stays only by transitions to itself not meeting a newline */
+	for (c = 0; c < 256; ++c) {
+		stay[c] = (state->targets[c] & ~RUN) == index + 1;
+		stops += !stay[c];
+		ranges += stay[c] && (c == 0 || !stay[c - 1]);
+	}
+	if (stops == 256 || stops == 0 ||
+		(stops > MAX_STOPS && ranges > MAX_RANGES)) {
+		print_error(state->line, "cannot run state", state->name);
+		return -1;
+	}
+
+	state->run_count = 0;
+	if (stops <= MAX_STOPS) {
+		state->run = 1;
+		for (c = 0; c < 256; ++c) {
+			if (!stay[c]) {
+				state->run_bytes[state->run_count++] = c;
+			}
+		}
+	} else {
+		state->run = 2;
+		for (c = 0; c < 256; ++c) {
+			if (stay[c] && (c == 0 || !stay[c - 1])) {
+				state->run_bytes[state->run_count++] = c;
+			}
+			if (stay[c] && (c == 255 || !stay[c + 1])) {
+				state->run_bytes[state->run_count++] = c;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * build a minimal perfect hash of keywords by hash and displace
+ * a keyword is hashed into a bucket, and every bucket has a displacement to
+ * move its keywords into free slots, while a seed is tried one by one until
+ * all buckets fit
+ *
+ * return: 0 on success, -1 on error
+ */
+static int build_hash(void)
+{
+	int * order, * used, * sizes;
+	size_t length;
+	int i, ret = -1;
+
+	keyword_min = MAX_NAME;
+	keyword_max = 0;
+	for (i = 0; i < keyword_count; ++i) {
+		length = strlen(keywords[i].spelling);
+		keyword_min = length < keyword_min ? length : keyword_min;
+		keyword_max = length > keyword_max ? length : keyword_max;
+	}
+	keyword_second = keyword_min > 1;
+	keyword_buckets = (keyword_count + 1) / 2;
+
+	order = malloc(keyword_count * sizeof(*order));
+	used = malloc(keyword_count * sizeof(*used));
+	sizes = malloc(keyword_buckets * sizeof(*sizes));
+	keyword_disp = malloc(keyword_buckets * sizeof(*keyword_disp));
+	if (order == NULL || used == NULL || sizes == NULL ||
+		keyword_disp == NULL) {
+		print_error(0, "out of memory", NULL);
+		goto out;
+	}
+
+	for (keyword_seed = 0; keyword_seed < MAX_SEEDS; ++keyword_seed) {
+		if (try_seed(order, used, sizes) == 0) {
+			ret = 0;
+			goto out;
+		}
+	}
+	print_error(0, "cannot find a perfect hash of keywords", NULL);
+
+out:
+	free(order);
+	free(used);
+	free(sizes);
+	return ret;
+}
+
+/*
+ * try to fit all buckets with current seed, larger buckets first
+ *
+ * @order: an array to sort keywords by bucket
+ * @used: an array to mark used slots
+ * @sizes: an array to count keywords in each bucket
+ *
+ * return: 0 on success, -1 if current seed does not fit
+ */
+static int try_seed(int * order, int * used, int * sizes)
+{
+	struct keyword_t * keyword;
+	int i, j, n, size, bucket, disp;
+
+	for (i = 0; i < keyword_count; ++i) {
+		keyword = &keywords[i];
+		keyword->hash = hash_keyword(keyword_seed, keyword->spelling,
+			strlen(keyword->spelling));
+		used[i] = 0;
+	}
+	memset(sizes, 0, keyword_buckets * sizeof(*sizes));
+	for (i = 0; i < keyword_count; ++i) {
+		++sizes[keywords[i].hash % keyword_buckets];
+	}
+
+	/* sort keywords by size of bucket, then by bucket */
+	n = 0;
+	for (size = keyword_count; size > 0; --size) {
+		for (bucket = 0; bucket < keyword_buckets; ++bucket) {
+			if (sizes[bucket] != size) {
+				continue;
+			}
+			for (i = 0; i < keyword_count; ++i) {
+				if (keywords[i].hash % keyword_buckets ==
+					bucket) {
+					order[n++] = i;
+				}
+			}
+		}
+	}
+
+	for (bucket = 0; bucket < keyword_buckets; ++bucket) {
+		keyword_disp[bucket] = 0;
+	}
+
+	/* find a displacement for each bucket in order */
+	for (i = 0; i < keyword_count; i = j) {
+		bucket = keywords[order[i]].hash % keyword_buckets;
+		for (j = i; j < keyword_count &&
+			keywords[order[j]].hash % keyword_buckets == bucket;
+			++j);
+
+		for (disp = 0; disp < keyword_count; ++disp) {
+			for (n = i; n < j; ++n) {
+				keyword = &keywords[order[n]];
+				keyword->slot = ((keyword->hash >> 16) + disp) %
+					keyword_count;
+				if (used[keyword->slot]) {
+					break;
+				}
+				used[keyword->slot] = 1;
+			}
+			if (n == j) {
+				break;
+			}
+			/* undo the slots taken by this try */
+			while (n-- > i) {
+				used[keywords[order[n]].slot] = 0;
+			}
+		}
+		if (disp == keyword_count) {
+			return -1;
+		}
+		keyword_disp[bucket] = disp;
+	}
+	return 0;
+}
+
+/*
+ * hash a keyword by its length, its first, second and last characters, which
+ * has to be the same as dfa_keyword() in lexdfa.h
+ *
+ * @seed: seed of hash
+ * @word: word to hash
+ * @length: length of word, no less than keyword_min
+ *
+ * return: hash value
+ */
+static unsigned int hash_keyword(unsigned int seed, const char * word,
+	size_t length)
+{
+	const unsigned char * p = (const unsigned char *)word;
+	unsigned int hash = 2166136261u ^ seed;
+
+	hash = (hash ^ (unsigned int)length) * 16777619u;
+	hash = (hash ^ p[0]) * 16777619u;
+	hash = (hash ^ p[keyword_second]) * 16777619u;
+	hash = (hash ^ p[length - 1]) * 16777619u;
+	return hash;
+}
+
+/*
+ * write the table as a C header, where characters having the same transitions
+ * in every state are merged into a class
+ *
+ * @out: output file
+ */
+static void write_table(FILE * out)
+{
+	int classes[256];
+	int members[256];
+	int class_count = 0;
+	int i, j, c, target;
+	char name[MAX_NAME];
+
+	/* find character classes */
+	for (c = 0; c < 256; ++c) {
+		for (j = 0; j < class_count; ++j) {
+			for (i = 0; i < state_count; ++i) {
+				if (states[i].targets[c] !=
+					states[i].targets[members[j]]) {
+					break;
+				}
+			}
+			if (i == state_count) {
+				break;
+			}
+		}
+		if (j == class_count) {
+			members[class_count++] = c;
+		}
+		classes[c] = j;
+	}
+
+	fprintf(out, "/*\n * lexdfa.h - transition table of Java scanner\n"
+		" *\n * generated by mkdfa from %s, do not edit\n */\n\n",
+		spec_name);
+	fprintf(out, "#ifndef LEXDFA_H\n#define LEXDFA_H\n\n");
+	fprintf(out, "#define DFA_STATES %d\n", state_count);
+	fprintf(out, "#define DFA_CLASSES %d\n\n", class_count);
+	fprintf(out, "/*\n * a transition meeting a newline, to a run state, or "
+		"no transition\n */\n");
+	fprintf(out, "#define DFA_LINE 0x%x\n", LINE);
+	fprintf(out, "#define DFA_RUN 0x%x\n", RUN);
+	fprintf(out, "#define DFA_ACCEPT 0x%x\n", 0xffff);
+	fprintf(out, "#define DFA_STATE_MASK 0x%x\n\n", RUN - 1);
+	fprintf(out, "#define DFA_RUN_BYTES %d\n\n", MAX_RANGES * 2);
+
+	/* state names */
+	fprintf(out, "/* states */\nenum\n{\n");
+	for (i = 0; i < state_count; ++i) {
+		for (j = 0; states[i].name[j] != '\0'; ++j) {
+			name[j] = toupper((unsigned char)states[i].name[j]);
+		}
+		name[j] = '\0';
+		fprintf(out, "\tDFA_STATE_%s,\n", name);
+	}
+	fprintf(out, "};\n\n");
+
+	/* actions */
+	fprintf(out, "/* accept actions other than word types */\nenum\n{\n");
+	for (i = 0; i < ARRAY_SIZE(actions); ++i) {
+		for (j = 0; actions[i][j] != '\0'; ++j) {
+			name[j] = toupper((unsigned char)actions[i][j]);
+		}
+		name[j] = '\0';
+		fprintf(out, "\tDFA_%s%s,\n", name, i ? "" : " = 1");
+	}
+	fprintf(out, "};\n\n");
+
+	/* character classes */
+	fprintf(out, "/* character class of each character */\n");
+	fprintf(out, "const static unsigned char dfa_class[256] = {");
+	for (c = 0; c < 256; ++c) {
+		fprintf(out, "%s%d,", c % 16 ? " " : "\n\t", classes[c]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	/* transitions */
+	fprintf(out, "/* next state of each state and character class */\n");
+	fprintf(out, "const static unsigned short "
+		"dfa_next[DFA_STATES][DFA_CLASSES] = {\n");
+	for (i = 0; i < state_count; ++i) {
+		fprintf(out, "\t/* %s */\n\t{", states[i].name);
+		for (j = 0; j < class_count; ++j) {
+			target = states[i].targets[members[j]];
+			if (target == 0) {
+				fprintf(out, "%sDFA_ACCEPT,",
+					j % 8 ? " " : "\n\t\t");
+			} else {
+				fprintf(out, "%s0x%04x,",
+					j % 8 ? " " : "\n\t\t",
+					(target & (LINE | RUN)) |
+					((target & ~(LINE | RUN)) - 1));
+			}
+		}
+		fprintf(out, "\n\t},\n");
+	}
+	fprintf(out, "};\n\n");
+
+	/* accept actions */
+	fprintf(out, "/* accept action of each state, 0 if none */\n");
+	fprintf(out, "const static int dfa_accept[DFA_STATES] = {\n");
+	for (i = 0; i < state_count; ++i) {
+		if (states[i].accept[0] == '\0') {
+			strcpy(name, "0");
+		} else if (isupper((unsigned char)states[i].accept[0])) {
+			strcpy(name, states[i].accept);
+		} else {
+			strcpy(name, "DFA_");
+			for (j = 0; states[i].accept[j] != '\0'; ++j) {
+				name[j + 4] = toupper(
+					(unsigned char)states[i].accept[j]);
+			}
+			name[j + 4] = '\0';
+		}
+		fprintf(out, "\t/* %s */ %s,\n", states[i].name, name);
+	}
+	fprintf(out, "};\n\n");
+
+	/* idle states */
+	fprintf(out, "/* whether a state has no word in progress */\n");
+	fprintf(out, "const static unsigned char dfa_idle[DFA_STATES] = {");
+	for (i = 0; i < state_count; ++i) {
+		fprintf(out, "%s%d,", i % 16 ? " " : "\n\t", states[i].idle);
+	}
+	fprintf(out, "\n};\n\n");
+
+	/* run states */
+	fprintf(out, "/*\n * how a run state is run, either stopping at "
+		"characters, or staying in\n * ranges of characters\n */\n");
+	fprintf(out, "enum\n{\n\tDFA_RUN_NONE,\n\tDFA_RUN_STOP,\n"
+		"\tDFA_RUN_STAY,\n};\n\n");
+	fprintf(out, "struct dfa_run_t\n{\n\tint type;\n\tint count;\n"
+		"\tunsigned char bytes[DFA_RUN_BYTES];\n};\n\n");
+	fprintf(out, "const static struct dfa_run_t dfa_run[DFA_STATES] = {\n");
+	for (i = 0; i < state_count; ++i) {
+		fprintf(out, "\t/* %s */ { %d, %d, {", states[i].name,
+			states[i].run, states[i].run_count);
+		for (j = 0; j < states[i].run_count; ++j) {
+			fprintf(out, "%s0x%02x", j ? ", " : " ",
+				states[i].run_bytes[j]);
+		}
+		fprintf(out, "%s} },\n", states[i].run_count ? " " : "");
+	}
+	fprintf(out, "};\n\n");
+
+	write_keywords(out);
+	fprintf(out, "#endif /* LEXDFA_H */\n");
+}
+
+/*
+ * write keywords in order of their slots, and the function to find them
+ *
+ * @out: output file
+ */
+static void write_keywords(FILE * out)
+{
+	char name[MAX_NAME];
+	int i, j, slot;
+
+	fprintf(out, "/* keywords, see dfa_keyword() */\n");
+	fprintf(out, "#define DFA_KEYWORDS %d\n", keyword_count);
+	fprintf(out, "#define DFA_KEYWORD_BUCKETS %d\n\n", keyword_buckets);
+	fprintf(out, "struct dfa_keyword_t\n{\n\tconst char * spelling;\n"
+		"\tsize_t length;\n\tint type;\n\tint id;\n};\n\n");
+
+	fprintf(out, "const static struct dfa_keyword_t "
+		"dfa_keywords[DFA_KEYWORDS] = {\n");
+	for (slot = 0; slot < keyword_count; ++slot) {
+		for (i = 0; keywords[i].slot != slot; ++i);
+		for (j = 0; keywords[i].spelling[j] != '\0'; ++j) {
+			name[j] = toupper((unsigned char)keywords[i].spelling[j]);
+		}
+		name[j] = '\0';
+		fprintf(out, "\t{ \"%s\", %d, %s, KW_%s },\n",
+			keywords[i].spelling, (int)strlen(keywords[i].spelling),
+			keywords[i].type, name);
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "const static unsigned short "
+		"dfa_keyword_disp[DFA_KEYWORD_BUCKETS] = {");
+	for (i = 0; i < keyword_buckets; ++i) {
+		fprintf(out, "%s%d,", i % 16 ? " " : "\n\t", keyword_disp[i]);
+	}
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "/*\n * find a keyword by a minimal perfect hash of its "
+		"length, its first, second\n * and last characters\n *\n"
+		" * return: index in dfa_keywords, -1 if not a keyword\n */\n");
+	fprintf(out, "static inline int dfa_keyword(const char * word, "
+		"size_t length)\n{\n");
+	fprintf(out, "\tconst unsigned char * p = "
+		"(const unsigned char *)word;\n");
+	fprintf(out, "\tunsigned int hash = 0x%08xu;\n\tint slot;\n\n",
+		2166136261u ^ keyword_seed);
+	fprintf(out, "\tif (length < %d || length > %d) {\n\t\treturn -1;"
+		"\n\t}\n", keyword_min, keyword_max);
+	fprintf(out, "\thash = (hash ^ (unsigned int)length) * 16777619u;\n");
+	fprintf(out, "\thash = (hash ^ p[0]) * 16777619u;\n");
+	fprintf(out, "\thash = (hash ^ p[%d]) * 16777619u;\n", keyword_second);
+	fprintf(out, "\thash = (hash ^ p[length - 1]) * 16777619u;\n");
+	fprintf(out, "\tslot = ((hash >> 16) + "
+		"dfa_keyword_disp[hash %% DFA_KEYWORD_BUCKETS]) %%\n"
+		"\t\tDFA_KEYWORDS;\n");
+	fprintf(out, "\tif (dfa_keywords[slot].length == length &&\n"
+		"\t\tmemcmp(dfa_keywords[slot].spelling, word, length) == 0) "
+		"{\n\t\treturn slot;\n\t}\n\treturn -1;\n}\n\n");
+}
+
+/*
+ * print an error in spec
+ *
+ * @lineno: line number in spec, 0 if none
+ * @message: error message
+ * @arg: what is wrong, NULL if none
+ */
+static void print_error(int lineno, const char * message, const char * arg)
+{
+	if (lineno) {
+		fprintf(stderr, "mkdfa: %s:%d: %s", spec_name, lineno, message);
+	} else {
+		fprintf(stderr, "mkdfa: %s: %s", spec_name, message);
+	}
+	if (arg != NULL) {
+		fprintf(stderr, " '%s'", arg);
+	}
+	fputc('\n', stderr);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
@@ -32,11 +32,22 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* checker and translator definitions, see line 573 for more details */
-#define DEFINE_CHECK(N) static int check_##N(FILE * src)
-#define DEFINE_TRANSLATE(N) static void translate_##N(FILE * src, FILE * out)
-#define DEFINE_TRANSLATE_RETURN(N) static int translate_##N(FILE * src,\
+#include "lexjava.h"
+
+#ifdef USE_THREADS
+# include <sched.h>
+# include <stdatomic.h>
+#endif /* USE_THREADS */
+
+/*
+ * checker and translator definitions, see the checkers and translators section
+ * for more details
+ */
+#define DEFINE_CHECK(N) static int check_##N(struct source_t * src)
+#define DEFINE_TRANSLATE(N) static void translate_##N(struct source_t * src,\
 	FILE * out)
+#define DEFINE_TRANSLATE_RETURN(N) static int translate_##N(\
+	struct source_t * src, FILE * out)
 #define CALL_CHECK(N, src) check_##N(src)
 #define CALL_TRANSLATE(N, src, out) translate_##N(src, out)
 
@@ -46,6 +57,9 @@
 #define BUF_SIZE 512
 #define STACK_SIZE BUF_SIZE
 
+/* number of slots in the token ring, must be a power of 2 */
+#define RING_SIZE 1024
+
 /* get the size of an array, maybe defined */
 #ifndef ARRAY_SIZE
 # define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
@@ -55,37 +69,9 @@
 extern "C" {
 #endif /* __cplusplus */
 
-/* attribute list */
+/* attribute list in addition to the one in lexjava.h */
 enum
 {
-	WRONG          = 0x101,
-	SPACE          = 0x102,
-	KEYWORD        = 0x103,
-	IDENTIFIER     = 0x104,
-	BOOLEAN        = 0x105,
-	CHAR           = 0x106,
-	INT            = 0x107,
-	FLOAT          = 0x108,
-	STRING         = 0x109,
-	ASSIGN         = 0x110,
-	CONDITION      = 0x111,
-	LOGIC_OR       = 0x112,
-	LOGIC_AND      = 0x113,
-	BIT_OR         = 0x114,
-	XOR            = 0x115,
-	BIT_AND        = 0x116,
-	EQUAL          = 0x117,
-	COMPARE        = 0x118,
-	SHIFT          = 0x119,
-	ADD_SUB        = 0x11a,
-	MUL_DIV        = 0x11b,
-	PLUSPLUS       = 0x11c,
-	BRACKET_DOT    = 0x11d,
-	/* here is a chasm */
-	COMMA          = 0x120,
-	BIG_BRACKET    = 0x121,
-	SEMICOLON      = 0x122,
-	COLON          = 0x123, /* in addition */
 	REGISTER       = 0x124, /* in addition */
 };
 
@@ -103,6 +89,62 @@ struct stack_t
 	struct word_t words[STACK_SIZE];
 };
 
+#ifdef USE_THREADS
+/*
+ * token ring type, a bounded lock-free queue with a scanner thread as the
+ * only producer and the parser as the only consumer
+ */
+struct ring_t
+{
+	_Alignas(64) atomic_size_t head; /* next slot to take */
+	_Alignas(64) atomic_size_t tail; /* next slot to fill */
+	atomic_int stop;                 /* set when the parser gives up */
+	struct word_t words[RING_SIZE];
+};
+
+/* scanner thread type */
+struct scanner_t
+{
+	pthread_t thread;
+	FILE * fp;
+	struct ring_t ring;
+};
+#endif /* USE_THREADS */
+
+/* string table type, strings kept in a pool and referred to by index */
+struct strings_t
+{
+	size_t * offsets;      /* offsets of strings in pool */
+	size_t count;
+	size_t capacity;       /* capacity of offsets */
+	char * pool;
+	size_t length;         /* length of pool */
+	size_t size;           /* capacity of pool */
+};
+
+/*
+ * word source type
+ * words are read either from a lexical analysis output file, in text or
+ * binary format, or from a token ring, in which case they are also kept so
+ * that the source can be rewound
+ */
+struct source_t
+{
+	FILE * fp;             /* lexical analysis output file, or NULL */
+	int binary;            /* whether the file is in binary format */
+	int positions;         /* whether words have position fields */
+	int numbers;           /* whether words have values of constants */
+	struct strings_t strings; /* interned strings, or symbols of text */
+#ifdef USE_THREADS
+	struct ring_t * ring;  /* token ring, or NULL */
+#endif /* USE_THREADS */
+	int * keys;            /* keys of words taken from the ring */
+	size_t key_capacity;   /* capacity of keys */
+	struct strings_t values; /* values of words taken from the ring */
+	size_t pos;            /* position of the next word to read */
+	int eof;               /* whether the end of the ring is reached */
+};
+
 /* global variable to store returned word */
 static struct word_t returned = {
 	.key = 0,
@@ -126,9 +168,25 @@ static int registers[] = {
 };
 
 /* word operations */
-static void get_word(FILE * src, struct word_t * ret);
+static void get_word(struct source_t * src, struct word_t * ret);
+static int take_word(struct source_t * src, struct word_t * ret);
+static void get_binary_word(struct source_t * src, struct word_t * ret);
+static int skip_position(struct source_t * src, int expected);
+static int open_source(struct source_t * src, FILE * fp);
+static void rewind_source(struct source_t * src);
+static void free_source(struct source_t * src);
+static int read_varint(FILE * fp, size_t * value);
+static int read_string(FILE * fp, char * value, size_t length);
+static int read_number(FILE * fp, struct lex_number * number);
+static inline int spell_number(char * value,
+	const struct lex_number * number);
+static int add_string(struct strings_t * table, const char * string,
+	size_t length);
+static inline void copy_string(char * value, const struct strings_t * table,
+	size_t n);
 static inline int check_word(const struct word_t * word, int type,
 	const char * value);
+static inline int check_keyword(const struct word_t * word, int id);
 static inline void return_word(const struct word_t * word);
 
 /* stack operations */
@@ -144,9 +202,18 @@ static inline void free_register(int no);
 static inline int get_register_no(const char * name);
 static inline const char * get_register_name(int no);
 
-static int do_validate_lex(FILE * src);
-static int do_validate_grammar(FILE * src);
-static void do_parse(FILE * src, FILE * out);
+#ifdef USE_THREADS
+/* token ring operations */
+static void push_ring(struct ring_t * ring, int key, const char * value,
+	size_t length);
+static void pop_ring(struct ring_t * ring, struct word_t * word);
+static char * read_all(FILE * fp, size_t * size);
+static void * do_scan(void * arg);
+#endif /* USE_THREADS */
+
+static int do_validate_lex(struct source_t * src);
+static int do_validate_grammar(struct source_t * src);
+static void do_parse(struct source_t * src, FILE * out);
 
 DEFINE_CHECK(S);
 DEFINE_TRANSLATE_RETURN(S);
@@ -174,12 +241,25 @@ int main(int argc, char * const * argv)
 	FILE * fp1 = NULL, * fp2 = NULL;
 	const char * src = "scanner_output", * out = "parser_output";
 	const char * usage = "Usage: parse-java [SOURCE]\n"
+			     "       parse-java -l <JAVA SOURCE>\n"
 			     "If SOURCE is not specified, 'scanner_output' "
-			     "will be used\n\n";
+			     "will be used\n"
+			     "With -l, JAVA SOURCE is scanned in another thread "
+			     "instead\n\n";
 	char err_msg[BUF_SIZE];
-
-	/* restrict exactly 1 or 2 arguments */
-	if (argc > 2) {
+	struct source_t source;
+	int fused = 0;
+#ifdef USE_THREADS
+	struct scanner_t * scanner = NULL;
+#endif /* USE_THREADS */
+
+	memset(&source, 0, sizeof(source));
+
+	/* restrict exactly 1 or 2 arguments, or 3 with '-l' */
+	if (argc == 3 && strcmp(argv[1], "-l") == 0) {
+		fused = 1;
+		src = argv[2];
+	} else if (argc > 2) {
 		fprintf(stderr, "%s", usage);
 		goto error;
 	} else if (argc == 2) {
@@ -187,22 +267,50 @@ int main(int argc, char * const * argv)
 	}
 
 	/* open source file */
-	if ((fp1 = fopen(src, "r")) == NULL) {
+	if ((fp1 = fopen(src, "rb")) == NULL) {
 		snprintf(err_msg, BUF_SIZE, "parse-java: cannot open '%s'",
 			src);
 		perror(err_msg);
 		goto error;
 	}
 
+	if (!fused) {
+		if (open_source(&source, fp1) != 0) {
+			fprintf(stderr, "parse-java: invalid lexical analysis "
+				"output file\n");
+			goto error;
+		}
+	} else {
+#ifdef USE_THREADS
+		/* scan Java source in another thread */
+		if ((scanner = calloc(1, sizeof(struct scanner_t))) == NULL) {
+			perror("parse-java: cannot allocate scanner");
+			goto error;
+		}
+		scanner->fp = fp1;
+		if (pthread_create(&scanner->thread, NULL, do_scan,
+			scanner) != 0) {
+			perror("parse-java: cannot create thread");
+			free(scanner);
+			scanner = NULL;
+			goto error;
+		}
+		source.ring = &scanner->ring;
+#else
+		fprintf(stderr, "%s", usage);
+		goto error;
+#endif /* USE_THREADS */
+	}
+
 	/* do lexical validation */
-	if (!do_validate_lex(fp1)) {
+	if (!do_validate_lex(&source)) {
 		fprintf(stderr, "parse-java: invalid lexical analysis output "
 			"file\n");
 		goto error;
 	}
 
 	/* do grammar validation */
-	if (!do_validate_grammar(fp1)) {
+	if (!do_validate_grammar(&source)) {
 		fprintf(stderr, "parse-java: grammar error\n");
 		goto error;
 	}
@@ -216,13 +324,29 @@ int main(int argc, char * const * argv)
 	}
 
 	/* do parse */
-	do_parse(fp1, fp2);
+	do_parse(&source, fp2);
 
+#ifdef USE_THREADS
+	if (scanner != NULL) {
+		pthread_join(scanner->thread, NULL);
+		free(scanner);
+	}
+#endif /* USE_THREADS */
+	free_source(&source);
 	fclose(fp1);
 	fclose(fp2);
 	return 0;
 
 error:
+#ifdef USE_THREADS
+	if (scanner != NULL) {
+		/* let the scanner run to the end without blocking */
+		atomic_store(&scanner->ring.stop, 1);
+		pthread_join(scanner->thread, NULL);
+		free(scanner);
+	}
+#endif /* USE_THREADS */
+	free_source(&source);
 	if (fp1 != NULL) {
 		fclose(fp1);
 	}
@@ -237,13 +361,15 @@ error:
 /*
  * get the next K-V pair
  *
- * @src: a FILE pointer of Java lexical analysis output file
+ * @src: source of words
  * @ret: a pointer to struct word_t to store return value
  */
-static void get_word(FILE * src, struct word_t * ret)
+static void get_word(struct source_t * src, struct word_t * ret)
 {
 	char * word = NULL;
 	int attr;
+	size_t id;
+	struct lex_number number;
 	char buffer[BUF_SIZE];
 
 	/* first check if there is a previous returned word */
@@ -259,8 +385,17 @@ static void get_word(FILE * src, struct word_t * ret)
 
 	ret->key = 0;
 	ret->value[0] = '\0';
+	if (src->fp == NULL) {
+		take_word(src, ret);
+		return;
+	}
+	if (src->binary) {
+		get_binary_word(src, ret);
+		return;
+	}
+
 	while (1) {
-		if (fgets(buffer, BUF_SIZE, src) == NULL) {
+		if (fgets(buffer, BUF_SIZE, src->fp) == NULL) {
 			return;
 		}
 
@@ -269,22 +404,442 @@ static void get_word(FILE * src, struct word_t * ret)
 		if (strcmp(word, "line") == 0 || strcmp(word, "total") == 0) {
 			continue;
 		}
+
+		/* define the next symbol, see symbol sink in lexjava.h */
+		if (strcmp(word, "symbol") == 0) {
+			if ((word = strtok(NULL, " \t\r\n")) == NULL ||
+				strtoul(word, NULL, 10) != src->strings.count ||
+				(word = strtok(NULL, " \t\r\n")) == NULL) {
+				return;
+			}
+			if (add_string(&src->strings, word,
+				strlen(word)) != 0) {
+				perror("parse-java: cannot keep symbols");
+				exit(1);
+			}
+			continue;
+		}
+
 		attr = strtol(word, NULL, 16);
 		if (attr == SPACE) {
 			continue;
 		}
 
+		word = strtok(NULL, " \t\r\n");
+		if (attr == IDENTIFIER && word != NULL && word[0] == '#') {
+			/* an identifier given by its symbol ID */
+			id = strtoul(word + 1, NULL, 10);
+			if (id >= src->strings.count) {
+				return;
+			}
+			word = src->strings.pool + src->strings.offsets[id];
+		}
+		/* a word of a line or of a symbol is shorter than BUF_SIZE */
 		ret->key = attr;
-		strncpy(ret->value, strtok(NULL, " \t\r\n"), BUF_SIZE);
+		memcpy(ret->value, word, strlen(word) + 1);
+		if (attr == INT && do_number(word, strlen(word), INT,
+			&number) == 0) {
+			spell_number(ret->value, &number);
+		}
 		return;
 	}
 }
 
+/*
+ * take the next word from the words kept or from the token ring
+ *
+ * @src: source of words, which has no file
+ * @ret: a pointer to struct word_t to store the word
+ *
+ * return: 1 if a word is taken, 0 on EOF
+ */
+static int take_word(struct source_t * src, struct word_t * ret)
+{
+	void * p;
+
+	if (src->pos == src->values.count) {
+#ifdef USE_THREADS
+		if (src->eof || src->ring == NULL) {
+			return 0;
+		}
+		pop_ring(src->ring, ret);
+		if (ret->key == 0) {
+			src->eof = 1;
+			return 0;
+		}
+
+		/* keep the word for rewinding, keys grow along with values */
+		if (add_string(&src->values, ret->value,
+			strlen(ret->value)) != 0) {
+			goto nomem;
+		}
+		if (src->key_capacity < src->values.capacity) {
+			if ((p = realloc(src->keys, src->values.capacity *
+				sizeof(int))) == NULL) {
+				goto nomem;
+			}
+			src->keys = p;
+			src->key_capacity = src->values.capacity;
+		}
+		src->keys[src->values.count - 1] = ret->key;
+		++src->pos;
+		return 1;
+
+nomem:
+		perror("parse-java: cannot keep words");
+		exit(1);
+#else
+		return 0;
+#endif /* USE_THREADS */
+	}
+
+	ret->key = src->keys[src->pos];
+	copy_string(ret->value, &src->values, src->pos);
+	++src->pos;
+	return 1;
+}
+
+/*
+ * get the next word from a file in binary format, see lexjava.h
+ * spaces and counter records are skipped
+ *
+ * @src: source of words, which has a binary file
+ * @ret: a pointer to struct word_t to store the word, whose key is left 0 on
+ *       EOF or a broken file
+ */
+static void get_binary_word(struct source_t * src, struct word_t * ret)
+{
+	FILE * fp = src->fp;
+	int kind, expected = 0;
+	size_t n;
+	struct lex_number number;
+
+	while ((kind = getc(fp)) != EOF) {
+		if (src->positions) {
+			expected = kind & LEX_BIN_EXPECTED;
+			kind &= ~LEX_BIN_EXPECTED;
+		}
+		if (kind == LEX_BIN_LINE || kind == LEX_BIN_TOTAL) {
+			if (!read_varint(fp, &n)) {
+				return;
+			}
+			continue;
+		}
+
+		if (kind + 0x100 == KEYWORD || kind + 0x100 == IDENTIFIER ||
+			kind + 0x100 == BOOLEAN) {
+			if (!read_varint(fp, &n)) {
+				return;
+			}
+			if (n > src->strings.count) {
+				return;
+			}
+			if (n > 0) {
+				/* an interned string */
+				copy_string(ret->value, &src->strings, n - 1);
+				if (skip_position(src, expected)) {
+					ret->key = kind + 0x100;
+				}
+				return;
+			}
+			/* a new string to intern */
+			if (!read_varint(fp, &n) ||
+				!read_string(fp, ret->value, n)) {
+				return;
+			}
+			if (add_string(&src->strings, ret->value,
+				strlen(ret->value)) != 0) {
+				perror("parse-java: cannot keep strings");
+				exit(1);
+			}
+			if (skip_position(src, expected)) {
+				ret->key = kind + 0x100;
+			}
+			return;
+		}
+
+		if (!read_varint(fp, &n) || !read_string(fp, ret->value, n)) {
+			ret->value[0] = '\0';
+			return;
+		}
+		if (kind + 0x100 == WRONG && !read_varint(fp, &n)) {
+			return;
+		}
+		if ((kind + 0x100 == INT || kind + 0x100 == FLOAT) &&
+			src->numbers && !read_number(fp, &number)) {
+			return;
+		}
+		if (!skip_position(src, expected)) {
+			return;
+		}
+		if (kind + 0x100 == INT && (src->numbers ||
+			do_number(ret->value, strlen(ret->value), INT,
+			&number) == 0) && !(number.flags & LEX_NUMBER_BAD)) {
+			spell_number(ret->value, &number);
+		}
+		if (kind + 0x100 != SPACE) {
+			/*
+			 * unknown kinds are passed on, to fail lexical
+			 * validation
+			 */
+			ret->key = kind + 0x100;
+			return;
+		}
+	}
+	ret->value[0] = '\0';
+}
+
+/*
+ * skip the position field of a word in binary format, if it has one
+ *
+ * @src: source of words, which has a binary file
+ * @expected: whether the kind of word has LEX_BIN_EXPECTED
+ *
+ * return: 1 on success, 0 on EOF
+ */
+static int skip_position(struct source_t * src, int expected)
+{
+	size_t n;
+
+	if (!src->positions || expected) {
+		return 1;
+	}
+	if (!read_varint(src->fp, &n)) {
+		return 0;
+	}
+	/* a word on another line has line delta and column as well */
+	return !(n & 1) || (read_varint(src->fp, &n) &&
+		read_varint(src->fp, &n));
+}
+
+/*
+ * attach a lexical analysis output file to a source, detecting its format
+ *
+ * @src: source of words
+ * @fp: a FILE pointer of Java lexical analysis output file
+ *
+ * return: 0 on success, -1 if it is of an unknown binary format version
+ */
+static int open_source(struct source_t * src, FILE * fp)
+{
+	unsigned char header[LEX_BIN_HEADER_SIZE];
+
+	src->fp = fp;
+	if (fread(header, 1, LEX_BIN_HEADER_SIZE, fp) ==
+		LEX_BIN_HEADER_SIZE && memcmp(header, LEX_BIN_MAGIC, 4) == 0) {
+		if (header[4] != LEX_BIN_VERSION) {
+			return -1;
+		}
+		src->binary = 1;
+		src->positions = header[5] & LEX_BIN_POSITIONS;
+		src->numbers = header[5] & LEX_BIN_VALUES;
+	}
+	return 0;
+}
+
+/*
+ * rewind a source to its first word
+ *
+ * @src: source of words
+ */
+static void rewind_source(struct source_t * src)
+{
+	if (src->fp == NULL) {
+		src->pos = 0;
+	} else {
+		/* strings and symbols will be interned again */
+		if (src->binary) {
+			fseek(src->fp, LEX_BIN_HEADER_SIZE, SEEK_SET);
+		} else {
+			rewind(src->fp);
+		}
+		src->strings.count = 0;
+		src->strings.length = 0;
+	}
+}
+
+/*
+ * release memory held by a source, the file is left open
+ *
+ * @src: source of words
+ */
+static void free_source(struct source_t * src)
+{
+	free(src->strings.offsets);
+	free(src->strings.pool);
+	free(src->keys);
+	free(src->values.offsets);
+	free(src->values.pool);
+}
+
+/*
+ * read an unsigned LEB128 varint
+ *
+ * @fp: a FILE pointer to read from
+ * @value: a pointer to store the value
+ *
+ * return: 1 on success, 0 on EOF or overflow
+ */
+static int read_varint(FILE * fp, size_t * value)
+{
+	int c, shift = 0;
+
+	*value = 0;
+	while ((c = getc(fp)) != EOF && shift < sizeof(size_t) * 8) {
+		*value |= (size_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return 1;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+/*
+ * read a string of the given length, keeping at most BUF_SIZE - 1 bytes
+ *
+ * @fp: a FILE pointer to read from
+ * @value: buffer of BUF_SIZE to store the string
+ * @length: length of string
+ *
+ * return: 1 on success, 0 on EOF
+ */
+static int read_string(FILE * fp, char * value, size_t length)
+{
+	size_t n = length < BUF_SIZE ? length : BUF_SIZE - 1;
+
+	if (fread(value, 1, n, fp) != n) {
+		return 0;
+	}
+	value[n] = '\0';
+	for (; n < length; ++n) {
+		if (getc(fp) == EOF) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*
+ * read the value of an integer or floating constant in binary format, see
+ * lexjava.h
+ *
+ * @fp: a FILE pointer to read from
+ * @number: a pointer to store the value
+ *
+ * return: 1 on success, 0 on EOF
+ */
+static int read_number(FILE * fp, struct lex_number * number)
+{
+	uint64_t bits = 0;
+	size_t n;
+	int c, i;
+
+	if (!read_varint(fp, &n)) {
+		return 0;
+	}
+	number->flags = (int)n;
+	if (n & LEX_NUMBER_FLOAT) {
+		for (i = 0; i < 8; ++i) {
+			if ((c = getc(fp)) == EOF) {
+				return 0;
+			}
+			bits |= (uint64_t)c << i * 8;
+		}
+		memcpy(&number->real, &bits, sizeof(bits));
+		return 1;
+	}
+	if (!read_varint(fp, &n)) {
+		return 0;
+	}
+	/* zigzag, where an odd value is of a negative one */
+	bits = n >> 1;
+	number->integer = n & 1 ? ~(int64_t)bits : (int64_t)bits;
+	return 1;
+}
+
+/*
+ * spell an integer constant in decimal, as assemblers know none of the other
+ * spellings of Java, such as octal, binary, underscores and suffix 'L'
+ *
+ * @value: buffer of BUF_SIZE to store the spelling
+ * @number: value of constant
+ *
+ * return: length of spelling
+ */
+static inline int spell_number(char * value,
+	const struct lex_number * number)
+{
+	return snprintf(value, BUF_SIZE, "%lld", (long long)number->integer);
+}
+
+/*
+ * append a string to a string table
+ *
+ * @table: string table
+ * @string: string to append, not necessarily terminated
+ * @length: length of string
+ *
+ * return: 0 on success, -1 if out of memory
+ */
+static int add_string(struct strings_t * table, const char * string,
+	size_t length)
+{
+	size_t size;
+	void * p;
+
+	if (table->count == table->capacity) {
+		size = table->capacity ? table->capacity << 1 : 1024;
+		if ((p = realloc(table->offsets, size * sizeof(size_t))) ==
+			NULL) {
+			return -1;
+		}
+		table->offsets = p;
+		table->capacity = size;
+	}
+	if (table->length + length + 1 > table->size) {
+		size = table->size ? table->size : BUF_SIZE << 4;
+		while (table->length + length + 1 > size) {
+			size <<= 1;
+		}
+		if ((p = realloc(table->pool, size)) == NULL) {
+			return -1;
+		}
+		table->pool = p;
+		table->size = size;
+	}
+
+	table->offsets[table->count++] = table->length;
+	memcpy(table->pool + table->length, string, length);
+	table->pool[table->length + length] = '\0';
+	table->length += length + 1;
+	return 0;
+}
+
+/*
+ * copy a string of a string table, whose strings are all shorter than
+ * BUF_SIZE
+ *
+ * @value: buffer of BUF_SIZE to store the string
+ * @table: string table
+ * @n: index of string
+ */
+static inline void copy_string(char * value, const struct strings_t * table,
+	size_t n)
+{
+	size_t end = n + 1 < table->count ? table->offsets[n + 1] :
+		table->length;
+
+	/* the terminator is copied along */
+	memcpy(value, table->pool + table->offsets[n],
+		end - table->offsets[n]);
+}
+
 /*
  * check a word of the given type and value
  *
  * @word: a pointer to struct word_t
- * @type: attribute key, see line 54
+ * @type: attribute key, see attribute list in lexjava.h
  * @value: value of the word, can be NULL
  *
  * return: 1 if valid, 0 otherwise
@@ -304,6 +859,20 @@ invalid:
 	return 0;
 }
 
+/*
+ * check a keyword of the given ID
+ *
+ * @word: a pointer to struct word_t
+ * @id: keyword ID, see keyword ID list in lexjava.h
+ *
+ * return: 1 if valid, 0 otherwise
+ */
+static inline int check_keyword(const struct word_t * word, int id)
+{
+	return word->key == KEYWORD &&
+		do_keyword(word->value, strlen(word->value)) == id;
+}
+
 /*
  * pretend to return a word to the file stream (only one word supported)
  *
@@ -486,6 +1055,141 @@ static inline const char * get_register_name(int no)
 	}
 }
 
+/********************* token ring operations **********************************/
+#ifdef USE_THREADS
+
+/*
+ * push a word to token ring, waiting while it is full
+ * the word is dropped if the parser has given up
+ *
+ * @ring: token ring
+ * @key: attribute key, 0 for EOF
+ * @value: value of the word, not terminated
+ * @length: length of value
+ */
+static void push_ring(struct ring_t * ring, int key, const char * value,
+	size_t length)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	struct word_t * word;
+
+	while (tail - atomic_load_explicit(&ring->head,
+		memory_order_acquire) == RING_SIZE) {
+		if (atomic_load_explicit(&ring->stop, memory_order_relaxed)) {
+			return;
+		}
+		sched_yield();
+	}
+
+	word = &ring->words[tail & (RING_SIZE - 1)];
+	word->key = key;
+	if (length >= BUF_SIZE) {
+		length = BUF_SIZE - 1;
+	}
+	memcpy(word->value, value, length);
+	word->value[length] = '\0';
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * pop a word from token ring, waiting while it is empty
+ *
+ * @ring: token ring
+ * @word: a pointer to struct word_t to store the word
+ */
+static void pop_ring(struct ring_t * ring, struct word_t * word)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const struct word_t * slot;
+
+	while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+		sched_yield();
+	}
+
+	slot = &ring->words[head & (RING_SIZE - 1)];
+	word->key = slot->key;
+	strcpy(word->value, slot->value);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/*
+ * read a whole file into memory
+ *
+ * @fp: a FILE pointer
+ * @size: a pointer to store the size read
+ *
+ * return: the content, to be freed, NULL on failure
+ */
+static char * read_all(FILE * fp, size_t * size)
+{
+	char * buffer = NULL;
+	size_t capacity = 0, n;
+	void * p;
+
+	*size = 0;
+	do {
+		if (*size == capacity) {
+			capacity = capacity ? capacity << 1 : BUF_SIZE << 4;
+			if ((p = realloc(buffer, capacity)) == NULL) {
+				free(buffer);
+				return NULL;
+			}
+			buffer = p;
+		}
+		n = fread(buffer + *size, 1, capacity - *size, fp);
+		*size += n;
+	} while (n != 0);
+
+	if (ferror(fp)) {
+		free(buffer);
+		return NULL;
+	}
+	return buffer;
+}
+
+/*
+ * scanner thread, taking tokens of Java source from a lexer into token ring
+ * spaces and lines are dropped since the parser ignores them anyway, and
+ * integer constants are spelled in decimal, see spell_number()
+ *
+ * @arg: a pointer to struct scanner_t
+ *
+ * return: always NULL
+ */
+static void * do_scan(void * arg)
+{
+	struct scanner_t * scanner = arg;
+	struct lexer_t * lexer = NULL;
+	struct lex_token token;
+	char * buffer;
+	char value[BUF_SIZE];
+	size_t size;
+
+	if ((buffer = read_all(scanner->fp, &size)) == NULL ||
+		(lexer = do_open_lexer(buffer, size)) == NULL) {
+		perror("parse-java: cannot scan source");
+		goto out;
+	}
+	while (do_next_token(lexer, &token)) {
+		if (token.type == INT &&
+			!(token.number.flags & LEX_NUMBER_BAD)) {
+			push_ring(&scanner->ring, INT, value,
+				spell_number(value, &token.number));
+		} else if (token.type != SPACE && token.type != 0) {
+			push_ring(&scanner->ring, token.type, token.word,
+				token.length);
+		}
+	}
+
+out:
+	do_close_lexer(lexer);
+	free(buffer);
+	push_ring(&scanner->ring, 0, "", 0);
+	return NULL;
+}
+
+#endif /* USE_THREADS */
+
 /********************* main stuffs ********************************************/
 
 /*
@@ -495,15 +1199,15 @@ static inline const char * get_register_name(int no)
  *                      <line X has W word[s]> is a word counter line
  *                      <total W words> is a global word counter line
  *
- * @src: a FILE pointer of Java lexical analysis output file
+ * @src: source of words
  *
  * return: 1 if valid, 0 otherwise
  */
-static int do_validate_lex(FILE * src)
+static int do_validate_lex(struct source_t * src)
 {
 	struct word_t word;
 
-	rewind(src);
+	rewind_source(src);
 	while (1) {
 		/* extract the word of each line */
 		get_word(src, &word);
@@ -535,15 +1239,15 @@ static int do_validate_lex(FILE * src)
  *          P -> + | -
  *          M -> * | /
  *
- * @src: a FILE pointer of Java lexical analysis output file
+ * @src: source of words
  *
  * return: 1 if valid, 0 otherwise
  */
-static int do_validate_grammar(FILE * src)
+static int do_validate_grammar(struct source_t * src)
 {
 	int ret;
 
-	rewind(src);
+	rewind_source(src);
 	while (1) {
 		ret = CALL_CHECK(S, src);
 		/* error */
@@ -560,12 +1264,12 @@ static int do_validate_grammar(FILE * src)
 /*
  * do parse
  *
- * @src: a FILE pointer of Java lexical analysis output file
+ * @src: source of words
  * @out: a FILE pointer of output file
  */
-static void do_parse(FILE * src, FILE * out)
+static void do_parse(struct source_t * src, FILE * out)
 {
-	rewind(src);
+	rewind_source(src);
 	while (1) {
 		if (CALL_TRANSLATE(S, src, out) == -1) {
 			/* EOF */
@@ -601,7 +1305,7 @@ DEFINE_CHECK(S)
 	}
 
 	/* catch a 'while' */
-	if (check_word(&word, KEYWORD, "while")) {
+	if (check_keyword(&word, KW_WHILE)) {
 		/* catch a '(' */
 		get_word(src, &word);
 		if (!check_word(&word, BRACKET_DOT, "(")) {
@@ -653,7 +1357,7 @@ DEFINE_TRANSLATE_RETURN(S)
 	}
 
 	/* catch a 'while' */
-	if (check_word(&word, KEYWORD, "while")) {
+	if (check_keyword(&word, KW_WHILE)) {
 		/* generate label S.begin */
 		fprintf(out, "begin_%d:\n", ++begin_counter);
 